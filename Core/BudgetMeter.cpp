@@ -0,0 +1,102 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BudgetMeter.h"
+
+#include <algorithm>
+#include <string.h>
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  uint64_t pack (double elapsed, double budget)
+  {
+    const float values[2] = { (float) (elapsed * 1e6), (float) (budget * 1e6) };
+    uint64_t packed;
+    memcpy (&packed, values, sizeof (packed));
+    return packed;
+  }
+
+  void unpack (uint64_t packed, double& elapsed, double& budget)
+  {
+    float values[2];
+    memcpy (values, &packed, sizeof (packed));
+    elapsed = values[0] * 1e-6;
+    budget = values[1] * 1e-6;
+  }
+}
+
+BudgetMeter::BudgetMeter() :
+  overrunFraction (0.8)
+{
+  reset();
+}
+
+void BudgetMeter::add (double elapsed, double budget)
+{
+  const uint64_t n = numCallbacks.load (std::memory_order_relaxed);
+  history[n % historySize].store (pack (elapsed, budget), std::memory_order_relaxed);
+
+  if (elapsed > budget * getOverrunFraction())
+    numOverruns.fetch_add (1, std::memory_order_relaxed);
+
+  numCallbacks.store (n + 1, std::memory_order_release);
+}
+
+void BudgetMeter::reset()
+{
+  for (int i = 0; i < historySize; i++)
+    history[i].store (0, std::memory_order_relaxed);
+
+  numOverruns.store (0, std::memory_order_relaxed);
+  numCallbacks.store (0, std::memory_order_release);
+}
+
+void BudgetMeter::getCallback (int i, double& elapsed, double& budget) const
+{
+  const uint64_t n = getNumCallbacks();
+  unpack (history[(n - 1 - i) % historySize].load (std::memory_order_relaxed), elapsed, budget);
+}
+
+BudgetMeter::Stats BudgetMeter::getRecentStats() const
+{
+  Stats stats = { 0, 0, 0, 0 };
+  stats.numCallbacks = (int) std::min<uint64_t> (getNumCallbacks(), historySize);
+
+  double sum = 0;
+  for (int i = 0; i < stats.numCallbacks; i++)
+  {
+    double elapsed, budget;
+    getCallback (i, elapsed, budget);
+
+    const double load = budget > 0 ? elapsed / budget : 0;
+    sum += load;
+    stats.maxLoad = std::max (stats.maxLoad, load);
+
+    if (i == 0)
+      stats.lastLoad = load;
+  }
+
+  stats.meanLoad = stats.numCallbacks > 0 ? sum / stats.numCallbacks : 0;
+  return stats;
+}
@@ -0,0 +1,87 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __BUDGETMETER_H_DEFINED
+#define __BUDGETMETER_H_DEFINED
+
+#include <atomic>
+#include <stdint.h>
+
+namespace StimDetectorSpace {
+
+  /**
+
+    Wall time of each processing callback against the duration of its buffer.
+
+    The last historySize callbacks are kept in a ring for rolling statistics
+    and export; calls over the overrun fraction of their budget are counted
+    for the whole run. One thread adds, any thread reads, nothing locks.
+
+  */
+  class BudgetMeter
+  {
+  public:
+    enum { historySize = 1024 };
+
+    BudgetMeter();
+
+    /** Audio thread: one callback that took elapsed seconds for a buffer of budget seconds. */
+    void add (double elapsed, double budget);
+
+    /** Clears the history and the counters; the overrun fraction is kept. */
+    void reset();
+
+    /** Fraction of the budget above which a callback counts as an overrun. */
+    void setOverrunFraction (double fraction)   { overrunFraction.store (fraction, std::memory_order_relaxed); }
+    double getOverrunFraction() const           { return overrunFraction.load (std::memory_order_relaxed); }
+
+    uint64_t getNumCallbacks() const            { return numCallbacks.load (std::memory_order_acquire); }
+    uint64_t getNumOverruns() const             { return numOverruns.load (std::memory_order_relaxed); }
+
+    /** Wall time and budget of the i-th most recent callback (0 is the last), in seconds. */
+    void getCallback (int i, double& elapsed, double& budget) const;
+
+    /** Load (wall time over budget) of the callbacks still in the history. */
+    struct Stats
+    {
+      int numCallbacks;
+      double meanLoad;
+      double maxLoad;
+      double lastLoad;
+    };
+
+    Stats getRecentStats() const;
+
+  private:
+    std::atomic<uint64_t> history[historySize]; //wall time and budget as two float microseconds
+    std::atomic<uint64_t> numCallbacks;
+    std::atomic<uint64_t> numOverruns;
+    std::atomic<double> overrunFraction;
+
+    BudgetMeter (const BudgetMeter&);
+    BudgetMeter& operator= (const BudgetMeter&);
+  };
+
+}
+
+#endif  // __BUDGETMETER_H_DEFINED
@@ -0,0 +1,171 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DetectorBank.h"
+#include <algorithm>
+#include <string.h>
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  int nextPowerOfTwo (int n)
+  {
+    int p = 1;
+    while (p < n)
+      p <<= 1;
+    return p;
+  }
+}
+
+DetectorBank::DetectorBank()
+  : numDetectors    (0)
+  , windowCapacity  (0)
+  , stride          (0)
+  , historyCapacity (0)
+  , stim            (nullptr)
+{
+  prepare (0, 0, 0);
+}
+
+void DetectorBank::prepare (int newNumDetectors, int newWindowCapacity, int historyLength)
+{
+  const size_t slots = (size_t) std::max (1, newNumDetectors);
+
+  // history is not kept across a resize, it refills within a few ms
+  const int newHistoryCapacity = nextPowerOfTwo (std::max (1, historyLength));
+
+  if (newHistoryCapacity != historyCapacity || newNumDetectors != numDetectors)
+  {
+    historyCapacity = newHistoryCapacity;
+    history.assign (slots * historyCapacity, 0.0f);
+    historyPos.assign (slots, 0);
+  }
+
+  if (newNumDetectors == numDetectors && newWindowCapacity <= windowCapacity && stim != nullptr)
+    return;
+
+  const int oldNumDetectors = numDetectors;
+
+  // resize() keeps the state of the detectors that already exist
+  threshold.resize           (slots, 0.0);
+  matcher.resize             (slots, nullptr);
+  matchThreshold.resize      (slots, 0.8);
+  differentiator.resize      (slots, nullptr);
+  prefilter.resize           (slots, nullptr);
+  outputChan.resize          (slots, -1);
+  lastSample.resize          (slots, 0.0f);
+  lastDiff.resize            (slots, 0.0f);
+  samplesSinceTrigger.resize (slots, 5000);
+  startIndex.resize          (slots, -1);
+  windowIndex.resize         (slots, -1);
+  windowStart.resize         (slots, 0);
+  count.resize               (slots, 0);
+  windowLength.resize        (slots, 0);
+  preLength.resize           (slots, 0);
+  ttlLength.resize           (slots, 0);
+  wasTriggered.resize        (slots, 0);
+  startStim.resize           (slots, 0);
+  detectorStim.resize        (slots, 1);
+  ignoreFirst.resize         (slots, 1);
+  gatedWindow.resize         (slots, 0);
+  gateError.resize           (slots, 0);
+  gateAligned.resize         (slots, 0);
+
+  // queued onsets only live for one buffer
+  gateSample.assign (slots * maxGateOnsets, 0);
+  gateTimestamp.assign (slots * maxGateOnsets, 0);
+  numGates.assign (slots, 0);
+  nextGate.assign (slots, 0);
+
+  // stim windows, each one starting on a cache line
+  const int newCapacity = std::max (newWindowCapacity, windowCapacity);
+  const int newStride = std::max (1, (newCapacity + valuesPerLine - 1) / valuesPerLine) * valuesPerLine;
+  const size_t values = slots * newStride;
+
+  std::vector<char> newStorage (values * sizeof (double) + cacheLine, 0);
+
+  char* aligned = newStorage.data() + (cacheLine - ((uintptr_t) newStorage.data() & (cacheLine - 1))) % cacheLine;
+  double* newStim = (double*) aligned;
+
+  for (int d = 0; d < std::min (oldNumDetectors, newNumDetectors); d++)
+    memcpy (newStim + (size_t) d * newStride, getStim (d), sizeof (double) * windowCapacity);
+
+  sweepStorage.swap (newStorage);
+  stim = newStim;
+
+  numDetectors = newNumDetectors;
+  windowCapacity = newCapacity;
+  stride = newStride;
+}
+
+void DetectorBank::writeHistory (int d, const float* input, int numSamples)
+{
+  float* ring = history.data() + (size_t) d * historyCapacity;
+
+  // only the newest historyCapacity samples survive
+  if (numSamples >= historyCapacity)
+  {
+    memcpy (ring, input + numSamples - historyCapacity, sizeof (float) * historyCapacity);
+    historyPos[d] = 0;
+    return;
+  }
+
+  const int pos = historyPos[d];
+  const int first = std::min (numSamples, historyCapacity - pos);
+
+  memcpy (ring + pos, input, sizeof (float) * first);
+  memcpy (ring, input + first, sizeof (float) * (numSamples - first));
+
+  historyPos[d] = (pos + numSamples) & (historyCapacity - 1);
+}
+
+bool DetectorBank::addGateOnset (int d, int bufferIndex, int64_t timestamp)
+{
+  if (numGates[d] >= maxGateOnsets)
+    return false;
+
+  // events arrive in buffer order, so the queue stays sorted
+  const int slot = d * maxGateOnsets + numGates[d]++;
+  gateSample[slot] = bufferIndex;
+  gateTimestamp[slot] = timestamp;
+  return true;
+}
+
+int DetectorBank::findGateOnset (int d, int bufferIndex)
+{
+  const int* onsets = gateSample.data() + d * maxGateOnsets;
+
+  while (nextGate[d] < numGates[d] && onsets[nextGate[d]] < bufferIndex)
+    nextGate[d]++;
+
+  return nextGate[d] < numGates[d] ? onsets[nextGate[d]] : -1;
+}
+
+void DetectorBank::clearGateOnsets()
+{
+  for (int d = 0; d < numDetectors; d++)
+  {
+    numGates[d] = 0;
+    nextGate[d] = 0;
+  }
+}
@@ -0,0 +1,139 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __DETECTORBANK_H_DEFINED
+#define __DETECTORBANK_H_DEFINED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace StimDetectorSpace {
+
+  class Differentiator;
+  class Prefilter;
+  class TemplateMatcher;
+
+  /**
+
+    Real-time state of every detector in a node, stored as a struct of arrays.
+
+    Each array holds one entry per detector, and the stim windows of all
+    detectors live in a single block with every window starting on its own
+    cache line. Sample w of a window has timestamp windowStart + w. Running
+    statistics of the sweeps belong to their consumer (SweepStatistics), not to
+    the bank. Only prepare() allocates.
+
+    @see DetectorEngine
+  */
+  struct DetectorBank
+  {
+    DetectorBank();
+
+    /** Resizes the bank for numDetectors detectors, windows of up to windowCapacity samples
+        and historyLength samples of pre-trigger history, keeping the state of the detectors
+        that already exist. Not real-time safe. */
+    void prepare (int numDetectors, int windowCapacity, int historyLength);
+
+    int size() const                    { return numDetectors; }
+    int getWindowCapacity() const       { return windowCapacity; }
+
+    double* getStim (int d) const       { return stim + (size_t) d * stride; }
+
+    /** Appends a block of input to the history ring of detector d, with at most two copies. */
+    void writeHistory (int d, const float* input, int numSamples);
+
+    /** Input sample offset samples before the first sample of the current block (offset < 0).
+        Only the last getHistoryCapacity() samples are kept. */
+    float getHistorySample (int d, int offset) const
+    {
+      return history[(size_t) d * historyCapacity + ((historyPos[d] + historyCapacity + offset) & (historyCapacity - 1))];
+    }
+
+    int getHistoryCapacity() const      { return historyCapacity; }
+
+    enum { maxGateOnsets = 8 };        //gate onsets kept per detector and buffer
+
+    /** Queues a gate onset at sample bufferIndex of the current buffer; returns false when full. */
+    bool addGateOnset (int d, int bufferIndex, int64_t timestamp);
+
+    /** Skips the onsets before bufferIndex and returns the buffer index of the next one, or -1. */
+    int findGateOnset (int d, int bufferIndex);
+
+    /** Consumes the onset returned by findGateOnset() and returns its timestamp. */
+    int64_t takeGateOnset (int d)       { return gateTimestamp[d * maxGateOnsets + nextGate[d]++]; }
+
+    /** Drops every queued onset, at the start of each buffer. */
+    void clearGateOnsets();
+
+    std::vector<double> threshold;          //threshold of detection
+    std::vector<TemplateMatcher*> matcher;  //template detection instead of the diff threshold, not owned
+    std::vector<double> matchThreshold;     //correlation that triggers a template detector
+    std::vector<Differentiator*> differentiator; //diff of the threshold test, null for the first difference, not owned
+    std::vector<Prefilter*> prefilter;      //IIR stage ahead of detection and capture, null for none, not owned
+    std::vector<int> outputChan;            //TTL output channel, inactive when < 0
+    std::vector<float> lastSample;          //last input data, after the prefilter
+    std::vector<float> lastDiff;            //last input diff data, or correlation of a template detector
+    std::vector<int> samplesSinceTrigger;   //ttl interval count
+    std::vector<int> startIndex;            //intput index
+    std::vector<int> windowIndex;           //avg index
+    std::vector<int64_t> windowStart;       //timestamp of the first window sample
+    std::vector<int> count;                 //windows in the current avg row, reset from the audio thread
+    std::vector<int> windowLength;          //samples in the window, pre-trigger included
+    std::vector<int> preLength;             //pre-trigger samples at the start of the window
+    std::vector<int> ttlLength;             //samples in the ttl
+    std::vector<uint8_t> wasTriggered;      //ttl interval
+    std::vector<uint8_t> startStim;         //stim interval
+    std::vector<uint8_t> detectorStim;      //internal ttl detector
+    std::vector<uint8_t> ignoreFirst;       //fix first diff value
+    std::vector<uint8_t> gatedWindow;       //the open window was started by the gate
+    std::vector<int64_t> gateError;         //first trigger candidate of the gated window minus the gate onset, in samples
+    std::vector<uint8_t> gateAligned;       //gateError holds a candidate of the open gated window
+
+    std::vector<int> gateSample;            //queued gate onsets, maxGateOnsets per detector
+    std::vector<int64_t> gateTimestamp;     //timestamp of each queued onset
+    std::vector<int> numGates;              //onsets queued in this buffer
+    std::vector<int> nextGate;              //first queued onset not reached yet
+
+    std::vector<int> historyPos;            //next write position in the history ring
+
+  private:
+    enum { cacheLine = 64, valuesPerLine = cacheLine / sizeof (double) };
+
+    int numDetectors;
+    int windowCapacity;
+    int stride;                             //values between two windows
+
+    int historyCapacity;                    //power of two, per detector
+    std::vector<float> history;             //last input samples of every detector
+
+    std::vector<char> sweepStorage;
+    double* stim;
+
+    DetectorBank (const DetectorBank&);
+    DetectorBank& operator= (const DetectorBank&);
+  };
+
+}
+
+#endif  // __DETECTORBANK_H_DEFINED
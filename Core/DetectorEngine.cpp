@@ -0,0 +1,374 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DetectorEngine.h"
+#include "Differentiator.h"
+#include "Prefilter.h"
+#include "StimDetectorKernels.h"
+#include "TemplateMatcher.h"
+#include <algorithm>
+
+using namespace StimDetectorSpace;
+
+DetectorEngine::Scratch::Scratch()
+  : diff          (Kernels::blockSize)
+  , match         (Kernels::blockSize)
+  , derivative    (Kernels::blockSize)
+  , output        (Kernels::blockSize)
+  , filtered      (Kernels::blockSize)
+  , firstFiltered (Kernels::blockSize)
+  , candidateMask (Kernels::maskWords)
+{
+}
+
+DetectorEngine::DetectorEngine (DetectorBank& b)
+  : bank (b)
+{
+}
+
+// One pass over an input channel serves every detector reading it
+void DetectorEngine::processChannel (const int* detectors, int numDetectors,
+                                     const float* input, int numSamples, int64_t bufferTimestamp,
+                                     Scratch& scratch, TtlEventBuffer& events, WindowSink& sink,
+                                     float* diffOut)
+{
+  // a separate output channel takes the kernels' output directly; in place it waits for the captures
+  const bool directOut = diffOut != nullptr && diffOut != input;
+
+  for (int blockStart = 0; blockStart < numSamples; blockStart += Kernels::blockSize)
+  {
+    const int blockLength = std::min ((int) Kernels::blockSize, numSamples - blockStart);
+    const float* block = input + blockStart;
+    float* out = directOut ? diffOut + blockStart : scratch.output.data();
+
+    const float* sharedDiff = nullptr;  //diff of the unfiltered block, shared by detectors
+    float diffFrom = 0.0f;              //lastSample it was computed from
+    bool haveActive = false;
+    const float* outBlock = block;      //detection input of the first active detector, for diffOut
+    float blockFrom = 0.0f;             //and its lastSample
+    bool haveOutput = false;            //a trigger diff was written to out
+
+    for (int k = 0; k < numDetectors; ++k)
+    {
+      const int d = detectors[k];
+
+      // check to see if it's active
+      if (bank.outputChan[d] < 0)
+        continue;
+
+      // a prefiltered detector detects and captures its own copy of the block
+      const float* source = block;
+      if (bank.prefilter[d] != nullptr)
+      {
+        float* filtered = haveActive ? scratch.filtered.data() : scratch.firstFiltered.data();
+        bank.prefilter[d]->process (block, blockLength, filtered);
+        source = filtered;
+      }
+
+      if (!haveActive)
+      {
+        outBlock = source;
+        blockFrom = bank.lastSample[d];
+        haveActive = true;
+      }
+
+      // the first detector with a trigger diff writes it to diffOut
+      const bool feedsOutput = diffOut != nullptr && !haveOutput;
+
+      if (bank.matcher[d] != nullptr)
+      {
+        // rising through the correlation threshold, the same test as a diff candidate
+        float* match = scratch.match.data();
+        bank.matcher[d]->process (source, blockLength, match);
+        Kernels::detectCandidates (match, blockLength, bank.lastDiff[d], (float) bank.matchThreshold[d], 2.0f,
+                                   scratch.candidateMask.data());
+        bank.lastDiff[d] = match[blockLength - 1];
+      }
+      else
+      {
+        const float* trigger;
+
+        if (bank.differentiator[d] != nullptr)
+        {
+          // per detector FIR state, nothing to share
+          float* derivative = feedsOutput ? out : scratch.derivative.data();
+          bank.differentiator[d]->process (source, blockLength, derivative);
+          trigger = derivative;
+        }
+        else if (source == block && sharedDiff != nullptr && bank.lastSample[d] == diffFrom)
+        {
+          trigger = sharedDiff;
+        }
+        else
+        {
+          // the diff is shared, unless this detector carries a different last sample or a filter;
+          // a filtered diff goes to the per-detector buffer so the shared one stays valid
+          float* diff = feedsOutput ? out : source == block ? scratch.diff.data() : scratch.derivative.data();
+          Kernels::computeDiff (source, blockLength, bank.lastSample[d], diff);
+          if (source == block)
+          {
+            sharedDiff = diff;
+            diffFrom = bank.lastSample[d];
+          }
+          trigger = diff;
+        }
+
+        float lowerBound, upperBound;
+        Kernels::getThresholdBounds (bank.threshold[d], lowerBound, upperBound);
+        Kernels::detectCandidates (trigger, blockLength, bank.lastDiff[d], lowerBound, upperBound, scratch.candidateMask.data());
+        bank.lastDiff[d] = trigger[blockLength - 1];
+
+        if (feedsOutput && trigger != out)
+          std::copy (trigger, trigger + blockLength, out);
+        haveOutput = haveOutput || feedsOutput;
+      }
+
+      processBlock (scratch, events, sink, d, source, blockStart, blockLength, bufferTimestamp);
+
+      if (bank.preLength[d] > 0 || getTriggerDelay (d) > 0)
+        bank.writeHistory (d, source, blockLength);
+
+      bank.lastSample[d] = source[blockLength - 1];
+    }
+
+    if (diffOut != nullptr && haveActive)
+    {
+      // only template detectors: the first difference of the first one's input
+      if (!haveOutput)
+        Kernels::computeDiff (outBlock, blockLength, blockFrom, out);
+
+      // input is only overwritten once every window has captured the original samples
+      if (!directOut)
+        std::copy (out, out + blockLength, diffOut + blockStart);
+    }
+    else if (directOut)
+    {
+      // nothing detects on this channel: a separate output stays silent, the input stays raw
+      std::fill (diffOut + blockStart, diffOut + blockStart + blockLength, 0.0f);
+    }
+  }
+}
+
+void DetectorEngine::processBlock (Scratch& scratch, TtlEventBuffer& events, WindowSink& sink,
+                                   int d, const float* input, int blockStart, int blockLength, int64_t bufferTimestamp)
+{
+  const uint32_t* candidateMask = scratch.candidateMask.data();
+
+  int& startIndex = bank.startIndex[d];
+  int& windowIndex = bank.windowIndex[d];
+  int& samplesSinceTrigger = bank.samplesSinceTrigger[d];
+  uint8_t& startStim = bank.startStim[d];
+  uint8_t& detectorStim = bank.detectorStim[d];
+
+  int i = 0;
+  while (i < blockLength)
+  {
+    // next sample where the state machine has something to decide
+    int next = blockLength;
+    int gate = -1;
+
+    if (startStim && (startIndex < 0 || !detectorStim))
+      next = i;                                                           //gate start
+
+    if (startIndex < 0)
+    {
+      gate = bank.findGateOnset (d, blockStart + i) - blockStart;        //queued gate onset
+      if (gate >= i && gate < next)
+        next = gate;
+    }
+
+    if (detectorStim)
+    {
+      if (!startStim)
+        next = Kernels::findNextCandidate (candidateMask, i, next);      //trigger
+      if (bank.wasTriggered[d])
+        next = std::min (next, i + std::max (0, bank.ttlLength[d] + 1 - samplesSinceTrigger)); //end of TTL
+    }
+
+    if (startIndex >= 0)
+      next = std::min (next, i + std::max (0, bank.windowLength[d] - windowIndex));     //end of window
+
+    // nothing happens in [i, next): advance counters and capture in bulk
+    if (next > i)
+    {
+      if (detectorStim && bank.wasTriggered[d])
+        samplesSinceTrigger += next - i;
+
+      if (startIndex >= 0)
+      {
+        captureWindow (d, input, i, next);
+        alignGate (d, candidateMask, i, next, bufferTimestamp + blockStart);
+      }
+      else
+      {
+        windowIndex = -1;
+        startStim = false;
+      }
+    }
+
+    if (next < blockLength)
+    {
+      // the gate opens the window at its own sample, not at the start of the buffer
+      if (next == gate && startIndex < 0)
+      {
+        bank.takeGateOnset (d);
+        startStim = true;
+        detectorStim = false;
+      }
+
+      processSample (scratch, events, sink, d, input, blockStart, next, bufferTimestamp);
+    }
+
+    i = next + 1;
+  }
+}
+
+void DetectorEngine::processSample (Scratch& scratch, TtlEventBuffer& events, WindowSink& sink,
+                                    int d, const float* input, int blockStart, int i, int64_t bufferTimestamp)
+{
+  const int outputChan = bank.outputChan[d];
+  const int bufferIndex = blockStart + i;
+  const int delay = getTriggerDelay (d);
+
+  bank.ignoreFirst[d] = (bufferTimestamp == 0 && bufferIndex == 0);
+
+  if (bank.detectorStim[d])               // Gate disableded
+  {
+    if (Kernels::isCandidate (scratch.candidateMask.data(), i) //variacao brusca, acima do limiar e abaixo de 5x o limiar
+    && !bank.startStim[d]                 //fora do TTL
+    && !bank.ignoreFirst[d])              //nao e o primeiro
+    {
+      //start TTL
+      const TtlEvent on = { d, bufferIndex, bufferTimestamp + bufferIndex - delay, outputChan, (uint8_t) (1 << outputChan) };
+      events.add (on);
+      bank.samplesSinceTrigger[d] = 0;
+      bank.wasTriggered[d] = true;
+      bank.startStim[d] = true;
+
+      //config avg
+      startWindow (d, input, blockStart, i, delay, bufferTimestamp);
+      bank.gatedWindow[d] = false;
+    }
+
+    //durante TTL
+    if (bank.wasTriggered[d])
+    {
+    //finalizacao do TTL
+      if (bank.samplesSinceTrigger[d] > bank.ttlLength[d])
+      {
+        const TtlEvent off = { d, bufferIndex, bufferTimestamp + bufferIndex - delay, outputChan, 0 };
+        events.add (off);
+        bank.wasTriggered[d] = false;
+      }
+      else
+      {
+        bank.samplesSinceTrigger[d]++;
+      }
+    }
+  } // end gate disableded
+
+  /* TTL gate enableded */
+  if (!bank.detectorStim[d] && bank.startStim[d]) //gate receive TTL
+  {
+    startWindow (d, input, blockStart, i, 0, bufferTimestamp);
+    bank.startStim[d] = false;
+    bank.gatedWindow[d] = true;
+    bank.gateAligned[d] = false;
+  }
+
+  // inside window
+  if (bank.startIndex[d] >= 0 && bank.windowIndex[d] < bank.windowLength[d])
+  {
+    captureWindow (d, input, i, i + 1);
+    alignGate (d, scratch.candidateMask.data(), i, i + 1, bufferTimestamp + blockStart);
+  }
+  else { //avgLength ended
+
+    // the sink keeps the running statistics, off the audio thread
+    if (bank.startStim[d] || bank.gatedWindow[d])
+      sink.windowClosed (d);
+
+    // disabled references
+    bank.startIndex[d] = -1;
+    bank.windowIndex[d] = -1;
+    bank.startStim[d] = false;
+    bank.gatedWindow[d] = false;
+  }
+}
+
+// Opens a window at block sample i, with the pre-trigger samples taken from the block
+// itself and, before the block, from the history ring. A trigger that lags the input by
+// delay samples dates the window back by it, so sample preLength is still the stim
+void DetectorEngine::startWindow (int d, const float* input, int blockStart, int i, int delay, int64_t bufferTimestamp)
+{
+  const int preLength = std::min (bank.preLength[d] + delay,
+                                  std::min (bank.windowLength[d], std::max (bank.preLength[d], bank.getHistoryCapacity())));
+
+  bank.startIndex[d] = blockStart + i;
+  bank.windowIndex[d] = preLength;
+  bank.windowStart[d] = bufferTimestamp + blockStart + i - preLength;
+  bank.count[d]++;
+
+  if (preLength == 0)
+    return;
+
+  double* stim = bank.getStim (d);
+
+  // samples before the block come from the history ring, the rest in one run
+  const int fromHistory = std::min (preLength, preLength - i);
+  for (int w = 0; w < fromHistory; ++w)
+    stim[w] = bank.getHistorySample (d, i - preLength + w) / getStimScale();
+
+  const int fromBlock = preLength - std::max (0, fromHistory);
+  Kernels::convertSamples (input + i - fromBlock, fromBlock, getStimScale(), stim + preLength - fromBlock);
+}
+
+void DetectorEngine::captureWindow (int d, const float* input, int start, int end)
+{
+  Kernels::convertSamples (input + start, end - start, getStimScale(), bank.getStim (d) + bank.windowIndex[d]);
+  bank.windowIndex[d] += end - start;
+}
+
+// The gate is measured against the stim as the detector sees it: the first sample of a
+// gated window that would have triggered, dated back by the trigger delay
+void DetectorEngine::alignGate (int d, const uint32_t* candidateMask, int start, int end, int64_t blockTimestamp)
+{
+  if (!bank.gatedWindow[d] || bank.gateAligned[d])
+    return;
+
+  const int candidate = Kernels::findNextCandidate (candidateMask, start, end);
+  if (candidate >= end)
+    return;
+
+  bank.gateError[d] = blockTimestamp + candidate - getTriggerDelay (d) - (bank.windowStart[d] + bank.preLength[d]);
+  bank.gateAligned[d] = true;
+}
+
+// A template match is reported at the last sample of the matched segment, a symmetric FIR
+// derivative half its length late; the matcher is the trigger when there is one
+int DetectorEngine::getTriggerDelay (int d) const
+{
+  if (bank.matcher[d] != nullptr)
+    return bank.matcher[d]->getTemplateLength() - 1;
+
+  return bank.differentiator[d] != nullptr ? bank.differentiator[d]->getDelay() : 0;
+}
@@ -0,0 +1,145 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __DETECTORENGINE_H_DEFINED
+#define __DETECTORENGINE_H_DEFINED
+
+#include "DetectorBank.h"
+
+namespace StimDetectorSpace {
+
+  /** TTL change emitted by a detector. */
+  struct TtlEvent
+  {
+    int detector;                       //detector index in the bank
+    int sampleNum;                      //sample in the buffer
+    int64_t timestamp;                  //timestamp of the input sample that set it off
+    int channel;                        //TTL output channel
+    uint8_t ttlData;                    //TTL state
+  };
+
+  /** Fixed-capacity list of the TTL changes of one call, allocated once by its constructor.
+      Past capacity an event is dropped and counted instead of growing the storage. */
+  class TtlEventBuffer
+  {
+  public:
+    explicit TtlEventBuffer (int capacity = defaultCapacity) : events ((size_t) capacity), numEvents (0), numDropped (0) {}
+
+    void add (const TtlEvent& event)
+    {
+      if (numEvents < (int) events.size())
+        events[(size_t) numEvents++] = event;
+      else
+        ++numDropped;
+    }
+
+    /** Forgets the events; the dropped count is kept. */
+    void clear() { numEvents = 0; }
+
+    const TtlEvent* begin() const { return events.data(); }
+    const TtlEvent* end() const { return events.data() + numEvents; }
+    int size() const { return numEvents; }
+    int getCapacity() const { return (int) events.size(); }
+    uint64_t getNumDropped() const { return numDropped; }
+    void resetNumDropped() { numDropped = 0; }
+
+    enum { defaultCapacity = 256 };    //two per trigger, far more than one buffer of a channel produces
+
+  private:
+    std::vector<TtlEvent> events;
+    int numEvents;
+    uint64_t numDropped;
+  };
+
+  /** Receives the windows closed by DetectorEngine, while their samples are still in the bank. */
+  class WindowSink
+  {
+  public:
+    virtual ~WindowSink() {}
+    virtual void windowClosed (int detector) = 0;
+  };
+
+  /**
+
+    Trigger detection, TTL generation and window capture for the detectors of a
+    DetectorBank, with no dependency on the host.
+
+    The caller hands over one input channel at a time together with the detectors
+    that read it; the engine runs the diff once per block, each detector's threshold
+    pass and its state machine, and reports TTL changes and closed windows. A
+    detector with a TemplateMatcher triggers on its correlation instead of the diff.
+
+    @see DetectorBank
+  */
+  class DetectorEngine
+  {
+  public:
+    /** Per-thread scratch of processChannel(). */
+    struct Scratch
+    {
+      Scratch();
+
+      std::vector<float> diff;              //|x[n] - x[n-1]| of the current block
+      std::vector<float> match;             //template correlation of the current block
+      std::vector<float> derivative;        //differentiator output or prefiltered diff of the current detector
+      std::vector<float> output;            //diffOut block, when written in place
+      std::vector<float> filtered;          //prefiltered block of the current detector
+      std::vector<float> firstFiltered;     //that of the first active detector, kept for diffOut
+      std::vector<uint32_t> candidateMask;  //samples that pass the trigger thresholds
+    };
+
+    DetectorEngine (DetectorBank& bank);
+
+    /** Runs detectors[0 .. numDetectors) over numSamples samples of the input channel they
+        all read. TTL changes are added to events in processing order; if diffOut is not
+        null it receives the trigger diff of the first active detector that has one, |x[n] - x[n-1]|
+        of its prefiltered input by default. diffOut may alias the input; a separate diffOut is written by
+        the kernels directly, and zeroed when no detector is active. Detectors on different
+        channels share nothing, so calls for different channels may run in parallel with their
+        own scratch, events and sink. TTL timestamps and windows are dated back by the delay
+        of the trigger: the template length - 1 of a TemplateMatcher, otherwise the
+        Differentiator delay. The history must hold preLength plus the longest delay. */
+    void processChannel (const int* detectors, int numDetectors,
+                         const float* input, int numSamples, int64_t bufferTimestamp,
+                         Scratch& scratch, TtlEventBuffer& events, WindowSink& sink,
+                         float* diffOut);
+
+    /** Scale of the stim window: input units per stim unit. */
+    static double getStimScale() { return 0.1950 * 1000; }
+
+  private:
+    void processBlock (Scratch& scratch, TtlEventBuffer& events, WindowSink& sink,
+                       int d, const float* input, int blockStart, int blockLength, int64_t bufferTimestamp);
+    void processSample (Scratch& scratch, TtlEventBuffer& events, WindowSink& sink,
+                        int d, const float* input, int blockStart, int i, int64_t bufferTimestamp);
+    void startWindow (int d, const float* input, int blockStart, int i, int delay, int64_t bufferTimestamp);
+    void captureWindow (int d, const float* input, int start, int end);
+    void alignGate (int d, const uint32_t* candidateMask, int start, int end, int64_t blockTimestamp);
+    int getTriggerDelay (int d) const;
+
+    DetectorBank& bank;
+  };
+
+}
+
+#endif  // __DETECTORENGINE_H_DEFINED
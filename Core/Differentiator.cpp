@@ -0,0 +1,184 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Differentiator.h"
+#include "StimDetectorKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  const double pi = 3.14159265358979323846;
+
+  // slope at the centre of the least-squares polynomial through x[-half..half]: the sum of
+  // q(j) q'(0) over the polynomials q orthonormal on those points. They are built by
+  // Gram-Schmidt from j q(j), which stays well conditioned where the power sums of the
+  // normal equations do not
+  void designSavitzkyGolay (int half, int order, std::vector<double>& centred)
+  {
+    const int points = 2 * half + 1;
+
+    std::vector<double> q (points, 1.0 / std::sqrt ((double) points));   //q_0, then each q_k in turn
+    std::vector<std::vector<double>> basis;
+    std::vector<double> slope;                                           //q_k'(0)
+    basis.push_back (q);
+    slope.push_back (0.0);
+
+    for (int k = 1; k <= order; k++)
+    {
+      // v(j) = j q_{k-1}(j), so v'(0) = q_{k-1}(0)
+      std::vector<double> v (points);
+      for (int j = -half; j <= half; j++)
+        v[j + half] = j * basis[k - 1][j + half];
+      double dv = basis[k - 1][half];
+
+      // twice against every earlier polynomial, for the rounding of the first pass
+      for (int pass = 0; pass < 2; pass++)
+      {
+        for (int i = 0; i < k; i++)
+        {
+          double c = 0;
+          for (int n = 0; n < points; n++)
+            c += v[n] * basis[i][n];
+          for (int n = 0; n < points; n++)
+            v[n] -= c * basis[i][n];
+          dv -= c * slope[i];
+        }
+      }
+
+      double norm = 0;
+      for (int n = 0; n < points; n++)
+        norm += v[n] * v[n];
+      norm = std::sqrt (norm);
+
+      for (int n = 0; n < points; n++)
+        v[n] /= norm;
+      basis.push_back (v);
+      slope.push_back (dv / norm);
+    }
+
+    for (int n = 0; n < points; n++)
+    {
+      double c = 0;
+      for (int k = 0; k <= order; k++)
+        c += basis[k][n] * slope[k];
+      centred[n] = c;
+    }
+  }
+
+  // ideal differentiator band-limited to cutoff * pi, Hamming windowed
+  void designBandLimited (int half, double cutoff, std::vector<double>& centred)
+  {
+    const double wc = pi * std::min (1.0, std::max (0.01, cutoff));
+
+    for (int j = -half; j <= half; j++)
+    {
+      double h = 0;
+      if (j != 0)
+        h = (wc * j * std::cos (wc * j) - std::sin (wc * j)) / (pi * j * j);
+
+      const double window = 0.54 + 0.46 * std::cos (pi * j / (half + 1));
+      centred[j + half] = -h * window;
+    }
+  }
+}
+
+void StimDetectorSpace::designDifferentiator (const DifferentiatorSettings& settings, std::vector<float>& taps)
+{
+  std::vector<double> centred;
+
+  switch (settings.type)
+  {
+    case DifferentiatorSettings::centralDifference:
+      centred = { -0.5, 0.0, 0.5 };
+      break;
+
+    case DifferentiatorSettings::savitzkyGolay:
+    case DifferentiatorSettings::bandLimited:
+    {
+      const int half = std::max (1, std::min ((int) DifferentiatorSettings::maxLength, settings.length) / 2);
+      centred.assign (2 * half + 1, 0.0);
+
+      if (settings.type == DifferentiatorSettings::savitzkyGolay)
+        designSavitzkyGolay (half, std::min (2 * half, std::max (1, settings.order)), centred);
+      else
+        designBandLimited (half, settings.cutoff, centred);
+      break;
+    }
+
+    default:
+      centred = { -1.0, 1.0 };
+      break;
+  }
+
+  // centred[i] weighs x[centre - half + i]; scale to a slope of exactly 1 on a ramp
+  const int numTaps = (int) centred.size();
+  const double half = (numTaps - 1) / 2.0;
+
+  double slope = 0;
+  for (int i = 0; i < numTaps; i++)
+    slope += centred[i] * (i - half);
+
+  taps.resize (numTaps);
+  for (int k = 0; k < numTaps; k++)
+    taps[k] = (float) (centred[numTaps - 1 - k] / slope);
+}
+
+Differentiator::Differentiator (const DifferentiatorSettings& s, int maxBlockSize) :
+  settings (s),
+  maxBlock (std::max (1, maxBlockSize)),
+  primed (false)
+{
+  designDifferentiator (settings, taps);
+  segment.assign (taps.size() - 1 + maxBlock, 0.0f);
+}
+
+void Differentiator::reset()
+{
+  std::fill (segment.begin(), segment.end(), 0.0f);
+  primed = false;
+}
+
+void Differentiator::process (const float* input, int numSamples, float* out)
+{
+  const int history = (int) taps.size() - 1;
+
+  if (!primed && numSamples > 0)
+  {
+    std::fill (segment.begin(), segment.begin() + history, input[0]);
+    primed = true;
+  }
+
+  for (int done = 0; done < numSamples; )
+  {
+    const int n = std::min (maxBlock, numSamples - done);
+
+    std::copy (input + done, input + done + n, segment.begin() + history);
+    Kernels::differentiate (segment.data() + history, n, taps.data(), (int) taps.size(), out + done);
+    std::copy (segment.begin() + n, segment.begin() + n + history, segment.begin());
+
+    done += n;
+  }
+}
@@ -0,0 +1,93 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __DIFFERENTIATOR_H_DEFINED
+#define __DIFFERENTIATOR_H_DEFINED
+
+#include <vector>
+
+namespace StimDetectorSpace {
+
+  /** Shape of the derivative a detector triggers on. */
+  struct DifferentiatorSettings
+  {
+    enum Type
+    {
+      firstDifference,            //x[n] - x[n-1], the engine's shared diff
+      centralDifference,          //(x[n] - x[n-2]) / 2
+      savitzkyGolay,              //slope of a least-squares polynomial over length samples
+      bandLimited                 //windowed ideal differentiator, flat to zero above cutoff
+    };
+
+    DifferentiatorSettings() : type(firstDifference), length(7), order(2), cutoff(0.5) {}
+
+    enum { maxLength = 63 };      //longest FIR, so the longest delay is maxLength / 2
+
+    Type type;
+    int length;                   //taps of savitzkyGolay and bandLimited, made odd, up to maxLength
+    int order;                    //polynomial order of savitzkyGolay, 1 to length - 1
+    double cutoff;                //bandLimited passband edge, as a fraction of Nyquist
+  };
+
+  /** Writes the FIR taps of a differentiator, taps[k] applying to x[n - k]. Every type
+      has a ramp response of 1 per sample, so thresholds carry over between types. */
+  void designDifferentiator (const DifferentiatorSettings& settings, std::vector<float>& taps);
+
+  /**
+
+    Streaming FIR differentiator of one detector's input channel.
+
+    Writes the absolute derivative of each sample, delayed by getDelay() samples
+    for the symmetric types; DetectorEngine dates triggers and windows back by it. The history starts as a copy of the first sample,
+    so a new acquisition does not open with a step. The taps run as a block FIR on the SIMD kernels,
+    with the history carried between blocks. Only the constructor allocates.
+
+    @see DetectorEngine, Kernels::differentiate
+  */
+  class Differentiator
+  {
+  public:
+    /** process() takes up to maxBlock samples per call. */
+    Differentiator (const DifferentiatorSettings& settings, int maxBlock);
+
+    const DifferentiatorSettings& getSettings() const  { return settings; }
+    int getNumTaps() const                             { return (int) taps.size(); }
+    int getDelay() const                               { return ((int) taps.size() - 1) / 2; }
+
+    /** Writes |derivative| of each input sample. */
+    void process (const float* input, int numSamples, float* out);
+
+    /** Forgets the input history, as at the start of an acquisition. */
+    void reset();
+
+  private:
+    DifferentiatorSettings settings;
+    std::vector<float> taps;
+    std::vector<float> segment;     //numTaps - 1 samples of history, then the new ones
+    int maxBlock;
+    bool primed;                    //history holds real input
+  };
+
+}
+
+#endif  // __DIFFERENTIATOR_H_DEFINED
@@ -0,0 +1,88 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LatencyHistogram.h"
+
+using namespace StimDetectorSpace;
+
+LatencyHistogram::LatencyHistogram()
+{
+  reset();
+}
+
+void LatencyHistogram::reset()
+{
+  for (int i = 0; i < numBins; i++)
+    bins[i].store (0, std::memory_order_relaxed);
+
+  count.store (0, std::memory_order_relaxed);
+  maxValue.store (0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::getBin (uint64_t nanoseconds)
+{
+  if (nanoseconds < subBins)
+    return (int) nanoseconds;
+
+  int msb = 0;
+  for (uint64_t v = nanoseconds; v > 1; v >>= 1)
+    msb++;
+
+  // the top subBinBits + 1 bits select the bin
+  const int shift = msb - subBinBits;
+  const int bin = (shift + 1) * subBins + (int) ((nanoseconds >> shift) & (subBins - 1));
+
+  return bin < numBins ? bin : numBins - 1;
+}
+
+uint64_t LatencyHistogram::getBinStart (int bin)
+{
+  if (bin < subBins)
+    return (uint64_t) bin;
+
+  const int shift = bin / subBins - 1;
+  return (uint64_t) (subBins + bin % subBins) << shift;
+}
+
+uint64_t LatencyHistogram::getPercentile (double p) const
+{
+  const uint64_t total = getCount();
+  if (total == 0)
+    return 0;
+
+  const uint64_t rank = (uint64_t) (p * (double) (total - 1)) + 1;
+  uint64_t seen = 0;
+
+  for (int bin = 0; bin < numBins; bin++)
+  {
+    seen += getBinCount (bin);
+
+    if (seen >= rank)
+    {
+      // the max is exact, no need to report past it
+      const uint64_t end = bin + 1 < numBins ? getBinStart (bin + 1) : getMax();
+      return end < getMax() ? end : getMax();
+    }
+  }
+
+  return getMax();
+}
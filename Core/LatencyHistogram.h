@@ -0,0 +1,91 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __LATENCYHISTOGRAM_H_DEFINED
+#define __LATENCYHISTOGRAM_H_DEFINED
+
+#include <atomic>
+#include <stdint.h>
+
+namespace StimDetectorSpace {
+
+  /**
+
+    Fixed-size log-linear histogram of durations in nanoseconds.
+
+    Each power of two is split into subBins linear bins, so every value is
+    kept to within 1/subBins of itself. add() is wait-free and never allocates,
+    and readers on other threads see a consistent enough picture without locks.
+
+  */
+  class LatencyHistogram
+  {
+  public:
+    enum
+    {
+      subBinBits = 3,
+      subBins = 1 << subBinBits,
+      numBins = 40 * subBins            //up to 2^40 ns, about 18 minutes
+    };
+
+    LatencyHistogram();
+
+    /** Audio thread: counts one duration. */
+    void add (uint64_t nanoseconds)
+    {
+      const int bin = getBin (nanoseconds);
+      bins[bin].fetch_add (1, std::memory_order_relaxed);
+      count.fetch_add (1, std::memory_order_relaxed);
+
+      uint64_t current = maxValue.load (std::memory_order_relaxed);
+      while (nanoseconds > current
+             && !maxValue.compare_exchange_weak (current, nanoseconds, std::memory_order_relaxed)) {}
+    }
+
+    /** Clears every bin; adds running at the same time may be lost. */
+    void reset();
+
+    uint64_t getCount() const           { return count.load (std::memory_order_relaxed); }
+    uint64_t getMax() const             { return maxValue.load (std::memory_order_relaxed); }
+    uint64_t getBinCount (int bin) const { return bins[bin].load (std::memory_order_relaxed); }
+
+    /** Upper edge of the bin holding the p quantile (0 to 1), 0 while empty. */
+    uint64_t getPercentile (double p) const;
+
+    static int getBin (uint64_t nanoseconds);
+
+    /** Smallest value of a bin; the bin ends at the start of the next one. */
+    static uint64_t getBinStart (int bin);
+
+  private:
+    std::atomic<uint64_t> bins[numBins];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> maxValue;
+
+    LatencyHistogram (const LatencyHistogram&);
+    LatencyHistogram& operator= (const LatencyHistogram&);
+  };
+
+}
+
+#endif  // __LATENCYHISTOGRAM_H_DEFINED
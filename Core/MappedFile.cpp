@@ -0,0 +1,211 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MappedFile.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+ #define WIN32_LEAN_AND_MEAN
+ #define NOMINMAX
+ #include <windows.h>
+#else
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+#endif
+
+using namespace StimDetectorSpace;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile (const std::string& path) :
+  data (nullptr), size (0), released (0), opened (false), file (INVALID_HANDLE_VALUE), mapping (nullptr)
+{
+  file = CreateFileA (path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                      FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return;
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx (file, &fileSize))
+    return;
+
+  opened = true;
+  size = (size_t) fileSize.QuadPart;
+  if (size == 0)
+    return;
+
+  mapping = CreateFileMappingA (file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping != nullptr)
+    data = (const uint8_t*) MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0);
+}
+
+MappedFile::~MappedFile()
+{
+  if (data != nullptr)
+    UnmapViewOfFile (data);
+  if (mapping != nullptr)
+    CloseHandle (mapping);
+  if (file != INVALID_HANDLE_VALUE)
+    CloseHandle (file);
+}
+
+void MappedFile::release (size_t end)
+{
+  // the working set trims itself on Windows; read-only pages are cheap to drop
+  released = end < size ? end : size;
+}
+
+#else
+
+MappedFile::MappedFile (const std::string& path) :
+  data (nullptr), size (0), released (0), opened (false)
+{
+  const int fd = open (path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+
+  struct stat info;
+  if (fstat (fd, &info) == 0)
+  {
+    opened = true;
+    size = (size_t) info.st_size;
+
+    if (size > 0)
+    {
+      void* mapped = mmap (nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if (mapped != MAP_FAILED)
+      {
+        data = (const uint8_t*) mapped;
+        madvise (mapped, size, MADV_SEQUENTIAL);
+      }
+    }
+  }
+
+  close (fd); // the mapping keeps the file
+}
+
+MappedFile::~MappedFile()
+{
+  if (data != nullptr)
+    munmap ((void*) data, size);
+}
+
+void MappedFile::release (size_t end)
+{
+  if (data == nullptr)
+    return;
+
+  const size_t page = (size_t) sysconf (_SC_PAGESIZE);
+  end = (end < size ? end : size) / page * page;
+
+  if (end > released)
+  {
+    madvise ((void*) (data + released), end - released, MADV_DONTNEED);
+    released = end;
+  }
+}
+
+#endif
+
+//==============================================================================
+NpyArray::NpyArray (const std::string& path) :
+  file (path), values (nullptr), length (0), type (0), itemSize (0)
+{
+  const uint8_t* d = file.getData();
+  const size_t fileSize = file.getSize();
+
+  if (d == nullptr || fileSize < 10 || memcmp (d, "\x93NUMPY", 6) != 0)
+    return;
+
+  size_t headerStart = 10;
+  size_t headerLength = d[8] | (d[9] << 8);
+
+  if (d[6] >= 2) // versions 2 and 3 have a 4-byte header length
+  {
+    if (fileSize < 12)
+      return;
+    headerStart = 12;
+    headerLength = headerLength | ((size_t) d[10] << 16) | ((size_t) d[11] << 24);
+  }
+
+  if (headerStart + headerLength > fileSize)
+    return;
+
+  const std::string header ((const char*) d + headerStart, headerLength);
+
+  // {'descr': '<i8', 'fortran_order': False, 'shape': (n,), }
+  const size_t descr = header.find ("'descr'");
+  const size_t quote = descr == std::string::npos ? descr : header.find ('\'', descr + 7);
+  const size_t shape = header.find ("'shape'");
+  const size_t paren = shape == std::string::npos ? shape : header.find ('(', shape);
+
+  if (quote == std::string::npos || paren == std::string::npos || quote + 4 > header.size())
+    return;
+
+  const char order = header[quote + 1];
+  type = header[quote + 2];
+  itemSize = atoi (header.c_str() + quote + 3);
+
+  const bool supported = (order == '<' || order == '|' || itemSize == 1)
+    && ((type == 'i' && (itemSize == 2 || itemSize == 8)) || (type == 'f' && itemSize == 8));
+
+  if (!supported)
+    return;
+
+  length = (size_t) strtoull (header.c_str() + paren + 1, nullptr, 10);
+
+  if (headerStart + headerLength + length * itemSize > fileSize)
+  {
+    length = 0;
+    return;
+  }
+
+  values = d + headerStart + headerLength;
+}
+
+int64_t NpyArray::getInt (size_t i) const
+{
+  const uint8_t* v = values + i * itemSize;
+
+  if (type == 'f')
+  {
+    double x;
+    memcpy (&x, v, sizeof (x));
+    return (int64_t) x;
+  }
+
+  if (itemSize == 2)
+  {
+    int16_t x;
+    memcpy (&x, v, sizeof (x));
+    return x;
+  }
+
+  int64_t x;
+  memcpy (&x, v, sizeof (x));
+  return x;
+}
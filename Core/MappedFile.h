@@ -0,0 +1,95 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __MAPPEDFILE_H_DEFINED
+#define __MAPPEDFILE_H_DEFINED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace StimDetectorSpace {
+
+  /**
+
+    Read-only memory map of a whole file, for tools that stream recordings.
+
+    Pages are read in as they are touched; release() hands the ones already
+    consumed back to the OS, so a long recording never stays resident.
+
+  */
+  class MappedFile
+  {
+  public:
+    explicit MappedFile (const std::string& path);
+    ~MappedFile();
+
+    bool isOpen() const                 { return opened; }
+    const uint8_t* getData() const      { return data; }
+    size_t getSize() const              { return size; }
+
+    /** Drops the pages of [0, end) from memory; they are read again if touched. */
+    void release (size_t end);
+
+  private:
+    const uint8_t* data;
+    size_t size;
+    size_t released;
+    bool opened;
+
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#endif
+
+    MappedFile (const MappedFile&);
+    MappedFile& operator= (const MappedFile&);
+  };
+
+  /**
+
+    A one-dimensional .npy array in a mapped file, of int16, int64 or float64.
+
+  */
+  class NpyArray
+  {
+  public:
+    explicit NpyArray (const std::string& path);
+
+    bool isOpen() const                 { return values != nullptr; }
+    size_t size() const                 { return length; }
+
+    /** Element i as an int64; float64 values are truncated. */
+    int64_t getInt (size_t i) const;
+
+  private:
+    MappedFile file;
+    const uint8_t* values;
+    size_t length;
+    char type;                          //'i' or 'f'
+    int itemSize;
+  };
+
+}
+
+#endif
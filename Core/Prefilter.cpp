@@ -0,0 +1,171 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Prefilter.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  const double pi = 3.14159265358979323846;
+
+  enum SectionType { lowPassSection, highPassSection, notchSection };
+
+  // the RBJ cookbook sections
+  Biquad makeSection (SectionType type, double frequency, double q, double sampleRate)
+  {
+    const double w0 = 2 * pi * std::min (0.45 * sampleRate, std::max (1e-3, frequency)) / sampleRate;
+    const double c = std::cos (w0);
+    const double alpha = std::sin (w0) / (2 * q);
+    const double a0 = 1 + alpha;
+
+    Biquad s;
+    switch (type)
+    {
+      case lowPassSection:
+        s.b0 = (1 - c) / 2;  s.b1 = 1 - c;     s.b2 = (1 - c) / 2;
+        break;
+      case highPassSection:
+        s.b0 = (1 + c) / 2;  s.b1 = -(1 + c);  s.b2 = (1 + c) / 2;
+        break;
+      default:
+        s.b0 = 1;            s.b1 = -2 * c;    s.b2 = 1;
+        break;
+    }
+
+    s.b0 /= a0;
+    s.b1 /= a0;
+    s.b2 /= a0;
+    s.a1 = -2 * c / a0;
+    s.a2 = (1 - alpha) / a0;
+    return s;
+  }
+
+  // a Butterworth edge as order / 2 sections with the pole pair Qs
+  void addButterworth (SectionType type, int order, double frequency, double sampleRate, std::vector<Biquad>& sections)
+  {
+    const int numSections = std::min (4, std::max (1, order / 2));
+
+    for (int k = 1; k <= numSections; k++)
+    {
+      const double q = 1 / (2 * std::cos ((2 * k - 1) * pi / (4 * numSections)));
+      sections.push_back (makeSection (type, frequency, q, sampleRate));
+    }
+  }
+}
+
+void StimDetectorSpace::designPrefilter (const PrefilterSettings& settings, double sampleRate, std::vector<Biquad>& sections)
+{
+  sections.clear();
+
+  if (sampleRate <= 0)
+    return;
+
+  switch (settings.type)
+  {
+    case PrefilterSettings::highPass:
+      addButterworth (highPassSection, settings.order, settings.lowHz, sampleRate, sections);
+      break;
+
+    case PrefilterSettings::notch:
+      sections.push_back (makeSection (notchSection, settings.lowHz, std::max (0.5, settings.q), sampleRate));
+      break;
+
+    case PrefilterSettings::bandPass:
+      addButterworth (highPassSection, settings.order, settings.lowHz, sampleRate, sections);
+      addButterworth (lowPassSection, settings.order, settings.highHz, sampleRate, sections);
+      break;
+
+    default:
+      break;
+  }
+}
+
+Prefilter::Prefilter (const PrefilterSettings& s, double rate) :
+  settings (s),
+  sampleRate (rate),
+  primed (false)
+{
+  designPrefilter (settings, sampleRate, sections);
+  state.assign (sections.size(), State());
+  reset();
+}
+
+void Prefilter::reset()
+{
+  for (State& s : state)
+    s.z1 = s.z2 = 0;
+  primed = false;
+}
+
+void Prefilter::process (const float* input, int numSamples, float* output)
+{
+  if (numSamples <= 0)
+    return;
+
+  if (sections.empty())
+  {
+    if (output != input)
+      std::copy (input, input + numSamples, output);
+    return;
+  }
+
+  // steady state of a constant first sample, section by section
+  if (!primed)
+  {
+    double x = input[0];
+    for (size_t k = 0; k < sections.size(); k++)
+    {
+      const Biquad& b = sections[k];
+      const double y = x * (b.b0 + b.b1 + b.b2) / (1 + b.a1 + b.a2);
+      state[k].z1 = y - b.b0 * x;
+      state[k].z2 = b.b2 * x - b.a2 * y;
+      x = y;
+    }
+    primed = true;
+  }
+
+  const float* in = input;
+  for (size_t k = 0; k < sections.size(); k++)
+  {
+    const double b0 = sections[k].b0, b1 = sections[k].b1, b2 = sections[k].b2;
+    const double a1 = sections[k].a1, a2 = sections[k].a2;
+    double z1 = state[k].z1;
+    double z2 = state[k].z2;
+
+    for (int i = 0; i < numSamples; i++)
+    {
+      const double x = in[i];
+      const double y = b0 * x + z1;
+      z1 = b1 * x - a1 * y + z2;
+      z2 = b2 * x - a2 * y;
+      output[i] = (float) y;
+    }
+
+    state[k].z1 = z1;
+    state[k].z2 = z2;
+    in = output;
+  }
+}
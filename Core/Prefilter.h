@@ -0,0 +1,103 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __PREFILTER_H_DEFINED
+#define __PREFILTER_H_DEFINED
+
+#include <vector>
+
+namespace StimDetectorSpace {
+
+  /** IIR stage a detector runs on its input before detection and capture. */
+  struct PrefilterSettings
+  {
+    enum Type
+    {
+      none,
+      highPass,                   //Butterworth, removes drift below lowHz
+      notch,                      //removes hum at lowHz
+      bandPass                    //Butterworth high-pass at lowHz and low-pass at highHz
+    };
+
+    PrefilterSettings() : type(none), lowHz(1), highHz(1000), q(30), order(2) {}
+
+    Type type;
+    double lowHz;                 //high-pass corner, notch centre or band-pass low edge
+    double highHz;                //band-pass high edge
+    double q;                     //notch quality factor, centre over -3 dB width
+    int order;                    //Butterworth order of each edge, even, 2 to 8
+  };
+
+  /** One second order section, normalized so a0 = 1. */
+  struct Biquad
+  {
+    double b0, b1, b2, a1, a2;
+  };
+
+  /** Writes the sections of a prefilter at sampleRate; none gives no sections. */
+  void designPrefilter (const PrefilterSettings& settings, double sampleRate, std::vector<Biquad>& sections);
+
+  /**
+
+    Streaming cascade of biquads in transposed direct form II, for one
+    detector's input channel.
+
+    Each section runs over the whole block before the next one, with its two
+    state values held in registers; the state is kept in double so corners
+    far below the sample rate stay stable. The state starts at the steady
+    state of the first sample, so a new acquisition does not ring on its DC
+    offset. Only the constructor allocates.
+
+    @see DetectorEngine
+  */
+  class Prefilter
+  {
+  public:
+    Prefilter (const PrefilterSettings& settings, double sampleRate);
+
+    const PrefilterSettings& getSettings() const  { return settings; }
+    double getSampleRate() const                  { return sampleRate; }
+    int getNumSections() const                    { return (int) sections.size(); }
+
+    /** Writes the filtered input; output may alias input. */
+    void process (const float* input, int numSamples, float* output);
+
+    /** Forgets the filter state, as at the start of an acquisition. */
+    void reset();
+
+  private:
+    struct State
+    {
+      double z1, z2;
+    };
+
+    PrefilterSettings settings;
+    double sampleRate;
+    std::vector<Biquad> sections;
+    std::vector<State> state;
+    bool primed;                  //state follows real input
+  };
+
+}
+
+#endif  // __PREFILTER_H_DEFINED
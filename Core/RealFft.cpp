@@ -0,0 +1,156 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "RealFft.h"
+
+#include <cmath>
+#include <utility>
+
+using namespace StimDetectorSpace;
+
+RealFft::RealFft (int n) :
+  size (n), half (n / 2), bitReverse (n / 2), twiddles (n / 2), postTwiddles (n + 2), work (n)
+{
+  const double pi = 3.14159265358979323846;
+
+  int bits = 0;
+  while ((1 << bits) < half)
+    bits++;
+
+  for (int i = 0; i < half; i++)
+  {
+    int r = 0;
+    for (int b = 0; b < bits; b++)
+      r |= ((i >> b) & 1) << (bits - 1 - b);
+    bitReverse[i] = r;
+  }
+
+  for (int k = 0; k < half / 2; k++)
+  {
+    twiddles[2 * k] = (float) std::cos (-2 * pi * k / half);
+    twiddles[2 * k + 1] = (float) std::sin (-2 * pi * k / half);
+  }
+
+  for (int k = 0; k <= half; k++)
+  {
+    postTwiddles[2 * k] = (float) std::cos (-2 * pi * k / size);
+    postTwiddles[2 * k + 1] = (float) std::sin (-2 * pi * k / size);
+  }
+}
+
+// In-place iterative radix-2 on half complex points; the inverse is unscaled
+void RealFft::transform (float* data, bool inverse) const
+{
+  for (int i = 0; i < half; i++)
+  {
+    const int j = bitReverse[i];
+    if (i < j)
+    {
+      std::swap (data[2 * i], data[2 * j]);
+      std::swap (data[2 * i + 1], data[2 * j + 1]);
+    }
+  }
+
+  const float sign = inverse ? -1.0f : 1.0f;
+
+  for (int length = 2; length <= half; length <<= 1)
+  {
+    const int step = half / length;
+
+    for (int start = 0; start < half; start += length)
+    {
+      for (int k = 0; k < length / 2; k++)
+      {
+        const float wr = twiddles[2 * k * step];
+        const float wi = sign * twiddles[2 * k * step + 1];
+
+        float* a = data + 2 * (start + k);
+        float* b = data + 2 * (start + k + length / 2);
+
+        const float br = b[0] * wr - b[1] * wi;
+        const float bi = b[0] * wi + b[1] * wr;
+
+        b[0] = a[0] - br;
+        b[1] = a[1] - bi;
+        a[0] += br;
+        a[1] += bi;
+      }
+    }
+  }
+}
+
+void RealFft::forward (const float* input, float* spectrum)
+{
+  // even samples as the real part, odd samples as the imaginary part
+  float* z = work.data();
+  for (int i = 0; i < size; i++)
+    z[i] = input[i];
+
+  transform (z, false);
+
+  // X[k] = E[k] + W^k O[k], with E and O split from Z[k] and conj(Z[half - k])
+  for (int k = 0; k <= half; k++)
+  {
+    const int a = k == half ? 0 : k;
+    const int b = k == 0 ? 0 : half - k;
+
+    const float zr = z[2 * a], zi = z[2 * a + 1];
+    const float cr = z[2 * b], ci = -z[2 * b + 1];
+
+    const float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+    const float orr = 0.5f * (zi - ci), oi = -0.5f * (zr - cr);
+
+    const float wr = postTwiddles[2 * k], wi = postTwiddles[2 * k + 1];
+
+    spectrum[2 * k] = er + wr * orr - wi * oi;
+    spectrum[2 * k + 1] = ei + wr * oi + wi * orr;
+  }
+}
+
+void RealFft::inverse (const float* spectrum, float* output)
+{
+  float* z = work.data();
+
+  // Z[k] = E[k] + i O[k], undoing the split of forward()
+  for (int k = 0; k < half; k++)
+  {
+    const float xr = spectrum[2 * k], xi = spectrum[2 * k + 1];
+    const float cr = spectrum[2 * (half - k)], ci = -spectrum[2 * (half - k) + 1];
+
+    const float er = 0.5f * (xr + cr), ei = 0.5f * (xi + ci);
+    const float dr = 0.5f * (xr - cr), di = 0.5f * (xi - ci);
+
+    // O[k] = D[k] / W^k
+    const float wr = postTwiddles[2 * k], wi = postTwiddles[2 * k + 1];
+    const float orr = dr * wr + di * wi;
+    const float oi = di * wr - dr * wi;
+
+    z[2 * k] = er - oi;
+    z[2 * k + 1] = ei + orr;
+  }
+
+  transform (z, true);
+
+  const float scale = 1.0f / half;
+  for (int i = 0; i < size; i++)
+    output[i] = z[i] * scale;
+}
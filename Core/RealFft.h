@@ -0,0 +1,67 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __REALFFT_H_DEFINED
+#define __REALFFT_H_DEFINED
+
+#include <vector>
+
+namespace StimDetectorSpace {
+
+  /**
+
+    Radix-2 FFT of real signals, computed as a complex FFT of half the size.
+
+    The spectrum of size real values is size / 2 + 1 complex bins, stored as
+    interleaved real and imaginary parts. Only the constructor allocates; the
+    transforms use the object's own work buffer, so each thread needs its own.
+
+  */
+  class RealFft
+  {
+  public:
+    /** size must be a power of two, at least 4. */
+    explicit RealFft (int size);
+
+    int getSize() const             { return size; }
+
+    /** size real values to size + 2 spectrum values. */
+    void forward (const float* input, float* spectrum);
+
+    /** Inverse of forward(), including the 1 / size scaling. spectrum is left unchanged. */
+    void inverse (const float* spectrum, float* output);
+
+  private:
+    void transform (float* data, bool inverse) const;
+
+    int size;
+    int half;                       //complex points of the inner FFT
+    std::vector<int> bitReverse;
+    std::vector<float> twiddles;    //e^(-2 pi i k / half), interleaved
+    std::vector<float> postTwiddles; //e^(-2 pi i k / size), interleaved
+    std::vector<float> work;
+  };
+
+}
+
+#endif  // __REALFFT_H_DEFINED
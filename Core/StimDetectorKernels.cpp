@@ -0,0 +1,519 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StimDetectorKernels.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+  #define SD_HAS_X86_SIMD 1
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+    #define SD_TARGET_AVX2
+  #else
+    #define SD_TARGET_AVX2 __attribute__((target("avx2")))
+  #endif
+#else
+  #define SD_HAS_X86_SIMD 0
+#endif
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  typedef void (*ComputeDiffFn) (const float*, int, float, float*);
+  typedef void (*DetectCandidatesFn) (const float*, int, float, float, float, uint32_t*);
+  typedef void (*DifferentiateFn) (const float*, int, const float*, int, float*);
+  typedef void (*ConvertSamplesFn) (const float*, int, double, double*);
+  typedef void (*AccumulateSweepFn) (const double*, int, double, double*, double*);
+
+  inline int countTrailingZeros (uint32_t x)
+  {
+  #ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward (&index, x);
+    return (int) index;
+  #else
+    return __builtin_ctz (x);
+  #endif
+  }
+
+  void computeDiffScalar (const float* input, int numSamples, float lastSample, float* diffOut)
+  {
+    float prev = lastSample;
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+      diffOut[i] = fabsf (input[i] - prev);
+      prev = input[i];
+    }
+  }
+
+  // also finishes the samples a vector loop did not cover
+  void detectCandidatesScalar (const float* diff, int start, int numSamples, float lastDiff,
+                               float lowerBound, float upperBound, uint32_t* candidateMask)
+  {
+    float prev = start == 0 ? lastDiff : diff[start - 1];
+
+    for (int i = start; i < numSamples; ++i)
+    {
+      const float d = diff[i];
+
+      if (d > prev && d > lowerBound && d < upperBound)
+        candidateMask[i >> 5] |= 1u << (i & 31);
+
+      prev = d;
+    }
+  }
+
+  void detectCandidatesScalar (const float* diff, int numSamples, float lastDiff,
+                               float lowerBound, float upperBound, uint32_t* candidateMask)
+  {
+    detectCandidatesScalar (diff, 0, numSamples, lastDiff, lowerBound, upperBound, candidateMask);
+  }
+
+  // also finishes the samples a vector loop did not cover
+  void differentiateScalar (const float* input, int start, int numSamples, const float* taps, int numTaps, float* out)
+  {
+    for (int i = start; i < numSamples; ++i)
+    {
+      float sum = 0.0f;
+      for (int k = 0; k < numTaps; ++k)
+        sum += taps[k] * input[i - k];
+      out[i] = fabsf (sum);
+    }
+  }
+
+  void differentiateScalar (const float* input, int numSamples, const float* taps, int numTaps, float* out)
+  {
+    differentiateScalar (input, 0, numSamples, taps, numTaps, out);
+  }
+
+  // also finishes the samples a vector loop did not cover
+  void convertSamplesScalar (const float* input, int start, int numSamples, double scale, double* out)
+  {
+    for (int i = start; i < numSamples; ++i)
+      out[i] = input[i] / scale;
+  }
+
+  void convertSamplesScalar (const float* input, int numSamples, double scale, double* out)
+  {
+    convertSamplesScalar (input, 0, numSamples, scale, out);
+  }
+
+  void accumulateSweepScalar (const double* sweep, int start, int length, double invCount, double* mean, double* m2)
+  {
+    for (int i = start; i < length; ++i)
+    {
+      const double delta = sweep[i] - mean[i];
+      mean[i] += delta * invCount;
+      m2[i] += delta * (sweep[i] - mean[i]);
+    }
+  }
+
+  void accumulateSweepScalar (const double* sweep, int length, double invCount, double* mean, double* m2)
+  {
+    accumulateSweepScalar (sweep, 0, length, invCount, mean, m2);
+  }
+
+#if SD_HAS_X86_SIMD
+  void computeDiffSSE2 (const float* input, int numSamples, float lastSample, float* diffOut)
+  {
+    const __m128 signMask = _mm_set1_ps (-0.0f);
+
+    diffOut[0] = fabsf (input[0] - lastSample);
+
+    int i = 1;
+    for (; i + 4 <= numSamples; i += 4)
+    {
+      const __m128 x = _mm_loadu_ps (input + i);
+      const __m128 xPrev = _mm_loadu_ps (input + i - 1);
+      _mm_storeu_ps (diffOut + i, _mm_andnot_ps (signMask, _mm_sub_ps (x, xPrev)));
+    }
+
+    for (; i < numSamples; ++i)
+      diffOut[i] = fabsf (input[i] - input[i - 1]);
+  }
+
+  // 4 mask bits per vector; the first sample compares against lastDiff
+  void detectCandidatesSSE2 (const float* diff, int numSamples, float lastDiff,
+                             float lowerBound, float upperBound, uint32_t* candidateMask)
+  {
+    const __m128 lower = _mm_set1_ps (lowerBound);
+    const __m128 upper = _mm_set1_ps (upperBound);
+
+    detectCandidatesScalar (diff, 0, 1, lastDiff, lowerBound, upperBound, candidateMask);
+
+    int j = 1;
+    for (; j + 4 <= numSamples; j += 4)
+    {
+      const __m128 d = _mm_loadu_ps (diff + j);
+      const __m128 dPrev = _mm_loadu_ps (diff + j - 1);
+      const __m128 pass = _mm_and_ps (_mm_cmpgt_ps (d, dPrev),
+                                      _mm_and_ps (_mm_cmpgt_ps (d, lower), _mm_cmplt_ps (d, upper)));
+      const uint32_t bits = (uint32_t) _mm_movemask_ps (pass);
+
+      if (bits != 0)
+      {
+        candidateMask[j >> 5] |= bits << (j & 31);
+        if ((j & 31) > 28)
+          candidateMask[(j >> 5) + 1] |= bits >> (32 - (j & 31));
+      }
+    }
+
+    detectCandidatesScalar (diff, j, numSamples, lastDiff, lowerBound, upperBound, candidateMask);
+  }
+
+  // 4 outputs per vector, the taps broadcast one at a time
+  void differentiateSSE2 (const float* input, int numSamples, const float* taps, int numTaps, float* out)
+  {
+    const __m128 signMask = _mm_set1_ps (-0.0f);
+
+    int i = 0;
+    for (; i + 4 <= numSamples; i += 4)
+    {
+      __m128 sum = _mm_setzero_ps();
+      for (int k = 0; k < numTaps; ++k)
+        sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps (taps[k]), _mm_loadu_ps (input + i - k)));
+      _mm_storeu_ps (out + i, _mm_andnot_ps (signMask, sum));
+    }
+
+    differentiateScalar (input, i, numSamples, taps, numTaps, out);
+  }
+
+  // the same divisions as the scalar loop, so every path gives identical stims
+  void convertSamplesSSE2 (const float* input, int numSamples, double scale, double* out)
+  {
+    const __m128d s = _mm_set1_pd (scale);
+
+    int i = 0;
+    for (; i + 4 <= numSamples; i += 4)
+    {
+      const __m128 x = _mm_loadu_ps (input + i);
+      _mm_storeu_pd (out + i, _mm_div_pd (_mm_cvtps_pd (x), s));
+      _mm_storeu_pd (out + i + 2, _mm_div_pd (_mm_cvtps_pd (_mm_movehl_ps (x, x)), s));
+    }
+
+    convertSamplesScalar (input, i, numSamples, scale, out);
+  }
+
+  void accumulateSweepSSE2 (const double* sweep, int length, double invCount, double* mean, double* m2)
+  {
+    const __m128d inv = _mm_set1_pd (invCount);
+
+    int i = 0;
+    for (; i + 2 <= length; i += 2)
+    {
+      const __m128d x = _mm_loadu_pd (sweep + i);
+      const __m128d oldMean = _mm_loadu_pd (mean + i);
+      const __m128d delta = _mm_sub_pd (x, oldMean);
+      const __m128d newMean = _mm_add_pd (oldMean, _mm_mul_pd (delta, inv));
+
+      _mm_storeu_pd (mean + i, newMean);
+      _mm_storeu_pd (m2 + i, _mm_add_pd (_mm_loadu_pd (m2 + i), _mm_mul_pd (delta, _mm_sub_pd (x, newMean))));
+    }
+
+    accumulateSweepScalar (sweep, i, length, invCount, mean, m2);
+  }
+
+  SD_TARGET_AVX2
+  void differentiateAVX2 (const float* input, int numSamples, const float* taps, int numTaps, float* out)
+  {
+    const __m256 signMask = _mm256_set1_ps (-0.0f);
+
+    int i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+      __m256 sum = _mm256_setzero_ps();
+      for (int k = 0; k < numTaps; ++k)
+        sum = _mm256_add_ps (sum, _mm256_mul_ps (_mm256_set1_ps (taps[k]), _mm256_loadu_ps (input + i - k)));
+      _mm256_storeu_ps (out + i, _mm256_andnot_ps (signMask, sum));
+    }
+
+    differentiateScalar (input, i, numSamples, taps, numTaps, out);
+  }
+
+  SD_TARGET_AVX2
+  void convertSamplesAVX2 (const float* input, int numSamples, double scale, double* out)
+  {
+    const __m256d s = _mm256_set1_pd (scale);
+
+    int i = 0;
+    for (; i + 4 <= numSamples; i += 4)
+      _mm256_storeu_pd (out + i, _mm256_div_pd (_mm256_cvtps_pd (_mm_loadu_ps (input + i)), s));
+
+    convertSamplesScalar (input, i, numSamples, scale, out);
+  }
+
+  SD_TARGET_AVX2
+  void accumulateSweepAVX2 (const double* sweep, int length, double invCount, double* mean, double* m2)
+  {
+    const __m256d inv = _mm256_set1_pd (invCount);
+
+    int i = 0;
+    for (; i + 4 <= length; i += 4)
+    {
+      const __m256d x = _mm256_loadu_pd (sweep + i);
+      const __m256d oldMean = _mm256_loadu_pd (mean + i);
+      const __m256d delta = _mm256_sub_pd (x, oldMean);
+      const __m256d newMean = _mm256_add_pd (oldMean, _mm256_mul_pd (delta, inv));
+
+      _mm256_storeu_pd (mean + i, newMean);
+      _mm256_storeu_pd (m2 + i, _mm256_add_pd (_mm256_loadu_pd (m2 + i), _mm256_mul_pd (delta, _mm256_sub_pd (x, newMean))));
+    }
+
+    accumulateSweepScalar (sweep, i, length, invCount, mean, m2);
+  }
+
+  SD_TARGET_AVX2
+  void computeDiffAVX2 (const float* input, int numSamples, float lastSample, float* diffOut)
+  {
+    const __m256 signMask = _mm256_set1_ps (-0.0f);
+
+    diffOut[0] = fabsf (input[0] - lastSample);
+
+    int i = 1;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+      const __m256 x = _mm256_loadu_ps (input + i);
+      const __m256 xPrev = _mm256_loadu_ps (input + i - 1);
+      _mm256_storeu_ps (diffOut + i, _mm256_andnot_ps (signMask, _mm256_sub_ps (x, xPrev)));
+    }
+
+    for (; i < numSamples; ++i)
+      diffOut[i] = fabsf (input[i] - input[i - 1]);
+  }
+
+  SD_TARGET_AVX2
+  void detectCandidatesAVX2 (const float* diff, int numSamples, float lastDiff,
+                             float lowerBound, float upperBound, uint32_t* candidateMask)
+  {
+    const __m256 lower = _mm256_set1_ps (lowerBound);
+    const __m256 upper = _mm256_set1_ps (upperBound);
+
+    detectCandidatesScalar (diff, 0, 1, lastDiff, lowerBound, upperBound, candidateMask);
+
+    int j = 1;
+    for (; j + 8 <= numSamples; j += 8)
+    {
+      const __m256 d = _mm256_loadu_ps (diff + j);
+      const __m256 dPrev = _mm256_loadu_ps (diff + j - 1);
+      const __m256 pass = _mm256_and_ps (_mm256_cmp_ps (d, dPrev, _CMP_GT_OQ),
+                                         _mm256_and_ps (_mm256_cmp_ps (d, lower, _CMP_GT_OQ),
+                                                        _mm256_cmp_ps (d, upper, _CMP_LT_OQ)));
+      const uint32_t bits = (uint32_t) _mm256_movemask_ps (pass);
+
+      if (bits != 0)
+      {
+        candidateMask[j >> 5] |= bits << (j & 31);
+        if ((j & 31) > 24)
+          candidateMask[(j >> 5) + 1] |= bits >> (32 - (j & 31));
+      }
+    }
+
+    detectCandidatesScalar (diff, j, numSamples, lastDiff, lowerBound, upperBound, candidateMask);
+  }
+
+  bool cpuHasAVX2()
+  {
+  #ifdef _MSC_VER
+    int info[4];
+    __cpuid (info, 0);
+    if (info[0] < 7)
+      return false;
+
+    __cpuid (info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (! osxsave || ! avx || (_xgetbv (0) & 0x6) != 0x6)
+      return false;
+
+    __cpuidex (info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+  #else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports ("avx2");
+  #endif
+  }
+#endif
+
+  enum Level { scalarLevel, sse2Level, avx2Level };
+
+  Level getBestLevel()
+  {
+  #if SD_HAS_X86_SIMD
+    return cpuHasAVX2() ? avx2Level : sse2Level;
+  #else
+    return scalarLevel;
+  #endif
+  }
+
+  struct Implementation
+  {
+    explicit Implementation (Level level)
+    {
+      computeDiff = computeDiffScalar;
+      detectCandidates = detectCandidatesScalar;
+      differentiate = differentiateScalar;
+      convertSamples = convertSamplesScalar;
+      accumulateSweep = accumulateSweepScalar;
+      name = "scalar";
+
+    #if SD_HAS_X86_SIMD
+      if (level >= sse2Level)
+      {
+        computeDiff = computeDiffSSE2;
+        detectCandidates = detectCandidatesSSE2;
+        differentiate = differentiateSSE2;
+        convertSamples = convertSamplesSSE2;
+        accumulateSweep = accumulateSweepSSE2;
+        name = "sse2";
+      }
+
+      if (level >= avx2Level)
+      {
+        computeDiff = computeDiffAVX2;
+        detectCandidates = detectCandidatesAVX2;
+        differentiate = differentiateAVX2;
+        convertSamples = convertSamplesAVX2;
+        accumulateSweep = accumulateSweepAVX2;
+        name = "avx2";
+      }
+    #else
+      (void) level;
+    #endif
+    }
+
+    ComputeDiffFn computeDiff;
+    DetectCandidatesFn detectCandidates;
+    DifferentiateFn differentiate;
+    ConvertSamplesFn convertSamples;
+    AccumulateSweepFn accumulateSweep;
+    const char* name;
+  };
+
+  Implementation& getImplementation()
+  {
+    static Implementation implementation (getBestLevel());
+    return implementation;
+  }
+
+  // resolve the implementation at load time, not on the first audio callback
+  const Implementation& selectedImplementation = getImplementation();
+}
+
+void Kernels::computeDiff (const float* input, int numSamples, float lastSample, float* diffOut)
+{
+  if (numSamples > 0)
+    selectedImplementation.computeDiff (input, numSamples, lastSample, diffOut);
+}
+
+void Kernels::detectCandidates (const float* diff, int numSamples, float lastDiff,
+                                float lowerBound, float upperBound, uint32_t* candidateMask)
+{
+  if (numSamples <= 0)
+    return;
+
+  memset (candidateMask, 0, sizeof (uint32_t) * ((numSamples + 31) / 32));
+  selectedImplementation.detectCandidates (diff, numSamples, lastDiff, lowerBound, upperBound, candidateMask);
+}
+
+void Kernels::diffAndDetect (const float* input, int numSamples, float lastSample, float lastDiff,
+                             float lowerBound, float upperBound, float* diffOut, uint32_t* candidateMask)
+{
+  computeDiff (input, numSamples, lastSample, diffOut);
+  detectCandidates (diffOut, numSamples, lastDiff, lowerBound, upperBound, candidateMask);
+}
+
+void Kernels::differentiate (const float* input, int numSamples, const float* taps, int numTaps, float* out)
+{
+  if (numSamples > 0)
+    selectedImplementation.differentiate (input, numSamples, taps, numTaps, out);
+}
+
+void Kernels::convertSamples (const float* input, int numSamples, double scale, double* out)
+{
+  if (numSamples > 0)
+    selectedImplementation.convertSamples (input, numSamples, scale, out);
+}
+
+void Kernels::accumulateSweep (const double* sweep, int length, double invCount, double* mean, double* m2)
+{
+  if (length > 0)
+    selectedImplementation.accumulateSweep (sweep, length, invCount, mean, m2);
+}
+
+void Kernels::getThresholdBounds (double threshold, float& lowerBound, float& upperBound)
+{
+  // d > threshold  <=>  d > (largest float <= threshold)
+  lowerBound = (float) threshold;
+  if ((double) lowerBound > threshold)
+    lowerBound = nextafterf (lowerBound, -HUGE_VALF);
+
+  // d < 5 * threshold  <=>  d < (smallest float >= 5 * threshold)
+  const double limit = 5 * threshold;
+  upperBound = (float) limit;
+  if ((double) upperBound < limit)
+    upperBound = nextafterf (upperBound, HUGE_VALF);
+}
+
+int Kernels::findNextCandidate (const uint32_t* candidateMask, int start, int end)
+{
+  if (start >= end)
+    return end;
+
+  int word = start >> 5;
+  uint32_t bits = candidateMask[word] & (~0u << (start & 31));
+  const int lastWord = (end - 1) >> 5;
+
+  while (bits == 0)
+  {
+    if (++word > lastWord)
+      return end;
+    bits = candidateMask[word];
+  }
+
+  const int index = (word << 5) + countTrailingZeros (bits);
+  return index < end ? index : end;
+}
+
+bool Kernels::selectImplementation (const char* name)
+{
+  const char* names[] = { "scalar", "sse2", "avx2" };
+
+  for (int level = scalarLevel; level <= getBestLevel(); level++)
+  {
+    if (strcmp (name, names[level]) == 0)
+    {
+      getImplementation() = Implementation ((Level) level);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+const char* Kernels::getImplementationName()
+{
+  return selectedImplementation.name;
+}
@@ -0,0 +1,97 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __STIMDETECTORKERNELS_H_DEFINED
+#define __STIMDETECTORKERNELS_H_DEFINED
+
+#include <stdint.h>
+
+namespace StimDetectorSpace {
+
+  /**
+
+    Block kernels used by StimDetector::process.
+
+    The implementation (AVX2, SSE2 or scalar) is chosen once at runtime
+    from the features of the host CPU.
+
+    @see StimDetector
+  */
+  namespace Kernels
+  {
+    enum
+    {
+      blockSize = 1024,             //samples per kernel call
+      maskWords = blockSize / 32    //one candidate bit per sample
+    };
+
+    /** Computes diff[n] = |x[n] - x[n-1]| for a block; lastSample is x[-1], carried from
+        the previous block. */
+    void computeDiff (const float* input, int numSamples, float lastSample, float* diffOut);
+
+    /** Sets bit n of candidateMask when diff[n] > diff[n-1], diff[n] > lowerBound and
+        diff[n] < upperBound; lastDiff is diff[-1]. Detectors sharing an input channel
+        run this on the same diff with their own bounds. */
+    void detectCandidates (const float* diff, int numSamples, float lastDiff,
+                           float lowerBound, float upperBound, uint32_t* candidateMask);
+
+    /** computeDiff() followed by detectCandidates(). */
+    void diffAndDetect (const float* input, int numSamples, float lastSample, float lastDiff,
+                        float lowerBound, float upperBound, float* diffOut, uint32_t* candidateMask);
+
+    /** Converts the double precision trigger limits (threshold, 5 * threshold) into float
+        bounds that give exactly the same result as comparing a float diff in double. */
+    void getThresholdBounds (double threshold, float& lowerBound, float& upperBound);
+
+    /** Writes out[n] = |sum over k of taps[k] * input[n - k]| for a block; the numTaps - 1
+        samples before input must be valid, carried from the previous block. */
+    void differentiate (const float* input, int numSamples, const float* taps, int numTaps, float* out);
+
+    /** Writes out[n] = input[n] / scale in double precision, the window capture of a
+        run of samples. */
+    void convertSamples (const float* input, int numSamples, double scale, double* out);
+
+    /** Welford update of a closed sweep into the per-sample mean and sum of squared
+        deviations m2: mean += (x - mean) * invCount, m2 += (x - mean_old) * (x - mean).
+        invCount is 1 / the sweep count including this one. */
+    void accumulateSweep (const double* sweep, int length, double invCount, double* mean, double* m2);
+
+    /** Returns the index of the first set bit in [start, end), or end if there is none. */
+    int findNextCandidate (const uint32_t* candidateMask, int start, int end);
+
+    inline bool isCandidate (const uint32_t* candidateMask, int index)
+    {
+      return (candidateMask[index >> 5] >> (index & 31)) & 1u;
+    }
+
+    /** Name of the implementation selected for this CPU ("avx2", "sse2" or "scalar"). */
+    const char* getImplementationName();
+
+    /** Switches to the named implementation if this CPU runs it; false otherwise. For tests
+        and benchmarks, never while another thread runs the kernels. */
+    bool selectImplementation (const char* name);
+  }
+
+}
+
+#endif  // __STIMDETECTORKERNELS_H_DEFINED
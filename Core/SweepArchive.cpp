@@ -0,0 +1,318 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SweepArchive.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+ #define WIN32_LEAN_AND_MEAN
+ #define NOMINMAX
+ #include <windows.h>
+#else
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <unistd.h>
+#endif
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  struct ArchiveHeader
+  {
+    char magic[8];              //"SDSWEEPS"
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t numSweeps;
+    uint64_t indexOffset;       //bytes from the start of the file
+    uint64_t indexCapacity;     //entries
+    uint64_t dataEnd;           //end of the last sweep or index
+    uint64_t reserved[2];
+  };
+
+  static_assert (sizeof (ArchiveHeader) == 64, "archive header must stay 64 bytes");
+  static_assert (sizeof (SweepInfo) == 40, "sweep info must stay 40 bytes");
+
+  const char archiveMagic[8] = { 'S', 'D', 'S', 'W', 'E', 'E', 'P', 'S' };
+  const uint32_t archiveVersion = 1;
+  const uint64_t initialIndexCapacity = 4096;
+
+  uint64_t getRecordSize (int length)
+  {
+    return (sizeof (SweepInfo) + (uint64_t) length * sizeof (float) + 7) & ~(uint64_t) 7;
+  }
+}
+
+SweepArchiveWriter::SweepArchiveWriter() :
+  data (nullptr), size (0)
+#ifdef _WIN32
+  , file (INVALID_HANDLE_VALUE), mapping (nullptr)
+#else
+  , fd (-1)
+#endif
+{
+}
+
+SweepArchiveWriter::~SweepArchiveWriter()
+{
+  close();
+}
+
+bool SweepArchiveWriter::open (const std::string& path, uint64_t initialBytes)
+{
+  close();
+
+  const uint64_t minBytes = sizeof (ArchiveHeader) + initialIndexCapacity * sizeof (uint64_t);
+  initialBytes = initialBytes > minBytes ? initialBytes : minBytes;
+
+#ifdef _WIN32
+  file = CreateFileA (path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                      FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+#else
+  fd = ::open (path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return false;
+#endif
+
+  if (!resize (initialBytes))
+  {
+    close();
+    return false;
+  }
+
+  ArchiveHeader* header = (ArchiveHeader*) data;
+  memcpy (header->magic, archiveMagic, sizeof (archiveMagic));
+  header->version = archiveVersion;
+  header->headerSize = sizeof (ArchiveHeader);
+  header->numSweeps = 0;
+  header->indexOffset = sizeof (ArchiveHeader);
+  header->indexCapacity = initialIndexCapacity;
+  header->dataEnd = minBytes;
+  return true;
+}
+
+uint64_t SweepArchiveWriter::getNumSweeps() const
+{
+  return data != nullptr ? ((const ArchiveHeader*) data)->numSweeps : 0;
+}
+
+bool SweepArchiveWriter::reserve (uint64_t bytes)
+{
+  const uint64_t needed = ((const ArchiveHeader*) data)->dataEnd + bytes;
+  if (needed <= size)
+    return true;
+
+  uint64_t newSize = size;
+  while (newSize < needed)
+    newSize *= 2;
+
+  return resize (newSize);
+}
+
+bool SweepArchiveWriter::append (const SweepInfo& info, const double* samples)
+{
+  if (data == nullptr || info.length < 0)
+    return false;
+
+  // a full index moves to the end of the file with twice the room
+  ArchiveHeader* header = (ArchiveHeader*) data;
+  if (header->numSweeps == header->indexCapacity)
+  {
+    const uint64_t newCapacity = header->indexCapacity * 2;
+    if (!reserve (newCapacity * sizeof (uint64_t)))
+      return false;
+
+    header = (ArchiveHeader*) data;
+    memcpy (data + header->dataEnd, data + header->indexOffset, header->numSweeps * sizeof (uint64_t));
+    header->indexOffset = header->dataEnd;
+    header->indexCapacity = newCapacity;
+    header->dataEnd += newCapacity * sizeof (uint64_t);
+  }
+
+  const uint64_t recordSize = getRecordSize (info.length);
+  if (!reserve (recordSize))
+    return false;
+
+  header = (ArchiveHeader*) data;
+  uint8_t* record = data + header->dataEnd;
+  memcpy (record, &info, sizeof (SweepInfo));
+
+  float* out = (float*) (record + sizeof (SweepInfo));
+  for (int i = 0; i < info.length; i++)
+    out[i] = (float) samples[i];
+
+  uint64_t* index = (uint64_t*) (data + header->indexOffset);
+  index[header->numSweeps] = header->dataEnd;
+
+  // the sweep is complete before the header counts it
+  header->dataEnd += recordSize;
+  header->numSweeps++;
+  return true;
+}
+
+#ifdef _WIN32
+
+bool SweepArchiveWriter::resize (uint64_t newSize)
+{
+  if (data != nullptr)
+    UnmapViewOfFile (data);
+  if (mapping != nullptr)
+    CloseHandle (mapping);
+  data = nullptr;
+
+  // mapping past the end of the file extends it
+  mapping = CreateFileMappingA (file, nullptr, PAGE_READWRITE, (DWORD) (newSize >> 32), (DWORD) newSize, nullptr);
+  if (mapping == nullptr)
+    return false;
+
+  data = (uint8_t*) MapViewOfFile (mapping, FILE_MAP_WRITE, 0, 0, 0);
+  size = newSize;
+  return data != nullptr;
+}
+
+void SweepArchiveWriter::close()
+{
+  uint64_t used = 0;
+
+  if (data != nullptr)
+  {
+    used = ((const ArchiveHeader*) data)->dataEnd;
+    FlushViewOfFile (data, 0);
+    UnmapViewOfFile (data);
+    data = nullptr;
+  }
+
+  if (mapping != nullptr)
+  {
+    CloseHandle (mapping);
+    mapping = nullptr;
+  }
+
+  if (file != INVALID_HANDLE_VALUE)
+  {
+    if (used > 0)
+    {
+      LARGE_INTEGER end;
+      end.QuadPart = (LONGLONG) used;
+      SetFilePointerEx (file, end, nullptr, FILE_BEGIN);
+      SetEndOfFile (file);
+    }
+
+    CloseHandle (file);
+    file = INVALID_HANDLE_VALUE;
+  }
+
+  size = 0;
+}
+
+#else
+
+bool SweepArchiveWriter::resize (uint64_t newSize)
+{
+  if (data != nullptr)
+    munmap (data, size);
+  data = nullptr;
+
+  if (ftruncate (fd, (off_t) newSize) != 0)
+    return false;
+
+  void* mapped = mmap (nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapped == MAP_FAILED)
+    return false;
+
+  data = (uint8_t*) mapped;
+  size = newSize;
+  return true;
+}
+
+void SweepArchiveWriter::close()
+{
+  if (data != nullptr)
+  {
+    const uint64_t used = ((const ArchiveHeader*) data)->dataEnd;
+    msync (data, size, MS_SYNC);
+    munmap (data, size);
+    data = nullptr;
+
+    // a failed trim keeps the preallocated tail, which the header already excludes
+    const int trimmed = ftruncate (fd, (off_t) used);
+    (void) trimmed;
+  }
+
+  if (fd >= 0)
+  {
+    fsync (fd);
+    ::close (fd);
+    fd = -1;
+  }
+
+  size = 0;
+}
+
+#endif
+
+//==============================================================================
+SweepArchiveReader::SweepArchiveReader (const std::string& path) :
+  file (path), index (nullptr), numSweeps (0), valid (false)
+{
+  const uint8_t* d = file.getData();
+  if (d == nullptr || file.getSize() < sizeof (ArchiveHeader))
+    return;
+
+  const uint64_t fileSize = file.getSize();
+  const ArchiveHeader* header = (const ArchiveHeader*) d;
+  if (memcmp (header->magic, archiveMagic, sizeof (archiveMagic)) != 0 || header->version != archiveVersion
+      || header->indexOffset % sizeof (uint64_t) != 0 || header->indexOffset > fileSize
+      || header->numSweeps > (fileSize - header->indexOffset) / sizeof (uint64_t)
+      || header->dataEnd > fileSize)
+    return;
+
+  // every record must lie inside the file, so getInfo() and getSamples() need no checks
+  const uint64_t* sweepIndex = (const uint64_t*) (d + header->indexOffset);
+  for (uint64_t i = 0; i < header->numSweeps; i++)
+  {
+    const uint64_t offset = sweepIndex[i];
+    if (offset % sizeof (uint64_t) != 0 || offset > fileSize || fileSize - offset < sizeof (SweepInfo))
+      return;
+
+    const SweepInfo* info = (const SweepInfo*) (d + offset);
+    if (info->length < 0 || (uint64_t) info->length > (fileSize - offset - sizeof (SweepInfo)) / sizeof (float))
+      return;
+  }
+
+  index = sweepIndex;
+  numSweeps = header->numSweeps;
+  valid = true;
+}
+
+const SweepInfo& SweepArchiveReader::getInfo (uint64_t sweep) const
+{
+  return *(const SweepInfo*) (file.getData() + index[sweep]);
+}
+
+const float* SweepArchiveReader::getSamples (uint64_t sweep) const
+{
+  return (const float*) (file.getData() + index[sweep] + sizeof (SweepInfo));
+}
@@ -0,0 +1,126 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __SWEEPARCHIVE_H_DEFINED
+#define __SWEEPARCHIVE_H_DEFINED
+
+#include "MappedFile.h"
+
+#include <stdint.h>
+#include <string>
+
+namespace StimDetectorSpace {
+
+  /** Fixed-size header of one archived sweep, followed in the file by its samples. */
+  struct SweepInfo
+  {
+    int64_t startTimestamp;     //timestamp of the first sample; the trigger is preLength samples in
+    double sampleRate;          //input channel sample rate
+    int32_t module;             //detector module index
+    int32_t row;                //avg row the sweep belongs to
+    int32_t count;              //avg count when the window closed
+    int32_t length;             //samples, one per timestamp from startTimestamp
+    int32_t preLength;          //pre-trigger samples at the start
+    int32_t flags;              //gatedFlag
+  };
+
+  enum { gatedFlag = 1 };       //the window was started by the gate
+
+  /**
+
+    Append-only file of raw sweeps, memory mapped while it is written.
+
+    The file is a 64-byte header, an index with the offset of every sweep and
+    the sweeps themselves (SweepInfo plus float samples, in the units of the
+    bank's stim window). Space is preallocated and doubled when it runs out;
+    the index is moved to the end of the file when it fills up. The header is
+    updated after every sweep, so a file cut short by a crash is still readable
+    up to its last complete sweep. close() trims the unused space.
+
+    One thread at a time; not real-time safe, since growing remaps the file.
+
+  */
+  class SweepArchiveWriter
+  {
+  public:
+    SweepArchiveWriter();
+    ~SweepArchiveWriter();
+
+    /** Creates or replaces path with initialBytes preallocated. */
+    bool open (const std::string& path, uint64_t initialBytes = (uint64_t) 64 << 20);
+
+    /** Appends a sweep of info.length samples; false if the file could not grow. */
+    bool append (const SweepInfo& info, const double* samples);
+
+    /** Trims the file to its contents and closes it. */
+    void close();
+
+    bool isOpen() const                 { return data != nullptr; }
+    uint64_t getNumSweeps() const;
+
+  private:
+    bool resize (uint64_t newSize);
+    bool reserve (uint64_t bytes);
+
+    uint8_t* data;
+    uint64_t size;
+
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int fd;
+#endif
+
+    SweepArchiveWriter (const SweepArchiveWriter&);
+    SweepArchiveWriter& operator= (const SweepArchiveWriter&);
+  };
+
+  /**
+
+    Read-only view of a sweep archive with O(1) access by sweep number. Opening
+    checks that every sweep lies inside the file and rejects the archive if one
+    does not; after that only the samples that are touched are read from disk.
+
+  */
+  class SweepArchiveReader
+  {
+  public:
+    explicit SweepArchiveReader (const std::string& path);
+
+    bool isOpen() const                 { return valid; }
+    uint64_t getNumSweeps() const       { return numSweeps; }
+
+    const SweepInfo& getInfo (uint64_t sweep) const;
+    const float* getSamples (uint64_t sweep) const;
+
+  private:
+    MappedFile file;
+    const uint64_t* index;
+    uint64_t numSweeps;
+    bool valid;
+  };
+
+}
+
+#endif  // __SWEEPARCHIVE_H_DEFINED
@@ -0,0 +1,158 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SweepReanalysis.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace StimDetectorSpace;
+
+SweepReanalysis::SweepReanalysis (const SweepArchiveReader& a, const ReanalysisSettings& s) :
+  archive (a), settings (s)
+{
+  std::sort (settings.splits.begin(), settings.splits.end());
+}
+
+void SweepReanalysis::assignRows()
+{
+  const uint64_t numSweeps = archive.getNumSweeps();
+  rows.assign (numSweeps, 0);
+  counts.assign (numSweeps, 0);
+  lengths.assign (numSweeps, 0);
+  params.assign (numSweeps * NUM_WAVEFORM_PARAMS, 0.0);
+
+  std::vector<int> sweepNumber;     //per module
+  std::vector<int> rowCount;        //per module, sweeps in its current row
+
+  for (uint64_t i = 0; i < numSweeps; i++)
+  {
+    const SweepInfo& info = archive.getInfo (i);
+    const int m = std::max (0, (int) info.module);
+
+    lengths[i] = info.length;
+    if (settings.windowMs > 0 && info.sampleRate > 0)
+      lengths[i] = std::min (info.length, info.preLength + (int) std::ceil (info.sampleRate * settings.windowMs / 1000));
+
+    if (m >= (int) sweepNumber.size())
+    {
+      sweepNumber.resize (m + 1, 0);
+      rowCount.resize (m + 1, 0);
+    }
+
+    const int n = sweepNumber[m]++;
+
+    if (settings.splitEvery > 0)
+    {
+      rows[i] = n / settings.splitEvery;
+      counts[i] = n % settings.splitEvery + 1;
+    }
+    else if (!settings.splits.empty())
+    {
+      rows[i] = (int) (std::upper_bound (settings.splits.begin(), settings.splits.end(), n) - settings.splits.begin());
+      const bool newRow = std::binary_search (settings.splits.begin(), settings.splits.end(), n);
+      counts[i] = newRow ? 1 : rowCount[m] + 1;
+    }
+    else
+    {
+      // as recorded, clears included
+      rows[i] = info.row;
+      counts[i] = info.count;
+    }
+
+    rowCount[m] = counts[i];
+  }
+}
+
+void SweepReanalysis::measureSweeps (uint64_t begin, uint64_t end)
+{
+  std::vector<double> stim, smoothed;
+
+  for (uint64_t i = begin; i < end; i++)
+  {
+    const SweepInfo& info = archive.getInfo (i);
+    const double sampleRate = info.sampleRate;
+    const int length = lengths[i];
+    if (sampleRate <= 0 || length <= info.preLength)
+      continue;
+
+    const int ttlLength = (int) std::ceil (sampleRate * settings.ttlMs / 1000);
+    const int movMean = std::max (1, (int) std::ceil (sampleRate * settings.smoothingMs / 1000));
+
+    stim.resize (length);
+    smoothed.resize (length);
+
+    const float* samples = archive.getSamples (i);
+    std::copy (samples, samples + length, stim.begin());
+
+    WaveformFeatures features;
+    extractWaveformFeatures (stim.data(), info.startTimestamp, length, info.preLength, ttlLength, movMean,
+                             smoothed.data(), features);
+    computeWaveformParams (features, counts[i], ttlLength, sampleRate, &params[i * NUM_WAVEFORM_PARAMS]);
+  }
+}
+
+void SweepReanalysis::buildTables (std::vector<ReanalysisTable>& tables) const
+{
+  tables.clear();
+  std::vector<double> sweep;
+
+  for (uint64_t i = 0; i < rows.size(); i++)
+  {
+    const int m = std::max (0, (int) archive.getInfo (i).module);
+    const int row = rows[i];
+    const int count = counts[i];
+
+    if (m >= (int) tables.size())
+      tables.resize (m + 1);
+
+    ReanalysisTable& table = tables[m];
+    if (row >= table.numRows)
+    {
+      table.numRows = row + 1;
+      table.avgTable.resize ((size_t) table.numRows * NUM_WAVEFORM_PARAMS, 0.0);
+      table.avgSweeps.resize (table.numRows);
+    }
+
+    if (count <= 0)
+      continue;
+
+    // a count of 1 starts the row again, as after a clear
+    SweepStatistics& stats = table.avgSweeps[row];
+    if (count == 1)
+      stats.reset();
+
+    const float* samples = archive.getSamples (i);
+    sweep.assign (samples, samples + lengths[i]);
+    stats.add (sweep.data(), lengths[i]);
+
+    const double* last = getSweepParams (i);
+    double* r = &table.avgTable[(size_t) row * NUM_WAVEFORM_PARAMS];
+
+    r[0] = updateRunningMean (r[0], last[0], count);      //MIN
+    r[1] = updateRunningMean (r[1], last[1], count);      //MAX
+    r[2] = r[1] - r[0];                                   //PEAK TO PEAK
+    r[3] = updateRunningMean (r[3], last[3], count);      //LATENCY
+    r[4] = updateRunningMean (r[4], last[4], count);      //SLOPE
+    r[5] = count;                                         //AVG COUNT
+  }
+}
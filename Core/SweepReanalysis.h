@@ -0,0 +1,97 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __SWEEPREANALYSIS_H_DEFINED
+#define __SWEEPREANALYSIS_H_DEFINED
+
+#include "SweepArchive.h"
+#include "SweepStatistics.h"
+#include "WaveformFeatures.h"
+
+#include <vector>
+
+namespace StimDetectorSpace {
+
+  /** How archived sweeps are measured and grouped into avg rows again. */
+  struct ReanalysisSettings
+  {
+    ReanalysisSettings() : smoothingMs (5), ttlMs (5), windowMs (0), splitEvery (0) {}
+
+    double smoothingMs;         //moving mean width
+    double ttlMs;               //blanking after the trigger, also added to the latency
+    double windowMs;            //window after the trigger, 0 for the archived length
+    int splitEvery;             //sweeps per avg row and detector, 0 for the archived rows
+    std::vector<int> splits;    //or the sweep numbers, per detector, that start a new row
+  };
+
+  /** Avg rows of one detector, laid out as ModuleResults::avgTable. */
+  struct ReanalysisTable
+  {
+    ReanalysisTable() : numRows (0) {}
+
+    int numRows;
+    std::vector<double> avgTable;                 //NUM_WAVEFORM_PARAMS values per row
+    std::vector<SweepStatistics> avgSweeps;       //mean and spread of each row's sweeps, in stim units
+  };
+
+  /**
+
+    Offline counterpart of the analysis thread, over a sweep archive.
+
+    measureSweeps() runs the same feature extraction as updateWaveformParams
+    on any range of sweeps, so ranges can be measured on separate threads.
+    buildTables() then folds the measured sweeps into running means in archive
+    order, as updateActiveAvgLineParams does.
+
+  */
+  class SweepReanalysis
+  {
+  public:
+    SweepReanalysis (const SweepArchiveReader& archive, const ReanalysisSettings& settings);
+
+    /** Avg row and count of every sweep under the settings; call before measuring. */
+    void assignRows();
+
+    /** Fills the params of sweeps [begin, end). Thread safe for disjoint ranges. */
+    void measureSweeps (uint64_t begin, uint64_t end);
+
+    /** Running means of every detector, indexed by module, measured params and sweeps both. */
+    void buildTables (std::vector<ReanalysisTable>& tables) const;
+
+    /** min, max, peak to peak, latency, slope and count of a measured sweep. */
+    const double* getSweepParams (uint64_t sweep) const { return &params[sweep * NUM_WAVEFORM_PARAMS]; }
+    int getSweepRow (uint64_t sweep) const              { return rows[sweep]; }
+
+  private:
+    const SweepArchiveReader& archive;
+    ReanalysisSettings settings;
+
+    std::vector<int> rows;          //avg row of each sweep
+    std::vector<int> counts;        //count of each sweep in its row
+    std::vector<int> lengths;       //samples of each sweep within the window
+    std::vector<double> params;     //NUM_WAVEFORM_PARAMS per sweep
+  };
+
+}
+
+#endif  // __SWEEPREANALYSIS_H_DEFINED
@@ -0,0 +1,51 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SweepStatistics.h"
+#include "StimDetectorKernels.h"
+
+#include <algorithm>
+
+using namespace StimDetectorSpace;
+
+void StimDetectorSpace::accumulateSweep (const double* sweep, int length, int count, double* mean, double* m2)
+{
+  if (count <= 1)
+  {
+    std::copy (sweep, sweep + length, mean);
+    std::fill (m2, m2 + length, 0.0);
+    return;
+  }
+
+  Kernels::accumulateSweep (sweep, length, 1.0 / (double) count, mean, m2);
+}
+
+void SweepStatistics::add (const double* sweep, int length)
+{
+  if (count == 0)
+  {
+    mean.resize (length);
+    m2.resize (length);
+  }
+
+  accumulateSweep (sweep, std::min (length, (int) mean.size()), ++count, mean.data(), m2.data());
+}
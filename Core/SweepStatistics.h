@@ -0,0 +1,79 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __SWEEPSTATISTICS_H_DEFINED
+#define __SWEEPSTATISTICS_H_DEFINED
+
+#include <cmath>
+#include <vector>
+
+namespace StimDetectorSpace {
+
+  /** Adds sweep number count (counting from 1) to the per-sample mean and sum of squared
+      deviations m2 of the sweeps before it (Welford). The first sweep restarts both.
+      Costs one division per sweep instead of one per sample. */
+  void accumulateSweep (const double* sweep, int length, int count, double* mean, double* m2);
+
+  /** Sample variance of count sweeps from their m2; 0 below two sweeps. */
+  inline double getSweepVariance (double m2, int count)
+  {
+    return count > 1 ? m2 / ((double) count - 1) : 0.0;
+  }
+
+  /** Standard error of the mean of count sweeps from their m2; 0 below two sweeps. */
+  inline double getSweepSem (double m2, int count)
+  {
+    return count > 1 ? std::sqrt (m2 / ((double) count * ((double) count - 1))) : 0.0;
+  }
+
+  /**
+
+    Mean, variance and SEM of every sample of a set of sweeps, without keeping
+    the sweeps. The first sweep sets the length; later sweeps are expected to
+    share it and only their first getLength() samples are used.
+
+  */
+  class SweepStatistics
+  {
+  public:
+    SweepStatistics() : count (0) {}
+
+    void reset()                    { count = 0; }
+    void add (const double* sweep, int length);
+
+    int getCount() const            { return count; }
+    int getLength() const           { return count > 0 ? (int) mean.size() : 0; }
+
+    const double* getMean() const   { return mean.data(); }
+    double getVariance (int i) const { return getSweepVariance (m2[i], count); }
+    double getSem (int i) const     { return getSweepSem (m2[i], count); }
+
+  private:
+    int count;
+    std::vector<double> mean;
+    std::vector<double> m2;         //sum of squared deviations from the mean
+  };
+
+}
+
+#endif  // __SWEEPSTATISTICS_H_DEFINED
@@ -0,0 +1,140 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TemplateMatcher.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  int chooseFftSize (int templateLength, int maxBlock)
+  {
+    int n = 4;
+    while (n < templateLength - 1 + maxBlock)
+      n <<= 1;
+    return n;
+  }
+}
+
+TemplateMatcher::TemplateMatcher (const float* shape, int templateLength, int maxBlock) :
+  length (std::max (1, templateLength)),
+  hop (0),
+  flatTemplate (true),
+  fft (chooseFftSize (std::max (1, templateLength), std::max (1, maxBlock)))
+{
+  const int n = fft.getSize();
+  hop = n - length + 1;
+
+  templateSpectrum.assign (n + 2, 0.0f);
+  segment.assign (n, 0.0f);
+  spectrum.assign (n + 2, 0.0f);
+  product.assign (n, 0.0f);
+  sums.assign (n + 1, 0.0);
+  squares.assign (n + 1, 0.0);
+
+  // zero mean and unit norm, so the dot product with a window is its correlation
+  double mean = 0;
+  for (int k = 0; k < templateLength; k++)
+    mean += shape[k];
+  mean /= length;
+
+  double norm = 0;
+  for (int k = 0; k < templateLength; k++)
+    norm += (shape[k] - mean) * (shape[k] - mean);
+  norm = std::sqrt (norm);
+
+  flatTemplate = norm <= 0;
+  if (flatTemplate)
+    return;
+
+  // reversed, so the convolution is a correlation
+  std::vector<float> reversed (n, 0.0f);
+  for (int k = 0; k < templateLength; k++)
+    reversed[length - 1 - k] = (float) ((shape[k] - mean) / norm);
+
+  fft.forward (reversed.data(), templateSpectrum.data());
+}
+
+void TemplateMatcher::reset()
+{
+  std::fill (segment.begin(), segment.end(), 0.0f);
+}
+
+void TemplateMatcher::process (const float* input, int numSamples, float* correlation)
+{
+  for (int start = 0; start < numSamples; start += hop)
+  {
+    const int chunk = std::min (hop, numSamples - start);
+    processChunk (input + start, chunk, correlation + start);
+  }
+}
+
+void TemplateMatcher::processChunk (const float* input, int numSamples, float* correlation)
+{
+  const int n = fft.getSize();
+  const int history = length - 1;
+  const int end = history + numSamples;
+
+  std::copy (input, input + numSamples, segment.begin() + history);
+  std::fill (segment.begin() + end, segment.end(), 0.0f);
+
+  if (!flatTemplate)
+  {
+    fft.forward (segment.data(), spectrum.data());
+
+    for (int k = 0; k <= n / 2; k++)
+    {
+      const float ar = spectrum[2 * k], ai = spectrum[2 * k + 1];
+      const float br = templateSpectrum[2 * k], bi = templateSpectrum[2 * k + 1];
+      spectrum[2 * k] = ar * br - ai * bi;
+      spectrum[2 * k + 1] = ar * bi + ai * br;
+    }
+
+    fft.inverse (spectrum.data(), product.data());
+  }
+
+  // window energy from exact prefix sums of this segment, so nothing drifts
+  for (int j = 0; j < end; j++)
+  {
+    sums[j + 1] = sums[j] + segment[j];
+    squares[j + 1] = squares[j] + (double) segment[j] * segment[j];
+  }
+
+  for (int i = 0; i < numSamples; i++)
+  {
+    const int p = history + i;  //last sample of the window, first valid output of the circular convolution
+    const double sum = sums[p + 1] - sums[p + 1 - length];
+    const double energy = squares[p + 1] - squares[p + 1 - length] - sum * sum / length;
+
+    // flat input matches nothing; the threshold keeps rounding noise from looking like a shape
+    if (flatTemplate || energy <= 1e-12 * (squares[p + 1] - squares[p + 1 - length]) || energy <= 0)
+      correlation[i] = 0.0f;
+    else
+      correlation[i] = (float) std::max (-1.0, std::min (1.0, product[p] / std::sqrt (energy)));
+  }
+
+  // the last samples become the history of the next chunk
+  std::copy (segment.begin() + numSamples, segment.begin() + end, segment.begin());
+}
@@ -0,0 +1,80 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __TEMPLATEMATCHER_H_DEFINED
+#define __TEMPLATEMATCHER_H_DEFINED
+
+#include "RealFft.h"
+
+#include <vector>
+
+namespace StimDetectorSpace {
+
+  /**
+
+    Streaming normalized cross-correlation of an input channel with a template,
+    by overlap-save FFT convolution.
+
+    Each call correlates the new samples against the template ending at them,
+    so a match is reported at the last sample of the matched segment. The FFT
+    size is fixed by the template length and the largest block, which keeps
+    the cost per sample nearly flat as the template grows. Only the constructor
+    allocates.
+
+    @see DetectorEngine
+  */
+  class TemplateMatcher
+  {
+  public:
+    /** Matches templateLength samples of shape; process() takes up to maxBlock samples. */
+    TemplateMatcher (const float* shape, int templateLength, int maxBlock);
+
+    int getTemplateLength() const   { return length; }
+    int getFftSize() const          { return fft.getSize(); }
+
+    /** Writes the correlation in [-1, 1] of each input sample's last getTemplateLength()
+        samples with the template, or 0 where the input is flat. */
+    void process (const float* input, int numSamples, float* correlation);
+
+    /** Forgets the input history, as at the start of an acquisition. */
+    void reset();
+
+  private:
+    void processChunk (const float* input, int numSamples, float* correlation);
+
+    int length;
+    int hop;                        //new samples per transform
+    bool flatTemplate;
+
+    RealFft fft;
+    std::vector<float> templateSpectrum;  //of the reversed, zero-mean, unit-norm template
+    std::vector<float> segment;     //length - 1 samples of history, then the new ones
+    std::vector<float> spectrum;
+    std::vector<float> product;
+    std::vector<double> sums;       //prefix sums of the segment and of its squares
+    std::vector<double> squares;
+  };
+
+}
+
+#endif  // __TEMPLATEMATCHER_H_DEFINED
@@ -0,0 +1,136 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TraceRecorder.h"
+
+#include <stdio.h>
+
+using namespace StimDetectorSpace;
+
+TraceRecorder& TraceRecorder::getInstance()
+{
+  static TraceRecorder recorder;
+  return recorder;
+}
+
+TraceRecorder::TraceRecorder() :
+  numRings (0)
+{
+  for (int i = 0; i < maxThreads; i++)
+    rings[i].events.resize (ringSize);
+}
+
+TraceRecorder::RingOwner::~RingOwner()
+{
+  if (ring != nullptr)
+    ring->owned.store (false, std::memory_order_release);
+}
+
+TraceRecorder::Ring* TraceRecorder::getRing()
+{
+  static thread_local RingOwner owner;
+
+  if (owner.ring == nullptr && !owner.full)
+  {
+    // the lowest ring no running thread holds, so restarted workers take their old rings back
+    for (int index = 0; index < maxThreads; index++)
+    {
+      bool expected = false;
+      if (rings[index].owned.compare_exchange_strong (expected, true, std::memory_order_acquire))
+      {
+        owner.ring = &rings[index];
+
+        int used = numRings.load (std::memory_order_relaxed);
+        while (used <= index && !numRings.compare_exchange_weak (used, index + 1, std::memory_order_relaxed))
+          ;
+        break;
+      }
+    }
+
+    owner.full = owner.ring == nullptr;
+  }
+
+  return owner.ring;
+}
+
+void TraceRecorder::add (const char* name, uint64_t start, uint64_t end)
+{
+  Ring* ring = getRing();
+  if (ring == nullptr)
+    return;
+
+  const uint64_t n = ring->position.load (std::memory_order_relaxed);
+  Event& event = ring->events[n & (ringSize - 1)];
+  event.name = name;
+  event.start = start;
+  event.end = end;
+
+  ring->position.store (n + 1, std::memory_order_release);
+}
+
+void TraceRecorder::setThreadName (const char* name)
+{
+  if (Ring* ring = getRing())
+    ring->threadName.store (name, std::memory_order_relaxed);
+}
+
+bool TraceRecorder::writeChromeTrace (const char* path) const
+{
+  FILE* f = fopen (path, "w");
+  if (f == nullptr)
+    return false;
+
+  fprintf (f, "{\"traceEvents\":[\n");
+  bool first = true;
+
+  const int used = numRings.load (std::memory_order_relaxed);
+  for (int t = 0; t < used && t < maxThreads; t++)
+  {
+    const Ring& ring = rings[t];
+
+    if (const char* threadName = ring.threadName.load (std::memory_order_relaxed))
+    {
+      fprintf (f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+               first ? "" : ",\n", t, threadName);
+      first = false;
+    }
+
+    const uint64_t end = ring.position.load (std::memory_order_acquire);
+    const uint64_t begin = end > ringSize ? end - ringSize : 0;
+
+    for (uint64_t i = begin; i < end; i++)
+    {
+      const Event event = ring.events[i & (ringSize - 1)];
+
+      // the writer may have lapped this slot while it was read
+      if (ring.position.load (std::memory_order_acquire) - i > ringSize)
+        continue;
+
+      fprintf (f, "%s{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+               first ? "" : ",\n", event.name, t, event.start / 1000.0, (event.end - event.start) / 1000.0);
+      first = false;
+    }
+  }
+
+  fprintf (f, "\n]}\n");
+  return fclose (f) == 0;
+}
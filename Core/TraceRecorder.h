@@ -0,0 +1,140 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __TRACERECORDER_H_DEFINED
+#define __TRACERECORDER_H_DEFINED
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <vector>
+
+#ifndef STIMDETECTOR_TRACE
+ #define STIMDETECTOR_TRACE 0
+#endif
+
+namespace StimDetectorSpace {
+
+  /**
+
+    Timed scopes of every thread, kept in one ring per thread and written out
+    as Chrome trace JSON (chrome://tracing, Perfetto).
+
+    Rings are taken from a pool allocated with the recorder, so the first scope
+    of a thread neither locks nor allocates, and go back to the pool when their
+    thread exits; a thread that takes a ring over continues its trace. Each ring
+    has a single writer and keeps its last ringSize scopes. Scopes come from the SD_TRACE_SCOPE macros,
+    which compile to nothing unless STIMDETECTOR_TRACE is set.
+
+  */
+  class TraceRecorder
+  {
+  public:
+    enum
+    {
+      maxThreads = 32,                  //threads running at once past this are not recorded
+      ringSize = 1 << 14                //scopes kept per thread
+    };
+
+    /** The process-wide recorder; call once off the audio thread to allocate it. */
+    static TraceRecorder& getInstance();
+
+    static uint64_t now()
+    {
+      return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds> (
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /** Appends a scope of the calling thread; name must be a string literal. */
+    void add (const char* name, uint64_t start, uint64_t end);
+
+    /** Names the calling thread in the trace; name must be a string literal. */
+    void setThreadName (const char* name);
+
+    /** Writes what the rings hold now as Chrome trace JSON; false on a write error. */
+    bool writeChromeTrace (const char* path) const;
+
+  private:
+    TraceRecorder();
+
+    struct Event
+    {
+      const char* name;
+      uint64_t start;
+      uint64_t end;
+    };
+
+    struct Ring
+    {
+      Ring() : position (0), threadName (nullptr), owned (false) {}
+
+      std::vector<Event> events;
+      std::atomic<uint64_t> position;   //scopes written so far
+      std::atomic<const char*> threadName;
+      std::atomic<bool> owned;          //a running thread writes to it
+    };
+
+    /** The ring of the calling thread, given back when the thread exits. */
+    struct RingOwner
+    {
+      RingOwner() : ring (nullptr), full (false) {}
+      ~RingOwner();
+
+      Ring* ring;
+      bool full;                        //no ring was free at its first scope
+    };
+
+    Ring* getRing();
+
+    Ring rings[maxThreads];
+    std::atomic<int> numRings;          //one past the highest ring ever taken
+
+    TraceRecorder (const TraceRecorder&);
+    TraceRecorder& operator= (const TraceRecorder&);
+  };
+
+  /** Adds the time between its construction and destruction to the trace. */
+  class TraceScope
+  {
+  public:
+    explicit TraceScope (const char* n) : name (n), start (TraceRecorder::now()) {}
+    ~TraceScope()                       { TraceRecorder::getInstance().add (name, start, TraceRecorder::now()); }
+
+  private:
+    const char* name;
+    uint64_t start;
+  };
+
+}
+
+#if STIMDETECTOR_TRACE
+ #define SD_TRACE_CONCAT2(a, b) a##b
+ #define SD_TRACE_CONCAT(a, b) SD_TRACE_CONCAT2(a, b)
+ #define SD_TRACE_SCOPE(name) const StimDetectorSpace::TraceScope SD_TRACE_CONCAT(traceScope, __LINE__) (name)
+ #define SD_TRACE_THREAD(name) StimDetectorSpace::TraceRecorder::getInstance().setThreadName (name)
+#else
+ #define SD_TRACE_SCOPE(name)
+ #define SD_TRACE_THREAD(name)
+#endif
+
+#endif  // __TRACERECORDER_H_DEFINED
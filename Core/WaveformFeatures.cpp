@@ -0,0 +1,100 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "WaveformFeatures.h"
+#include <algorithm>
+
+using namespace StimDetectorSpace;
+
+void StimDetectorSpace::extractWaveformFeatures (const double* stim, int64_t startTimestamp, int length,
+                                                 int preLength, int ttlLength, int movMean,
+                                                 double* smoothed, WaveformFeatures& features)
+{
+  const int halfWidth = movMean / 2;
+  const int smoothStart = movMean;
+  const int smoothEnd = length - movMean;
+
+  // params are measured from the trigger, past the pre-trigger samples
+  const int pre = std::min (preLength, length);
+
+  features.sweepStart = length > pre ? startTimestamp + pre : 0;
+  features.xMin = 0;
+  features.yMin = 0;
+  int tMin = 0;
+
+  // running sum over stim[t - halfWidth, t + halfWidth)
+  double sum = 0;
+  if (smoothStart < smoothEnd)
+  {
+    for (int t = smoothStart - halfWidth; t < smoothStart + halfWidth; t++)
+      sum += stim[t];
+  }
+
+  //suavisar a curva e MIN, in a single pass
+  for (int t = 0; t < length; t++)
+  {
+    if (t >= smoothStart && t < smoothEnd)
+    {
+      if (t > smoothStart)
+        sum += stim[t + halfWidth - 1] - stim[t - halfWidth - 1];
+
+      smoothed[t] = sum / movMean;
+    }
+    else
+    {
+      smoothed[t] = stim[t];
+    }
+
+    if (smoothed[t] < features.yMin && t >= pre + ttlLength)
+    {
+      features.xMin = startTimestamp + t;
+      features.yMin = stim[t];
+      tMin = t; //ref
+    }
+  }
+
+  //MAX, walking back from the minimum while the smoothed curve rises
+  features.xMax = features.xMin;
+  features.yMax = features.yMin;
+  for (int tMax = tMin; tMax >= pre && tMax < length && (tMax > pre ? smoothed[tMax - 1] : 0.0) > smoothed[tMax]; tMax--)
+  {
+    features.xMax = startTimestamp + tMax;
+    features.yMax = stim[tMax];
+  }
+}
+
+void StimDetectorSpace::computeWaveformParams (const WaveformFeatures& f, int count, int ttlLength,
+                                               double sampleRate, double* params)
+{
+  double slope = f.xMax - f.xMin == 0 ? 0
+    : ((f.yMax - f.yMin) / ((f.xMax - f.xMin) / sampleRate));
+
+  double latency = count == 0 ? 0
+    : (double) (ttlLength + f.xMin - f.sweepStart) / sampleRate * 1000;
+
+  params[0] = f.yMin;               //MIN
+  params[1] = f.yMax;               //MAX
+  params[2] = f.yMax - f.yMin;      //PEAK TO PEAK
+  params[3] = latency;              //LATENCY
+  params[4] = slope;                //SLOPE
+  params[5] = count;                //AVG COUNT
+}
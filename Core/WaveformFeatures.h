@@ -0,0 +1,66 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __WAVEFORMFEATURES_H_DEFINED
+#define __WAVEFORMFEATURES_H_DEFINED
+
+#include <stdint.h>
+
+namespace StimDetectorSpace {
+
+  enum { NUM_WAVEFORM_PARAMS = 6 }; //min, max, peak to peak, latency, slope, count
+
+  /** Extremes of one evoked response. */
+  struct WaveformFeatures
+  {
+    WaveformFeatures() : sweepStart(0), yMax(0), yMin(0), xMax(0), xMin(0) {}
+
+    int64_t sweepStart;         //timestamp of the trigger
+    double yMax;                //max of stim
+    double yMin;                //min of stim
+    int64_t xMax;               //time of max
+    int64_t xMin;               //time of min
+  };
+
+  /** Smooths stim with a moving mean of movMean samples into smoothed (length values) and
+      finds the minimum after the TTL, then the maximum walking back from it while the
+      smoothed curve rises. The first preLength samples are pre-trigger history and are
+      only used for smoothing. Sample t has timestamp startTimestamp + t. */
+  void extractWaveformFeatures (const double* stim, int64_t startTimestamp, int length,
+                                int preLength, int ttlLength, int movMean,
+                                double* smoothed, WaveformFeatures& features);
+
+  /** Fills the NUM_WAVEFORM_PARAMS table values of a response: min, max, peak to peak,
+      latency (ms), slope and count. Latency is 0 while count is 0. */
+  void computeWaveformParams (const WaveformFeatures& features, int count, int ttlLength,
+                              double sampleRate, double* params);
+
+  /** Mean of count values, given the mean of the first count - 1 and the last one. */
+  inline double updateRunningMean (double mean, double value, int count)
+  {
+    return (mean * ((double) count - 1) + value) / (double) count;
+  }
+
+}
+
+#endif  // __WAVEFORMFEATURES_H_DEFINED
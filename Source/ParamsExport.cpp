@@ -0,0 +1,134 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ParamsExport.h"
+
+using namespace StimDetectorSpace;
+
+ParamsExport::ParamsExport(int capacity)
+  : Thread    ("Stim Detector export")
+  , fifo      (capacity)
+  , lastSync  (0)
+{
+  records.calloc(capacity);
+}
+
+ParamsExport::~ParamsExport()
+{
+  stop();
+}
+
+bool ParamsExport::start(const File& newFile)
+{
+  stop();
+
+  file = newFile;
+  file.getParentDirectory().createDirectory();
+  const bool isNew = !file.existsAsFile();
+
+  stream = new FileOutputStream(file, 1 << 16); // appends
+  if (!stream->openedOk())
+  {
+    stream = nullptr;
+    return false;
+  }
+
+  if (isNew)
+    *stream << "module,row,count,timestamp,min,max,peak_to_peak,latency,slope,gated\n";
+
+  fifo.reset();
+  numDropped.set(0);
+  lastSync = Time::getMillisecondCounter();
+
+  startThread();
+  return true;
+}
+
+void ParamsExport::stop()
+{
+  if (stream == nullptr)
+    return;
+
+  stopThread(1000);
+  writePending();
+  stream->flush();
+  stream = nullptr;
+}
+
+bool ParamsExport::push(const Record& record)
+{
+  int start1, size1, start2, size2;
+  fifo.prepareToWrite(1, start1, size1, start2, size2);
+
+  if (size1 == 0)
+  {
+    ++numDropped;
+    return false;
+  }
+
+  records[start1] = record;
+  fifo.finishedWrite(1);
+  return true;
+}
+
+void ParamsExport::run()
+{
+  while (!threadShouldExit())
+  {
+    wait(pollMs);
+    writePending();
+
+    // flush() syncs the file, so it runs once per interval rather than per batch
+    const uint32 now = Time::getMillisecondCounter();
+    if (now - lastSync >= syncIntervalMs)
+    {
+      stream->flush();
+      lastSync = now;
+    }
+  }
+}
+
+// Writer thread, or the message thread once the writer has stopped
+void ParamsExport::writePending()
+{
+  int start1, size1, start2, size2;
+  fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+
+  const int starts[] = { start1, start2 };
+  const int sizes[] = { size1, size2 };
+  char line[256];
+
+  for (int block = 0; block < 2; ++block)
+  {
+    for (int i = starts[block]; i < starts[block] + sizes[block]; ++i)
+    {
+      const Record& r = records[i];
+      const int length = snprintf(line, sizeof(line), "%d,%d,%d,%lld,%g,%g,%g,%g,%g,%d\n",
+        r.module, r.row, r.count, (long long) r.timestamp,
+        r.params[0], r.params[1], r.params[2], r.params[3], r.params[4], r.gated ? 1 : 0);
+
+      stream->write(line, (size_t) jmin(length, (int) sizeof(line) - 1));
+    }
+  }
+
+  fifo.finishedRead(size1 + size2);
+}
@@ -0,0 +1,98 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __PARAMSEXPORT_H_DEFINED
+#define __PARAMSEXPORT_H_DEFINED
+
+#include <ProcessorHeaders.h>
+#include "WaveformFeatures.h"
+
+namespace StimDetectorSpace {
+
+  /**
+
+    Appends the params of every analysed stim to a CSV file, off the
+    analysis thread.
+
+    The analysis thread pushes records into a lock-free single-producer
+    queue and never touches the file; a writer thread drains it in batches
+    through a buffered stream and syncs the file to disk about once a second.
+    When the queue is full the record is dropped and counted.
+
+    @see StimDetector
+  */
+  class ParamsExport : private Thread
+  {
+  public:
+    struct Record
+    {
+      int module;                             //detector module index
+      int row;                                //avg row of the stim
+      int count;                              //stims in the row so far
+      bool gated;                             //the window was started by the gate
+      int64 timestamp;                        //trigger timestamp
+      double params[NUM_WAVEFORM_PARAMS];     //min, max, peak to peak, latency, slope, count
+    };
+
+    ParamsExport (int capacity);
+    ~ParamsExport();
+
+    /** Message thread: opens file for appending and starts the writer. */
+    bool start (const File& file);
+
+    /** Message thread: writes what is left, syncs and closes the file. */
+    void stop();
+
+    /** Producer side, never blocks; false if the record was dropped. */
+    bool push (const Record& record);
+
+    bool isRunning() const { return stream != nullptr; }
+    const File& getFile() const { return file; }
+
+    /** Records lost because the queue was full since start(). */
+    int getNumDropped() const { return numDropped.get(); }
+
+  private:
+    enum
+    {
+      pollMs = 20,                            //writer wake-up period
+      syncIntervalMs = 1000                   //time between syncs to disk
+    };
+
+    void run() override;
+    void writePending();
+
+    AbstractFifo fifo;
+    HeapBlock<Record> records;
+    Atomic<int> numDropped;
+
+    File file;
+    ScopedPointer<FileOutputStream> stream;
+    uint32 lastSync;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ParamsExport);
+  };
+
+}
+
+#endif  // __PARAMSEXPORT_H_DEFINED
@@ -23,29 +23,163 @@
 #include <stdio.h>
 #include "StimDetector.h"
 #include "StimDetectorEditor.h"
+#include "StimDetectorKernels.h"
 #include <math.h>
 #include <iostream>
+#include <new>
+#include <stdlib.h>
 
 #define PI 3.1415926535897932384626433
 
 using namespace StimDetectorSpace;
 
+#if JUCE_DEBUG
+namespace
+{
+  // set while the calling thread runs the audio path and may not allocate
+  bool& getRealtimeFlag()
+  {
+    static thread_local bool realtime = false;
+    return realtime;
+  }
+
+  // the assertion logs through JUCE, which allocates itself
+  void assertNotRealtime()
+  {
+    if (getRealtimeFlag())
+    {
+      getRealtimeFlag() = false;
+      jassertfalse; // heap allocation or release inside process()
+      getRealtimeFlag() = true;
+    }
+  }
+}
+
+/**
+  Debug-build guard for the audio thread. While process() runs, any heap allocation or
+  release by the plugin's code asserts through the operator new and delete replacements
+  below, as does prepareModule(); on exit it also asserts that the detector storage kept
+  its addresses and sizes. The pool's workers are covered by a Scope in processChannelGroup().
+*/
+class StimDetector::RealtimeStorageCheck
+{
+public:
+  RealtimeStorageCheck(StimDetector& p) : processor(p), signature(getStorageSignature())
+  {
+  }
+
+  ~RealtimeStorageCheck()
+  {
+    jassert(signature == getStorageSignature()); // detector storage was resized inside process()
+  }
+
+  static bool isActive() { return getRealtimeFlag(); }
+
+  /** Marks the calling thread as running the audio path while it exists. */
+  class Scope
+  {
+  public:
+    Scope(bool realtime = true) : previous(getRealtimeFlag()) { getRealtimeFlag() = realtime; }
+    ~Scope() { getRealtimeFlag() = previous; }
+
+  private:
+    const bool previous;
+  };
+
+  /** The host's event API allocates in every buffer with events; that is not ours to fix. */
+  class HostAllocation : public Scope
+  {
+  public:
+    HostAllocation() : Scope(false) {}
+  };
+
+private:
+  uint64 getStorageSignature() const
+  {
+    const DetectorBank& bank = processor.bank;
+
+    uint64 s = (uint64)(pointer_sized_int)processor.modules.begin() + (uint64)processor.modules.size();
+    s = s * 31 + (uint64)(pointer_sized_int)bank.getStim(0) + (uint64)bank.size();
+    s = s * 31 + (uint64)(pointer_sized_int)bank.threshold.data() + (uint64)bank.getWindowCapacity();
+
+    for (const DetectorModule& m : processor.modules)
+      s = s * 31 + (uint64)(pointer_sized_int)m.stimMean.begin() + (uint64)m.stimMean.size();
+
+    return s;
+  }
+
+  StimDetector& processor;
+  const uint64 signature;
+  const Scope scope;                  //after the signature, which is taken before process() starts
+};
+
+// Debug builds only: the plugin's allocations assert on the audio path
+void* operator new(size_t size)
+{
+  assertNotRealtime();
+  if (void* p = malloc(size > 0 ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+  if (p != nullptr)
+    assertNotRealtime();
+  free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+  operator delete(p);
+}
+#endif
+
 StimDetector::StimDetector()
   : GenericProcessor      ("Stim Detector")
+  , engine                (bank)
   , activeModule          (-1)
   , defaultThreshold      (100.0f)
+  , numThreads            (1)
+  , groupJob              (*this)
+  , sweepQueue            (64)
+  , paramsExport          (4096)
+  , archiveEnabled        (false)
+  , resultVersion         (0)
+  , budgetSampleRate      (0)
 {
   setProcessorType (PROCESSOR_TYPE_FILTER);
   lastNumInputs = 1;
 
-  avgLength = 1;
-  ttlLength = 1;
   buffetMin = 1;
-  movMean = 1;
+
+  prepareScratch();
+
+  analysisThread = new AnalysisThread(*this);
+
+#if STIMDETECTOR_TRACE
+  TraceRecorder::getInstance(); // allocate the trace rings here, not on the audio thread
+#endif
 }
 
 StimDetector::~StimDetector()
 {
+  analysisThread->stopThread(1000);
 }
 
 AudioProcessorEditor* StimDetector::createEditor()
@@ -64,48 +198,64 @@ void StimDetector::addModule()
   m.inputChan = -1;
   m.gateChan = -1;
   m.outputChan = -1;
-  m.samplesSinceTrigger = 5000;
-  m.lastSample = 0.0f;
-  m.lastDiff = 0.0f;
   m.threshold = 0.0f;
-  m.yMin = 0.0f;
-  m.yMax = 0.0f;
-  m.xMin = 0;
-  m.xMax = 0;
+  m.matchThreshold = 0.8;
+  m.templateMs = 2;
+  m.usesTemplate = false;
   m.applyDiff = false;
+  m.diffChannel = false;
   m.isActive = true;
-  m.wasTriggered = false;
-  m.wasTriggered_buffer = false;
-  m.startStim = false;
-  m.detectorStim = true;
-  m.ignoreFirst = true;
-  m.startIndex = -1;
-  m.windowIndex = -1;
-  m.count = 0;
-  m.timestamps.resize(avgLength);
-  m.stim.resize(avgLength);
-  m.avg.resize(avgLength);
-  m.stimMean.resize(avgLength);
- 
-  m.matrix.add (m.avg);
+  m.sampleRate = 0;
+  m.avgLength = 0;
+  m.preTriggerMs = 0;
+  m.preLength = 0;
+  m.ttlLength = 0;
+  m.movMean = 0;
+  m.sweepCount = 0;
+  m.numGated = 0;
+  m.numAligned = 0;
+  m.gateAlignment = 0;
+  m.maxGateAlignment = 0;
+
   m.activeRow = 0;
   m.yAvgMin.add(0.0f);
   m.yAvgMax.add(0.0f);
   m.avgSlope.add(0.0f);
   m.avgLatency.add(0.0f);
+  m.avgCount.add(0);
+  m.rowStats.add(SweepStatistics());
 
-  modules.add (m);
+  {
+    const SpinLock::ScopedLockType lock(triggerLock);
+    requestedMatchers.add(nullptr);
+    requestedDifferentiators.add(nullptr);
+    requestedPrefilters.add(nullptr);
+  }
 
+  const ScopedLock resetLock(onlineReset);
+  modules.add (m);
+  publishResults();
 }
 
 void StimDetector::setActiveModule (int i)
 {
   activeModule = i;
+
+  // the snapshot only carries the mean sweeps of the active detector
+  const ScopedLock resetLock(onlineReset);
+  publishResults();
 }
 
 void StimDetector::setParameter (int parameterIndex, float newValue)
 {
+  if (parameterIndex == 7) // numThreads, for the whole node
+  {
+    numThreads = jlimit(1, SystemStats::getNumCpus(), (int) newValue);
+    return;
+  }
+
   DetectorModule& module = modules.getReference (activeModule);
+  const bool inBank = activeModule < bank.size();  //added modules join the bank in updateSettings
 
   if (parameterIndex == 1) // applyDiff
   {
@@ -114,21 +264,20 @@ void StimDetector::setParameter (int parameterIndex, float newValue)
   else if (parameterIndex == 2)   // inputChan
   {
     module.inputChan = (int) newValue;
+    groupsChanged.set(1);
   }
   else if (parameterIndex == 3)   // outputChan
   {
     module.outputChan = (int) newValue;
+    if (inBank)
+      bank.outputChan[activeModule] = module.outputChan;
   }
   else if (parameterIndex == 4)   // gateChan
   {
     module.gateChan = (int) newValue;
-    if (module.gateChan < 0)
+    if (inBank)
     {
-      module.detectorStim = true;
-    }
-    else
-    {
-      module.detectorStim = false;
+      bank.detectorStim[activeModule] = module.gateChan < 0;
     }
   }
   else if (parameterIndex == 5) // threshold
@@ -137,12 +286,32 @@ void StimDetector::setParameter (int parameterIndex, float newValue)
       return;
     
     module.threshold = (double) newValue;
+    if (inBank)
+      bank.threshold[activeModule] = module.threshold;
     editor->updateParameterButtons (parameterIndex);
   }
   else if (parameterIndex == 6) // activeRow
   {
     module.activeRow = (int) newValue;
   }
+  else if (parameterIndex == 8) // preTriggerMs, applied in updateSettings/enable
+  {
+    module.preTriggerMs = jlimit(0.0, 100.0, (double) newValue);
+  }
+  else if (parameterIndex == 9) // templateMs, applied by the next learnTemplate
+  {
+    module.templateMs = jlimit(0.5, (double) maxTemplateMs, (double) newValue);
+  }
+  else if (parameterIndex == 10) // matchThreshold
+  {
+    module.matchThreshold = jlimit(0.01, 0.99, (double) newValue);
+    if (inBank)
+      bank.matchThreshold[activeModule] = module.matchThreshold;
+  }
+  else if (parameterIndex == 11) // diffChannel, applied in updateSettings
+  {
+    module.diffChannel = (bool) newValue;
+  }
 }
 
 //Usually, to be more ordered, we'd create the event channels overriding the createEventChannels() method.
@@ -189,17 +358,225 @@ void StimDetector::updateSettings()
   }
   eventChannelArray.add(ev);
   moduleEventChannels.add(ev);
+
+  prepareModule(modules.getReference(i));
+
+  // filters are designed for the input's sample rate
+  const Prefilter* prefilter = requestedPrefilters[i];
+  const bool wantsPrefilter = modules[i].prefilter.type != PrefilterSettings::none && modules[i].sampleRate > 0;
+  if (wantsPrefilter != (prefilter != nullptr) || (prefilter != nullptr && prefilter->getSampleRate() != modules[i].sampleRate))
+    updatePrefilter(i);
   }
   lastNumInputs = getNumInputs();
+
+  // derived diff channels after the inputs, one per input channel, so recorders keep the raw data
+  derivedChannels.clearQuick();
+  derivedChannels.insertMultiple(0, -1, getNumInputs());
+
+  for (int i = 0; i < modules.size(); i++)
+  {
+    const int inputChan = modules[i].inputChan;
+    const DataChannel* in = getDataChannel(inputChan);
+
+    if (!modules[i].diffChannel || in == nullptr || inputChan >= derivedChannels.size() || derivedChannels[inputChan] >= 0)
+      continue;
+
+    DataChannel* diff = new DataChannel(*in);
+    diff->setName(in->getName() + " diff");
+    diff->setDescription("Trigger diff of the stim detector on " + in->getName());
+    diff->setIdentifier("dataderived.stimdetector.diff");
+    derivedChannels.set(inputChan, dataChannelArray.size());
+    dataChannelArray.add(diff);
+  }
+
+  prepareBank();
 }
 
 bool StimDetector::enable()
 {
+  for (int i = 0; i < modules.size(); i++)
+    prepareModule(modules.getReference(i));
+
+  prepareBank();
+
+  triggerLatency.total.reset();
+  triggerLatency.inBuffer.reset();
+  triggerLatency.processing.reset();
+  droppedEvents.set(0);
+  droppedGateOnsets.set(0);
+
+  const DataChannel* firstChannel = getDataChannel(0);
+  budgetSampleRate = firstChannel ? firstChannel->getSampleRate() : 0;
+  budgetMeter.reset();
+
+  for (TemplateMatcher* matcher : templates)
+    matcher->reset();
+  for (Differentiator* differentiator : differentiators)
+    differentiator->reset();
+  for (Prefilter* prefilter : prefilters)
+    prefilter->reset();
+
+  pool = numThreads > 1 ? new WorkerPool(numThreads) : nullptr;
+  prepareScratch();
+
+  sweepQueue.prepare(bank.getWindowCapacity());
+
+  // new files per acquisition, in Documents/StimDetector
+  const File exportFolder = File::getSpecialLocation(File::userDocumentsDirectory).getChildFile("StimDetector");
+  const String startTime = Time::getCurrentTime().formatted("%Y-%m-%d_%H-%M-%S");
+  const File exportFile = exportFolder.getChildFile("stims_" + startTime + ".csv");
+
+  if (!paramsExport.start(exportFile))
+    CoreServices::sendStatusMessage("Stim Detector: could not write " + exportFile.getFullPathName());
+
+  archiveFile = File();
+  if (archiveEnabled)
+  {
+    const File file = exportFolder.getChildFile("sweeps_" + startTime + ".sda");
+
+    if (archive.open(file.getFullPathName().toStdString()))
+      archiveFile = file;
+    else
+      CoreServices::sendStatusMessage("Stim Detector: could not write " + file.getFullPathName());
+  }
+
+  analysisThread->startThread();
+
+  return true;
+}
+
+bool StimDetector::disable()
+{
+  analysisThread->stopThread(1000);
+  analysisThread->drain();
+  paramsExport.stop();
+  archive.close();
+
+  // templates replaced during the acquisition are no longer read
+  for (int i = templates.size(); --i >= 0;)
+  {
+    if (!requestedMatchers.contains(templates[i]))
+      templates.remove(i);
+  }
+  for (int i = differentiators.size(); --i >= 0;)
+  {
+    if (!requestedDifferentiators.contains(differentiators[i]))
+      differentiators.remove(i);
+  }
+  for (int i = prefilters.size(); --i >= 0;)
+  {
+    if (!requestedPrefilters.contains(prefilters[i]))
+      prefilters.remove(i);
+  }
+
+  pool = nullptr;
+
   return true;
 }
 
+// All module storage is sized here, outside of the audio thread; process() never allocates.
+void StimDetector::prepareModule(DetectorModule& module)
+{
+#if JUCE_DEBUG
+  jassert(!RealtimeStorageCheck::isActive());
+#endif
+
+  const DataChannel* in = getDataChannel(module.inputChan);
+
+  module.sampleRate = in ? in->getSampleRate() : 0;
+  module.avgLength = (int)ceil(module.sampleRate * 0.040); //total de pontos que precisamos para olharr o potencial na janela de 40 ms
+  module.ttlLength = (int)ceil(module.sampleRate * 0.005); //dura��o m�xima do TTL (timestamps para ignorar): 5 ms
+  module.movMean = (int)ceil(module.sampleRate * 0.005);   //MOVING MEAN WINDOW SIZE
+  module.preLength = (int)ceil(module.sampleRate * module.preTriggerMs / 1000);
+
+  if (module.stimMean.size() != module.preLength + module.avgLength)
+    module.stimMean.resize(module.preLength + module.avgLength);
+}
+
+void StimDetector::prepareBank()
+{
+#if JUCE_DEBUG
+  jassert(!RealtimeStorageCheck::isActive());
+#endif
+
+  // the history also dates triggers back by their delay; templates may be learned during acquisition
+  int maxLength = 0;
+  int maxHistory = 0;
+  for (int i = 0; i < modules.size(); i++)
+  {
+    const int maxTemplate = (int)ceil(modules[i].sampleRate * maxTemplateMs / 1000);
+    maxLength = jmax(maxLength, modules[i].preLength + modules[i].avgLength);
+    maxHistory = jmax(maxHistory, modules[i].preLength + jmax(maxTemplate - 1, (int)DifferentiatorSettings::maxLength / 2));
+  }
+
+  const int previousSize = bank.size();
+  bank.prepare(modules.size(), maxLength, maxHistory);
+
+  for (int i = 0; i < modules.size(); i++)
+  {
+    const DetectorModule& module = modules.getReference(i);
+    bank.threshold[i] = module.threshold;
+    bank.matchThreshold[i] = module.matchThreshold;
+    bank.matcher[i] = requestedMatchers[i];
+    bank.differentiator[i] = requestedDifferentiators[i];
+    bank.prefilter[i] = requestedPrefilters[i];
+    bank.outputChan[i] = module.outputChan;
+    bank.windowLength[i] = module.preLength + module.avgLength;
+    bank.preLength[i] = module.preLength;
+    bank.ttlLength[i] = module.ttlLength;
+
+    if (i >= previousSize)
+      bank.detectorStim[i] = module.gateChan < 0;
+  }
+
+  detectorOrder.ensureStorageAllocated(bank.size());
+  channelGroups.ensureStorageAllocated(bank.size() + 1);
+  groupDetectors();
+
+  while (groupEvents.size() < bank.size())
+    groupEvents.add(new TtlEventBuffer());
+}
+
+void StimDetector::prepareScratch()
+{
+  const int numParticipants = pool != nullptr ? pool->getNumThreads() : 1;
+
+  while (scratch.size() < numParticipants)
+    scratch.add(new DetectorEngine::Scratch());
+}
+
+// Groups the detectors by input channel, so each channel is read once per buffer.
+// Runs on the audio thread when an input changes, within the storage reserved by prepareBank
+void StimDetector::groupDetectors()
+{
+  detectorOrder.clearQuick();
+  for (int i = 0; i < bank.size(); i++)
+  {
+    const int inputChan = modules.getReference(i).inputChan;
+    if (inputChan < 0)
+      continue;
+
+    // insertion keeps detectors on the same channel in module order
+    int k = detectorOrder.size();
+    detectorOrder.add(i);
+    for (; k > 0 && modules.getReference(detectorOrder[k - 1]).inputChan > inputChan; k--)
+      detectorOrder.set(k, detectorOrder[k - 1]);
+    detectorOrder.set(k, i);
+  }
+
+  channelGroups.clearQuick();
+  for (int k = 0; k < detectorOrder.size(); k++)
+  {
+    if (k == 0 || modules[detectorOrder[k]].inputChan != modules[detectorOrder[k - 1]].inputChan)
+      channelGroups.add(k);
+  }
+  channelGroups.add(detectorOrder.size());
+}
+
 void StimDetector::handleEvent(const EventChannel* channelInfo, const MidiMessage& event, int sampleNum)
 {
+  SD_TRACE_SCOPE("handleEvent");
+
   // MOVED GATING TO PULSE PAL OUTPUT!
   // now use to randomize phase for next trial
 
@@ -207,163 +584,218 @@ void StimDetector::handleEvent(const EventChannel* channelInfo, const MidiMessag
 
   if (Event::getEventType(event) == EventChannel::TTL)
   {
+#if JUCE_DEBUG
+    const RealtimeStorageCheck::HostAllocation hostAllocation;
+#endif
     TTLEventPtr ttl = TTLEvent::deserializeFromMessage(event, channelInfo);
 
     // int eventNodeId = *(dataptr+1);
     const int eventId = ttl->getState() ? 1 : 0;
     const int eventChannel = ttl->getChannel();
 
-    for (int i = 0; i < modules.size(); ++i)
-    {
-      DetectorModule& module = modules.getReference(i);
+    // only the onset matters: it opens a window at its own sample, if none is open there
+    if (!eventId)
+      return;
 
-      if (module.gateChan == eventChannel && module.startIndex < 0) //gate receive TTL outside stim
-      {
-        if (eventId)
-        {
-          module.startStim = true;
-          module.detectorStim = false;
-        }
-        else {
-          module.startStim = false;
-        }
-      }
+    for (int i = 0; i < bank.size(); ++i)
+    {
+      if (modules.getReference(i).gateChan == eventChannel && !bank.addGateOnset(i, sampleNum, ttl->getTimestamp()))
+        ++droppedGateOnsets;
     }
   }
 }
 
 void StimDetector::process(AudioSampleBuffer& buffer)
 {
+#if JUCE_DEBUG
+  const RealtimeStorageCheck storageCheck(*this);
+#endif
+
+  const int64 arrivalTicks = Time::getHighResolutionTicks();
+
+  SD_TRACE_THREAD("audio");
+  SD_TRACE_SCOPE("process");
+
+  bank.clearGateOnsets();
   checkForEvents();
 
-  // loop through the modules
-  for (int m = 0; m < modules.size(); ++m)
+  if (groupsChanged.exchange(0) != 0)
+    groupDetectors();
+
+  // a template, differentiator or prefilter changed during acquisition; retried next buffer if the message thread holds the lock
+  if (triggersChanged.get() != 0)
   {
-    DetectorModule& module = modules.getReference(m);
+    const SpinLock::ScopedTryLockType lock(triggerLock);
+    if (lock.isLocked())
+    {
+      triggersChanged.set(0);
+      for (int i = 0; i < bank.size(); ++i)
+      {
+        bank.matcher[i] = requestedMatchers[i];
+        bank.differentiator[i] = requestedDifferentiators[i];
+        bank.prefilter[i] = requestedPrefilters[i];
+      }
+
+      for (int module : pendingCountResets)
+        if (module < bank.size())
+          bank.count[module] = 0;
+      pendingCountResets.clearQuick();
+    }
+  }
+
+  const int numGroups = channelGroups.size() - 1;
 
-    avgLength = (int)ceil(getDataChannel(module.inputChan)->getSampleRate() * 0.040); //total de pontos que precisamos para olharr o potencial na janela de 40 ms
-    ttlLength = (int)ceil(getDataChannel(module.inputChan)->getSampleRate() * 0.005); //dura��o m�xima do TTL (timestamps para ignorar): 5 ms
-    movMean = (int)ceil(getDataChannel(module.inputChan)->getSampleRate() * 0.005); //MOVING MEAN WINDOW SIZE 
-    //buffetMin = ceil(getDataChannel(module.inputChan)->getSampleRate() / 1024); //Quantos buffers precisamos por segundo de registro (na frente multiplicamos pelo tamanho da janela de 40 ms)
+  // channel groups share no state, so they can run on the pool in any order
+  if (pool != nullptr && numGroups >= minParallelGroups)
+  {
+    groupJob.buffer = &buffer;
+    pool->run(groupJob, numGroups);
+  }
+  else
+  {
+    for (int g = 0; g < numGroups; ++g)
+      processChannelGroup(g, *scratch[0], buffer);
+  }
 
-    //std::cout << "AVG_LENGTH " << avgLength << std::endl;
-    //std::cout << "TTL_LENGTH " << ttlLength << std::endl;
-    //std::cout << "MOV_MEAN "   << movMean << std::endl;
+  const double processingSeconds = Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - arrivalTicks);
 
-    module.timestamps.resize(avgLength);
-    module.stim.resize(avgLength);
-    module.avg.resize(avgLength);
-    module.stimMean.resize(avgLength);
+  // events are added in group order, the same on both paths
+  for (int g = 0; g < numGroups; ++g)
+  {
+    TtlEventBuffer& events = *groupEvents[g];
 
+    if (events.getNumDropped() > 0)
+    {
+      droppedEvents += (int64) events.getNumDropped();
+      events.resetNumDropped();
+    }
 
-    // check to see if it's active and has a channel
-    if (module.outputChan >= 0
-      && module.inputChan >= 0
-      && module.inputChan < buffer.getNumChannels())
+    for (const TtlEvent& pending : events)
     {
-      int bufferLength = getNumSamples(module.inputChan);
-      for (int i = 0; i < bufferLength; ++i)
-      {
-        const float sample = *buffer.getReadPointer(module.inputChan, i);
-        const float diffSample = abs(sample - module.lastSample);
+#if JUCE_DEBUG
+      const RealtimeStorageCheck::HostAllocation hostAllocation;
+#endif
+      if (pending.ttlData != 0)
+        recordTriggerLatency(pending, processingSeconds);
+
+      TTLEventPtr event = TTLEvent::createTTLEvent(moduleEventChannels[pending.detector], pending.timestamp, &pending.ttlData, sizeof(uint8), pending.channel);
+      addEvent(moduleEventChannels[pending.detector], event, pending.sampleNum);
+    }
 
-        module.ignoreFirst = (getTimestamp(module.inputChan) == 0 && i == 0);
+    events.clear();
+  }
 
-        if (module.applyDiff)
-        {
-          *buffer.getWritePointer(module.inputChan, i) = diffSample;
-        }
+  if (budgetSampleRate > 0 && buffer.getNumChannels() > 0)
+  {
+    const double budget = getNumSamples(0) / budgetSampleRate;
+    budgetMeter.add(Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - arrivalTicks), budget);
+  }
+}
 
-        if (module.detectorStim)                // Gate disableded
-        {
-          if (diffSample > module.lastDiff      //variacao brusca
-          && diffSample > module.threshold      //acima do limiar
-          && diffSample < 5 * module.threshold  //ignorar valores muito maiores do limiar
-          && !module.startStim                  //fora do TTL
-          && !module.ignoreFirst)               //nao e o primeiro
-          {
-            //start TTL
-            uint8 ttlData = 1 << module.outputChan;
-            TTLEventPtr event = TTLEvent::createTTLEvent(moduleEventChannels[m], getTimestamp(module.inputChan) + i, &ttlData, sizeof(uint8), module.outputChan);
-            addEvent(moduleEventChannels[m], event, i);
-            module.samplesSinceTrigger = 0;
-            module.wasTriggered = true;
-            //module.wasTriggered_buffer = true;
-            module.startStim = true;
-
-            //config avg
-            module.startIndex = i;
-            module.windowIndex = 0;
-            module.count++;
-          }
-
-          //durante TTL
-          if (module.wasTriggered)
-          {
-          //finalizacao do TTL
-            if (module.samplesSinceTrigger > ttlLength)
-            {
-              uint8 ttlData = 0;
-              TTLEventPtr event = TTLEvent::createTTLEvent(moduleEventChannels[m], getTimestamp(module.inputChan) + i, &ttlData, sizeof(uint8), module.outputChan);
-              addEvent(moduleEventChannels[m], event, i);
-              module.wasTriggered = false;
-            }
-            else
-            {
-              module.samplesSinceTrigger++;
-            }
-          }
-        } // end gate disableded
-
-        /* TTL gate enableded */
-        if (!module.detectorStim && module.startStim) //gate receive TTL
-        {
-          module.startIndex = i;
-          module.windowIndex = 0;
-          module.count++;
-          module.startStim = false;
-          //module.wasTriggered_buffer = true;
-        }
+// The stim sample waits for the end of its buffer, then for the processing of the whole buffer
+void StimDetector::recordTriggerLatency(const TtlEvent& event, double processingSeconds)
+{
+  const DetectorModule& module = modules.getReference(event.detector);
 
-        // inside window
-        if (module.startIndex >= 0 && module.windowIndex < avgLength)
-        {
-          module.stim.set(module.windowIndex, sample/(0.1950*1000));
-          module.timestamps.set(module.windowIndex, getTimestamp(module.inputChan) + i); ///conferir
-
-          // std::cout << module.avg[module.windowIndex] << "*" << module.count - 1 << "+" << sample << "/" << module.count << std::endl;
-          module.avg.set(module.windowIndex, (module.avg[module.windowIndex] * ((double)module.count - 1) + sample) / (double)(module.count));
-        
-          //output
-          //*buffer.getWritePointer(module.inputChan, i) = module.avg[module.windowIndex];
-          //if(module.windowIndex == AVG_LENGTH - 1) // last window loop
-          //{
-          //  std::cout << std::endl;
-          //} 
-
-          module.windowIndex++;
-        }
-        else { //avgLength ended
-          
-          if (module.startStim)
-          {
-            updateWaveformParams();
-            updateActiveAvgLineParams();
-            //std::cout << module.xMin << ", " << module.yMin << ", " << module.xMax << ", " << module.yMax << ", " << (((module.yMax - module.yMin) / abs(module.xMax - module.xMin))) << ", " << (module.xMin - module.timestamps[1] + ttlLength) / (getDataChannel(module.inputChan)->getSampleRate()) * 1000 << std::endl;
-          }
-
-          // disabled references
-          module.startIndex = -1;
-          module.windowIndex = -1;
-          module.startStim = false;
-          module.wasTriggered_buffer = false;
-        }
+  if (module.sampleRate <= 0)
+    return;
 
-        module.lastSample = sample;
-        module.lastDiff = diffSample;
-      }
-    }
+  // from the input sample that set it off, which a differentiator delay puts before sampleNum
+  const int64 bufferEnd = getTimestamp(module.inputChan) + getNumSamples(module.inputChan) - 1;
+  const int waiting = (int) jmax((int64) 0, bufferEnd - event.timestamp);
+  const double inBufferSeconds = waiting / module.sampleRate;
+
+  triggerLatency.inBuffer.add((uint64) (inBufferSeconds * 1e9));
+  triggerLatency.processing.add((uint64) (processingSeconds * 1e9));
+  triggerLatency.total.add((uint64) ((inBufferSeconds + processingSeconds) * 1e9));
+}
+
+bool StimDetector::saveTriggerLatency(const File& file) const
+{
+  const LatencyHistogram* histograms[] = { &triggerLatency.total, &triggerLatency.inBuffer, &triggerLatency.processing };
+  const char* names[] = { "total", "in_buffer", "processing" };
+
+  String csv = "latency,count,p50_us,p99_us,max_us\n";
+  for (int h = 0; h < 3; ++h)
+  {
+    csv << names[h] << "," << (int64) histograms[h]->getCount()
+      << "," << histograms[h]->getPercentile(0.50) / 1000.0
+      << "," << histograms[h]->getPercentile(0.99) / 1000.0
+      << "," << histograms[h]->getMax() / 1000.0 << "\n";
   }
+
+  csv << "\nbin_start_ns,bin_end_ns,total,in_buffer,processing\n";
+  for (int bin = 0; bin < LatencyHistogram::numBins; ++bin)
+  {
+    const uint64 counts[] = { histograms[0]->getBinCount(bin), histograms[1]->getBinCount(bin), histograms[2]->getBinCount(bin) };
+
+    if (counts[0] + counts[1] + counts[2] == 0)
+      continue;
+
+    csv << (int64) LatencyHistogram::getBinStart(bin) << ","
+      << (bin + 1 < LatencyHistogram::numBins ? (int64) LatencyHistogram::getBinStart(bin + 1) : (int64) -1) << ","
+      << (int64) counts[0] << "," << (int64) counts[1] << "," << (int64) counts[2] << "\n";
+  }
+
+  return file.replaceWithText(csv);
+}
+
+bool StimDetector::saveBudget(const File& file) const
+{
+  const BudgetMeter::Stats stats = budgetMeter.getRecentStats();
+
+  String csv = "callbacks,overruns,overrun_fraction,recent,mean_load,max_load\n";
+  csv << (int64) budgetMeter.getNumCallbacks() << "," << (int64) budgetMeter.getNumOverruns()
+    << "," << budgetMeter.getOverrunFraction() << "," << stats.numCallbacks
+    << "," << stats.meanLoad << "," << stats.maxLoad << "\n";
+
+  // oldest first
+  csv << "\ncallback,elapsed_us,budget_us,load\n";
+  const int64 last = (int64) budgetMeter.getNumCallbacks() - 1;
+  for (int i = stats.numCallbacks - 1; i >= 0; --i)
+  {
+    double elapsed, budget;
+    budgetMeter.getCallback(i, elapsed, budget);
+    csv << (last - i) << "," << elapsed * 1e6 << "," << budget * 1e6 << "," << (budget > 0 ? elapsed / budget : 0.0) << "\n";
+  }
+
+  return file.replaceWithText(csv);
+}
+
+// The buffer side of a channel group; detection itself runs in the engine
+void StimDetector::processChannelGroup(int g, DetectorEngine::Scratch& groupScratch, AudioSampleBuffer& buffer)
+{
+#if JUCE_DEBUG
+  const RealtimeStorageCheck::Scope realtime; // on a pool worker too
+#endif
+  SD_TRACE_SCOPE("channelGroup");
+
+  const int first = channelGroups[g];
+  const int last = channelGroups[g + 1];
+  const int inputChan = modules.getReference(detectorOrder[first]).inputChan;
+
+  if (inputChan < 0 || inputChan >= buffer.getNumChannels())
+    return;
+
+  bool applyDiff = false;
+  for (int k = first; k < last; ++k)
+  {
+    const DetectorModule& module = modules.getReference(detectorOrder[k]);
+    applyDiff = applyDiff || (module.outputChan >= 0 && module.applyDiff);
+  }
+
+  // the derived channel is filled by the engine's kernels; applyDiff then copies it over the input
+  const int derived = inputChan < derivedChannels.size() ? derivedChannels[inputChan] : -1;
+  const bool haveDerived = derived >= 0 && derived < buffer.getNumChannels();
+  const int numSamples = getNumSamples(inputChan);
+
+  engine.processChannel(detectorOrder.begin() + first, last - first,
+    buffer.getReadPointer(inputChan), numSamples, getTimestamp(inputChan),
+    groupScratch, *groupEvents[g], *this,
+    haveDerived ? buffer.getWritePointer(derived) : applyDiff ? buffer.getWritePointer(inputChan) : nullptr);
+
+  if (haveDerived && applyDiff)
+    FloatVectorOperations::copy(buffer.getWritePointer(inputChan), buffer.getReadPointer(derived), numSamples);
 }
 
 
@@ -399,7 +831,8 @@ void StimDetector::process(AudioSampleBuffer& buffer)
 
 void StimDetector::splitAvgArray()
 {
-  //ScopedLock resetLock(onlineReset);
+  SD_TRACE_SCOPE("splitAvgArray");
+  const ScopedLock resetLock(onlineReset);
   //alocar uma nova linha na matriz
   DetectorModule& m = modules.getReference(activeModule);
   
@@ -407,28 +840,32 @@ void StimDetector::splitAvgArray()
   m.yAvgMax.add(0.0f);
   m.avgSlope.add(0.0f);
   m.avgLatency.add(0.0f);
+  m.avgCount.add(0);
+  m.rowStats.add(SweepStatistics());
 
-  m.matrix.resize(m.activeRow + 2);
-  m.matrix[m.activeRow + 1].resize(m.matrix[0].size());
-
-  m.count = 0;
+  m.sweepCount = 0;
   m.activeRow++;
+
+  requestCountReset(activeModule);
+
+  publishResults();
 }
 
 void StimDetector::clearAgvArray()
 {
-  //ScopedLock resetLock(onlineReset);
+  SD_TRACE_SCOPE("clearAgvArray");
+  const ScopedLock resetLock(onlineReset);
 
   DetectorModule& m = modules.getReference(activeModule);
-  m.matrix.resize(1);
-  m.matrix[0].clear();
-  m.matrix[0].resize(avgLength);
   m.activeRow = 0;
 
-  m.count = 0;
+  m.sweepCount = 0;
+  m.numGated = 0;
+  m.numAligned = 0;
+  m.gateAlignment = 0;
+  m.maxGateAlignment = 0;
 
-  m.avg.clear();
-  m.avg.resize(avgLength);
+  requestCountReset(activeModule);
 
   m.yAvgMin.clear();
   m.yAvgMin.add(0.0f);
@@ -442,76 +879,235 @@ void StimDetector::clearAgvArray()
   m.avgLatency.clear();
   m.avgLatency.add(0.0f);
 
+  m.avgCount.clear();
+  m.avgCount.add(0);
+
+  m.rowStats.clear();
+  m.rowStats.add(SweepStatistics());
+
+  publishResults();
 }
 
-void StimDetector::updateWaveformParams()
+// Audio thread: a bounded copy of the closed window into a preallocated slot
+void StimDetector::windowClosed(int m)
 {
-  for (int m = 0; m < modules.size(); ++m)
-  {
-    DetectorModule& dm = modules.getReference(m);
+  SD_TRACE_SCOPE("windowClosed");
+
+  const DetectorModule& module = modules.getReference(m);
+  const SpinLock::ScopedLockType lock(sweepLock);
+  SweepQueue::Sweep* sweep = sweepQueue.beginWrite();
+
+  if (sweep == nullptr) // analysis is behind, drop this sweep
+    return;
+
+  sweep->module = m;
+  sweep->count = bank.count[m];
+  sweep->activeRow = module.activeRow;
+  sweep->preLength = bank.preLength[m];
+  sweep->gated = bank.gatedWindow[m] != 0;
+  sweep->gateAligned = bank.gatedWindow[m] != 0 && bank.gateAligned[m] != 0;
+  sweep->gateError = bank.gateError[m];
+  sweep->startTimestamp = bank.windowStart[m];
+  sweep->length = jmin(bank.windowLength[m], sweepQueue.getMaxLength());
+  memcpy(sweep->stim, bank.getStim(m), sizeof(double) * sweep->length);
+
+  sweepQueue.finishWrite();
+}
 
-    dm.stimMean = dm.stim; //Array
-    dm.xMin = 0;
-    dm.yMin = 0;
-    int tMin = 0;
+// Analysis thread
+void StimDetector::analyseSweep(const SweepQueue::Sweep& sweep)
+{
+  if (sweep.module >= modules.size())
+    return;
 
-    //suavisar a curva
-    for (int t = movMean; t < (avgLength - movMean); t++)
-    {
-      double aux_mean = 0;
-      for (int tt = -(movMean / 2); tt < ((movMean / 2)); tt++)
-      {
-        aux_mean = aux_mean + dm.stim[(t + tt)];
-        //std::cout << (tt) << std::endl;
-      }
+  const ScopedLock resetLock(onlineReset);
 
-      dm.stimMean.set(t, (aux_mean / (movMean)));
-      //std::cout << dm.stimMean[t] << std::endl;
-    }
+  updateWaveformParams(sweep);
+  updateActiveAvgLineParams(sweep);
+  updateGateAlignment(sweep);
+  exportSweep(sweep);
+  archiveSweep(sweep);
+  publishResults();
+}
+
+void StimDetector::updateWaveformParams(const SweepQueue::Sweep& sweep)
+{
+  SD_TRACE_SCOPE("updateWaveformParams");
 
-    //std::cout << dm.stimMean << ", " << dm.stim[tMin - 2] << ", " << dm.stim[tMin - 1] << std::endl;
+  DetectorModule& dm = modules.getReference(sweep.module);
 
-    //MIN
-    for (int t = 0; t < avgLength; t++)
-    {
-      if (dm.stimMean[t] < dm.yMin && t >= ttlLength)
-      {
-        dm.xMin = dm.timestamps[t];
-        dm.yMin = dm.stim[t];
-        tMin = t; //ref
-      }
-    }
-    //std::cout << dm.yMin << ", " << dm.xMin << std::endl;
+  const int length = jmin(sweep.length, dm.stimMean.size());
 
+  extractWaveformFeatures(sweep.stim, sweep.startTimestamp, length, sweep.preLength, dm.ttlLength, dm.movMean,
+    dm.stimMean.getRawDataPointer(), dm.features);
+  dm.sweepCount = sweep.count;
+}
 
-    //MAX
-    dm.xMax = dm.xMin;
-    dm.yMax = dm.yMin;
-    for (int tMax = tMin; dm.stimMean[tMax - 1] > dm.stimMean[tMax]; tMax--)
-    {
-      dm.xMax = dm.timestamps[tMax];
-      dm.yMax = dm.stim[tMax];
-      // std::cout << yMax << ", " << dm.stim[yMax - 1] << ", " << dm.stim[yMax] << std::endl;
-    }
-    //std::cout << yMax << ", " << dm.stim[yMax - 2] << ", " << dm.stim[yMax - 1] << std::endl;
+// How far the stim the detector sees landed from the gate timestamp
+void StimDetector::updateGateAlignment(const SweepQueue::Sweep& sweep)
+{
+  DetectorModule& dm = modules.getReference(sweep.module);
+
+  if (!sweep.gated || dm.sampleRate <= 0)
+    return;
+
+  dm.numGated++;
+  if (!sweep.gateAligned)
+    return;
+
+  dm.numAligned++;
+  dm.gateAlignment = (double)sweep.gateError / dm.sampleRate * 1000;
+  dm.maxGateAlignment = jmax(dm.maxGateAlignment, std::abs(dm.gateAlignment));
+}
+
+// Analysis thread: queued for the export writer, no I/O here
+void StimDetector::exportSweep(const SweepQueue::Sweep& sweep)
+{
+  if (!paramsExport.isRunning())
+    return;
+
+  const DetectorModule& dm = modules.getReference(sweep.module);
+
+  ParamsExport::Record record;
+  record.module = sweep.module;
+  record.row = sweep.activeRow;
+  record.count = sweep.count;
+  record.gated = sweep.gated;
+  record.timestamp = dm.features.sweepStart;
+  computeWaveformParams(dm.features, dm.sweepCount, dm.ttlLength, dm.sampleRate, record.params);
+
+  paramsExport.push(record);
+}
+
+// Analysis thread: a copy into the mapped file, the OS writes it back
+void StimDetector::archiveSweep(const SweepQueue::Sweep& sweep)
+{
+  if (!archive.isOpen() || sweep.length <= 0)
+    return;
+
+  SweepInfo info;
+  info.startTimestamp = sweep.startTimestamp;
+  info.sampleRate = modules.getReference(sweep.module).sampleRate;
+  info.module = sweep.module;
+  info.row = sweep.activeRow;
+  info.count = sweep.count;
+  info.length = sweep.length;
+  info.preLength = sweep.preLength;
+  info.flags = sweep.gated ? gatedFlag : 0;
+
+  if (!archive.append(info, sweep.stim))
+    archive.close(); // out of disk space: keep what was written
+}
+
+void StimDetector::updateActiveAvgLineParams(const SweepQueue::Sweep& sweep)
+{
+  SD_TRACE_SCOPE("updateActiveAvgLineParams");
+
+  DetectorModule& dm = modules.getReference(sweep.module);
+  const int count = sweep.count;
+  const int row = sweep.activeRow;
+
+  double last[NUM_WAVEFORM_PARAMS];
+  computeWaveformParams(dm.features, dm.sweepCount, dm.ttlLength, dm.sampleRate, last);
+
+  if(count > 0 && row < dm.yAvgMin.size()) { //row may be gone after a clear
+    dm.avgCount.set(row, count);
+    dm.yAvgMin.set(row, updateRunningMean(dm.yAvgMin[row], last[0], count));
+    dm.yAvgMax.set(row, updateRunningMean(dm.yAvgMax[row], last[1], count));
+
+    dm.avgLatency.set(row, updateRunningMean(dm.avgLatency[row], last[3], count));
+    dm.avgSlope.set(row, updateRunningMean(dm.avgSlope[row], last[4], count));
+
+    SweepStatistics& stats = dm.rowStats.getReference(row);
+    if (count == 1) // first sweep since a split or clear
+      stats.reset();
+    stats.add(sweep.stim, sweep.length);
   }
 }
 
-void StimDetector::updateActiveAvgLineParams()
+bool StimDetector::learnTemplate(int module)
 {
-  for (int m = 0; m < modules.size(); ++m)
+  const ScopedLock resetLock(onlineReset);
+
+  DetectorModule& m = modules.getReference(module);
+  const SweepStatistics& stats = m.rowStats.getReference(m.activeRow);
+  const int length = (int)ceil(m.sampleRate * m.templateMs / 1000);
+
+  if (stats.getCount() == 0 || length < 2 || stats.getLength() < m.preLength + length)
+    return false;
+
+  // the response from the trigger on, as the window captured it
+  HeapBlock<float> shape(length);
+  for (int i = 0; i < length; i++)
+    shape[i] = (float) stats.getMean()[m.preLength + i];
+
+  TemplateMatcher* matcher = templates.add(new TemplateMatcher(shape, length, Kernels::blockSize));
   {
-    Array<double> last = getLastWaveformParams(m);
-    DetectorModule& dm = modules.getReference(m);
+    const SpinLock::ScopedLockType lock(triggerLock);
+    requestedMatchers.set(module, matcher);
+  }
+  triggersChanged.set(1);
 
-    if(dm.count > 0) {
-      dm.yAvgMin.set(dm.activeRow, (dm.yAvgMin[dm.activeRow] * ((double)dm.count - 1) + last[0]) / (double)(dm.count));
-      dm.yAvgMax.set(dm.activeRow, (dm.yAvgMax[dm.activeRow] * ((double)dm.count - 1) + last[1]) / (double)(dm.count));
+  m.usesTemplate = true;
+  return true;
+}
 
-      dm.avgLatency.set(dm.activeRow, (dm.avgLatency[dm.activeRow] * ((double)dm.count - 1) + last[3]) / (double)(dm.count));
-      dm.avgSlope.set(dm.activeRow, (dm.avgSlope[dm.activeRow] * ((double)dm.count - 1) + last[4]) / (double)(dm.count));
-    }
+void StimDetector::clearTemplate(int module)
+{
+  {
+    const SpinLock::ScopedLockType lock(triggerLock);
+    requestedMatchers.set(module, nullptr);
+  }
+  triggersChanged.set(1);
+
+  modules.getReference(module).usesTemplate = false;
+}
+
+void StimDetector::setDifferentiator(int module, const DifferentiatorSettings& settings)
+{
+  // the first difference stays on the shared diff of the input channel
+  Differentiator* differentiator = nullptr;
+  if (settings.type != DifferentiatorSettings::firstDifference)
+    differentiator = differentiators.add(new Differentiator(settings, Kernels::blockSize));
+
+  {
+    const SpinLock::ScopedLockType lock(triggerLock);
+    requestedDifferentiators.set(module, differentiator);
   }
+  triggersChanged.set(1);
+
+  modules.getReference(module).differentiator = settings;
+}
+
+void StimDetector::requestCountReset(int module)
+{
+  // the audio thread owns bank.count; it takes the reset before its next buffer
+  {
+    const SpinLock::ScopedLockType lock(triggerLock);
+    pendingCountResets.addIfNotAlreadyThere(module);
+  }
+  triggersChanged.set(1);
+}
+
+void StimDetector::setPrefilter(int module, const PrefilterSettings& settings)
+{
+  modules.getReference(module).prefilter = settings;
+  updatePrefilter(module);
+}
+
+void StimDetector::updatePrefilter(int module)
+{
+  // without an input rate the filter waits for updateSettings
+  const DetectorModule& m = modules.getReference(module);
+  Prefilter* prefilter = nullptr;
+  if (m.prefilter.type != PrefilterSettings::none && m.sampleRate > 0)
+    prefilter = prefilters.add(new Prefilter(m.prefilter, m.sampleRate));
+
+  {
+    const SpinLock::ScopedLockType lock(triggerLock);
+    requestedPrefilters.set(module, prefilter);
+  }
+  triggersChanged.set(1);
 }
 
 int StimDetector::getActiveModule() {
@@ -524,44 +1120,101 @@ double StimDetector::getThresholdValueForActiveModule()
   return module.threshold;
 }
 
-Array<double> StimDetector::getLastWaveformParams(int module=-1)
+// onlineReset must be held
+void StimDetector::publishResults()
 {
-  DetectorModule& dm = modules.getReference(module==-1 ? activeModule : module);
+  ResultSnapshot& snapshot = results.getWriteBuffer();
+  snapshot.version = ++resultVersion;
+  snapshot.modules.resize(modules.size());
+
+  for (int m = 0; m < modules.size(); ++m)
+  {
+    const DetectorModule& dm = modules.getReference(m);
+    ModuleResults& r = snapshot.modules.getReference(m);
+
+    computeWaveformParams(dm.features, dm.sweepCount, dm.ttlLength, dm.sampleRate, r.last);
+
+    r.numGated = dm.numGated;
+    r.numAligned = dm.numAligned;
+    r.gateAlignment = dm.gateAlignment;
+    r.maxGateAlignment = dm.maxGateAlignment;
+
+    r.numRows = dm.activeRow + 1;
+    r.avgTable.resize(r.numRows * NUM_WAVEFORM_PARAMS);
+    double* row = r.avgTable.getRawDataPointer();
+
+    for (int i = 0; i < r.numRows; i++, row += NUM_WAVEFORM_PARAMS)
+    {
+      row[0] = dm.yAvgMin[i];                   //MIN
+      row[1] = dm.yAvgMax[i];                   //MAX
+      row[2] = dm.yAvgMax[i] - dm.yAvgMin[i];   //PEAK TO PEAK
+      row[3] = dm.avgLatency[i];                //LATENCY
+      row[4] = dm.avgSlope[i];                  //SLOPE
+      row[5] = dm.avgCount[i];                  //AVG COUNT
+    }
 
-  double slope = dm.xMax - dm.xMin == 0 ? 0
-    : ((dm.yMax - dm.yMin) / ((dm.xMax - dm.xMin) / (double)(getDataChannel(dm.inputChan)->getSampleRate()) ));
+    // mean sweeps and SEM bands of the canvas, only for the detector on screen
+    r.sweepLength = 0;
+    r.preLength = dm.preLength;
+    r.sampleRate = dm.sampleRate;
 
-  double latency = dm.count == 0 ? 0
-    : (double)(ttlLength + dm.xMin - dm.timestamps[0]) / (double)(getDataChannel(dm.inputChan)->getSampleRate()) * 1000;
+    if (m == activeModule)
+    {
+      for (int i = 0; i < r.numRows; i++)
+        r.sweepLength = jmax(r.sweepLength, dm.rowStats.getReference(i).getLength());
+
+      r.rowMean.resize(r.numRows * r.sweepLength);
+      r.rowSem.resize(r.numRows * r.sweepLength);
 
-  Array<double> moduleParams;
-  moduleParams.add(dm.yMin);              //MIN
-  moduleParams.add(dm.yMax);              //MAX
-  moduleParams.add(dm.yMax - dm.yMin);    //PEAK TO PEAK
-  moduleParams.add(latency);              //LATENCY
-  moduleParams.add(slope);                //SLOPE
-  moduleParams.add(dm.count);             //AVG COUNT
+      for (int i = 0; i < r.numRows; i++)
+      {
+        const SweepStatistics& stats = dm.rowStats.getReference(i);
+        double* mean = r.rowMean.getRawDataPointer() + i * r.sweepLength;
+        double* sem = r.rowSem.getRawDataPointer() + i * r.sweepLength;
+
+        for (int w = 0; w < r.sweepLength; w++)
+        {
+          const bool valid = w < stats.getLength();
+          mean[w] = valid ? stats.getMean()[w] : 0.0;
+          sem[w] = valid ? stats.getSem(w) : 0.0;
+        }
+      }
+    }
+  }
 
-  return moduleParams;
+  results.publish();
 }
 
-Array<Array<double>> StimDetector::getAvgMatrixParams()
+const StimDetector::ResultSnapshot& StimDetector::getResultSnapshot()
 {
-  DetectorModule& dm = modules.getReference(activeModule);
+  results.update();
+  return results.getReadBuffer();
+}
 
-  for (int r = 0; r <= dm.activeRow; r++)
-  {
+// ===================================================================
 
-    Array<double> rowParams;
-    rowParams.add(dm.yAvgMin[r]);                   //MIN
-    rowParams.add(dm.yAvgMax[r]);                   //MAX
-    rowParams.add(dm.yAvgMax[r] - dm.yAvgMin[r]);   //PEAK TO PEAK
-    rowParams.add(dm.avgLatency[r]);               //LATENCY
-    rowParams.add(dm.avgSlope[r]);                 //SLOPE
-    rowParams.add(dm.count);                        //AVG COUNT
+StimDetector::AnalysisThread::AnalysisThread(StimDetector& p)
+  : Thread("Stim Detector analysis")
+  , processor(p)
+{
+}
+
+void StimDetector::AnalysisThread::run()
+{
+  SD_TRACE_THREAD("analysis");
 
-    dm.matrix.set(dm.activeRow,rowParams);          //row of table
+  while (!threadShouldExit())
+  {
+    drain();
+    wait(2);
   }
+}
 
-  return dm.matrix;
+void StimDetector::AnalysisThread::drain()
+{
+  while (const SweepQueue::Sweep* sweep = processor.sweepQueue.beginRead())
+  {
+    processor.analyseSweep(*sweep);
+    processor.sweepQueue.finishRead();
+  }
 }
@@ -30,6 +30,20 @@
 #endif
 
 #include <ProcessorHeaders.h>
+#include "SweepArchive.h"
+#include "SweepQueue.h"
+#include "TripleBuffer.h"
+#include "BudgetMeter.h"
+#include "DetectorEngine.h"
+#include "Differentiator.h"
+#include "LatencyHistogram.h"
+#include "ParamsExport.h"
+#include "Prefilter.h"
+#include "SweepStatistics.h"
+#include "TemplateMatcher.h"
+#include "TraceRecorder.h"
+#include "WaveformFeatures.h"
+#include "WorkerPool.h"
 
 //#define AVG_LENGTH 487
 //#define TTL_LENGTH 10
@@ -42,7 +56,8 @@ namespace StimDetectorSpace {
 
     @see GenericProcessor, StimDetectorEditor
   */
-  class StimDetector : public GenericProcessor
+  class StimDetector : public GenericProcessor,
+                       private WindowSink
   {
   public:
     StimDetector();
@@ -56,6 +71,7 @@ namespace StimDetectorSpace {
     void setParameter (int parameterIndex, float newValue) override;
     void updateSettings() override;
     bool enable() override;
+    bool disable() override;
     void process (AudioSampleBuffer& buffer) override;
 
     void splitAvgArray();
@@ -63,10 +79,98 @@ namespace StimDetectorSpace {
     
     int getActiveModule();
     double getThresholdValueForActiveModule();
-    Array<double> getLastWaveformParams(int module); //paramIndex
-    Array<Array<double>> getAvgMatrixParams(); //AvgSection.paramIndex
+    int getNumThreads() const { return numThreads; }
 
-    
+    /** Params of one detector, laid out as the rows of the canvas table. */
+    struct ModuleResults
+    {
+      double last[NUM_WAVEFORM_PARAMS]; //last stim
+      Array<double> avgTable;           //NUM_WAVEFORM_PARAMS values per avg row
+      int numRows;                      //avg rows
+
+      int sweepLength;                  //samples of each row's mean sweep, 0 when not published
+      int preLength;                    //pre-trigger samples at the start of a sweep
+      double sampleRate;
+      Array<double> rowMean;            //active detector only: sweepLength mean values per avg row
+      Array<double> rowSem;             //and their standard error of the mean
+
+      int numGated;                     //windows started by the gate
+      int numAligned;                   //of those, windows with a trigger candidate to measure the gate against
+      double gateAlignment;             //first candidate minus gate time of the last one (ms)
+      double maxGateAlignment;          //largest absolute alignment error (ms)
+    };
+
+    /** Immutable copy of every module's results, published after each analysed stim. */
+    struct ResultSnapshot
+    {
+      ResultSnapshot() : version(0) {}
+
+      uint32 version;                   //changes on every publish
+      Array<ModuleResults> modules;
+    };
+
+    /** Message thread only: picks up the latest published results without locking or
+        copying. The reference stays valid until the next call. */
+    const ResultSnapshot& getResultSnapshot();
+
+    /** Stim sample to TTL latencies since acquisition started, in ns. */
+    struct TriggerLatency
+    {
+      LatencyHistogram total;           //stim sample to addEvent()
+      LatencyHistogram inBuffer;        //stim sample to the end of its buffer
+      LatencyHistogram processing;      //buffer arrival to addEvent()
+    };
+
+    const TriggerLatency& getTriggerLatency() const { return triggerLatency; }
+
+    /** Writes the latency percentiles and histograms as CSV; false if the file cannot be written. */
+    bool saveTriggerLatency (const File& file) const;
+
+    /** Wall time of each process() call against its buffer duration. */
+    const BudgetMeter& getBudgetMeter() const { return budgetMeter; }
+    int64 getNumDroppedEvents() const { return droppedEvents.get(); }
+    int64 getNumDroppedGateOnsets() const { return droppedGateOnsets.get(); }
+    void setOverrunFraction (double fraction) { budgetMeter.setOverrunFraction(fraction); }
+
+    /** Writes the budget counters and the recent callbacks as CSV; false if the file cannot be written. */
+    bool saveBudget (const File& file) const;
+
+    /** Per-stim params of the current acquisition, streamed to a CSV file. */
+    const ParamsExport& getParamsExport() const { return paramsExport; }
+
+    /** Archives every raw sweep of the next acquisitions to a memory-mapped file. */
+    void setArchiveEnabled (bool enabled) { archiveEnabled = enabled; }
+    bool isArchiveEnabled() const { return archiveEnabled; }
+
+    /** Message thread: the archive of the current acquisition, if any. */
+    const File& getArchiveFile() const { return archiveFile; }
+
+    /** Message thread: module triggers on the correlation of its input with the first
+        templateMs of its active avg row's mean sweep, instead of the diff threshold.
+        False if that row has no sweeps yet. The TTL fires at the end of the match and is
+        dated back to its start, as the window is. */
+    bool learnTemplate (int module);
+
+    enum { maxTemplateMs = 40 };      //longest template, sizes the history that dates matches back
+
+    /** Message thread: module goes back to the diff threshold. */
+    void clearTemplate (int module);
+
+    bool hasTemplate (int module) const           { return modules.getReference(module).usesTemplate; }
+    double getMatchThreshold (int module) const   { return modules.getReference(module).matchThreshold; }
+    double getTemplateMs (int module) const       { return modules.getReference(module).templateMs; }
+
+    /** Message thread: derivative the module's diff threshold tests, and its applyDiff output
+        when it is the first active detector on its input channel. */
+    void setDifferentiator (int module, const DifferentiatorSettings& settings);
+
+    const DifferentiatorSettings& getDifferentiator (int module) const { return modules.getReference(module).differentiator; }
+
+    /** Message thread: IIR stage the module runs on its input before detection, so its
+        windows and params are taken from the filtered signal too. */
+    void setPrefilter (int module, const PrefilterSettings& settings);
+
+    const PrefilterSettings& getPrefilter (int module) const { return modules.getReference(module).prefilter; }
 
     //void saveCustomChannelParametersToXml(XmlElement* channelInfo, int channelNumber, InfoObjectCommon::InfoObjectType channelTypel) override;
     //void loadCustomChannelParametersFromXml(XmlElement* channelInfo, InfoObjectCommon::InfoObjectType channelType)  override;
@@ -74,8 +178,43 @@ namespace StimDetectorSpace {
   private:
     void handleEvent (const EventChannel* channelInfo, const MidiMessage& event, int sampleNum) override;
 
-    void updateWaveformParams();
-    void updateActiveAvgLineParams();
+    struct DetectorModule;
+
+    void prepareModule (DetectorModule& module);
+    void updatePrefilter (int module);
+    void requestCountReset (int module);
+    void prepareBank();
+    void groupDetectors();
+
+    void windowClosed (int module) override;
+    void analyseSweep (const SweepQueue::Sweep& sweep);
+    void updateWaveformParams (const SweepQueue::Sweep& sweep);
+    void updateActiveAvgLineParams (const SweepQueue::Sweep& sweep);
+    void updateGateAlignment (const SweepQueue::Sweep& sweep);
+    void exportSweep (const SweepQueue::Sweep& sweep);
+    void archiveSweep (const SweepQueue::Sweep& sweep);
+    void publishResults();
+
+    /** Processes one channel group per item, on the worker pool. */
+    class ChannelGroupJob : public WorkerPool::Job
+    {
+    public:
+      ChannelGroupJob (StimDetector& p) : buffer(nullptr), processor(p) {}
+
+      void process (int item, int worker) override
+      {
+        processor.processChannelGroup(item, *processor.scratch[worker], *buffer);
+      }
+
+      AudioSampleBuffer* buffer;
+
+    private:
+      StimDetector& processor;
+    };
+
+    void prepareScratch();
+    void recordTriggerLatency (const TtlEvent& event, double processingSeconds);
+    void processChannelGroup (int group, DetectorEngine::Scratch& scratch, AudioSampleBuffer& buffer);
 
     //enum ModuleType
     //{
@@ -86,45 +225,47 @@ namespace StimDetectorSpace {
     //{
     //  NO_PHASE, FALLING_POS
     //};
+    // Settings and analysis results of a detector; its real-time state lives in the DetectorBank
     struct DetectorModule
     {
       int inputChan;              //electrode input channel
       int gateChan;               //digital input channel
       int outputChan;             //digital output channel
-      int samplesSinceTrigger;    //ttl interval count
 
-      float lastSample;           //last input original data
-      float lastDiff;             //last input diff data
-      
       double threshold;           //threshold of detection
+      double matchThreshold;      //correlation that triggers a template detector
+      double templateMs;          //length of the next learned template (ms)
+      bool usesTemplate;          //a template replaces the diff threshold
+      DifferentiatorSettings differentiator; //derivative of the diff threshold and applyDiff
+      PrefilterSettings prefilter;           //IIR stage ahead of detection and capture
 
       bool applyDiff;             //overwrite input chan data
+      bool diffChannel;           //append a derived diff channel of the input, applied in updateSettings
       bool isActive;              //channels to display in canvas
-      bool wasTriggered;          //ttl interval
-      bool wasTriggered_buffer;   //ttl interval inside the entire buffer
-      bool startStim;             //stim interval
-      bool detectorStim;          //internal ttl detector
-      bool ignoreFirst;           //fix first diff value
-
-      int startIndex;             //intput index
-      int windowIndex;            //avg index
-      int count;                  //avg count
+
+      double sampleRate;          //input channel sample rate
+      int avgLength;              //window length after the trigger (40 ms)
+      double preTriggerMs;        //history kept before the trigger (ms)
+      int preLength;              //pre-trigger samples at the start of the window
+      int ttlLength;              //ttl length and samples ignored after the stim (5 ms)
+      int movMean;                //moving mean window size (5 ms)
  
-      Array<double> stim;         //original stim
-      Array<int64> timestamps;    //last stim timestamps
-      Array<double> stimMean;     //moving mean array for max and min calculation
-      double yMax;                //max of stim
-      double yMin;                //min of stim
-      int64 xMax;                 //time of max
-      int64 xMin;                 //time of min
-
-      Array<double> avg;            //avg of stims
-      Array<Array<double>> matrix;  //matrix of avg params 
+      Array<double> stimMean;     //moving mean array for max and min calculation (analysis thread)
+      WaveformFeatures features;  //extremes of the last analysed stim
+      int sweepCount;             //avg count at the last analysed stim
+
+      int numGated;               //windows started by the gate
+      int numAligned;             //of those, windows with a trigger candidate to measure the gate against
+      double gateAlignment;       //first candidate minus gate time of the last one (ms)
+      double maxGateAlignment;    //largest absolute alignment error (ms)
+
       int activeRow;                //last row of avg
+      Array<int> avgCount;          //stims in each avg row
       Array<double> yAvgMax;        //max of avg stim
       Array<double> yAvgMin;        //min of avg stim
       Array<double> avgLatency;     //latency of avg stim
       Array<double> avgSlope;       //slope of avg stim
+      Array<SweepStatistics> rowStats; //mean and spread of the sweeps in each avg row
 
       //StimPlot* stimPlot;         //Canvas Component
       //ModuleType type;
@@ -132,19 +273,75 @@ namespace StimDetectorSpace {
     };
 
     Array<DetectorModule> modules;
+    DetectorBank bank;
+    DetectorEngine engine;
+    Array<int> detectorOrder;         //detectors with an input, sorted by input channel
+    Array<int> channelGroups;         //start of each input channel in detectorOrder, plus the end
+    Array<int> derivedChannels;       //per input channel, its derived diff channel or -1; set in updateSettings
+    Atomic<int> groupsChanged;        //an input channel changed, regroup before the next buffer
+
+    OwnedArray<TemplateMatcher> templates;    //every learned template, pruned when acquisition stops
+    Array<TemplateMatcher*> requestedMatchers; //per module, null for the diff threshold
+    OwnedArray<Differentiator> differentiators;          //likewise for differentiators
+    Array<Differentiator*> requestedDifferentiators;     //per module, null for the first difference
+    OwnedArray<Prefilter> prefilters;                    //likewise for prefilters, built for the input sample rate
+    Array<Prefilter*> requestedPrefilters;               //per module, null for none
+    Array<int> pendingCountResets;                       //modules whose avg count restarts (split or clear)
+    SpinLock triggerLock;                      //the requested arrays and count resets, between the message and audio threads
+    Atomic<int> triggersChanged;               //the audio thread takes the requested arrays before the next buffer
     int activeModule;
     int lastNumInputs;
     double defaultThreshold;
 
-    int avgLength;
-    int ttlLength;
-    int movMean;
     int buffetMin;
 
-    //CriticalSection onlineReset;
+    enum { minParallelGroups = 4 };   //fewer input channels than this run serially
+
+    int numThreads;                   //threads of the channel group pass, applied in enable()
+    ScopedPointer<WorkerPool> pool;   //null when running serially
+    ChannelGroupJob groupJob;
+    OwnedArray<DetectorEngine::Scratch> scratch;       //one per pool participant
+    OwnedArray<TtlEventBuffer> groupEvents;            //one per channel group, merged in group order
+    Atomic<int64> droppedEvents;                       //TTL changes past the capacity of groupEvents, since enable()
+    Atomic<int64> droppedGateOnsets;                   //gate onsets past DetectorBank::maxGateOnsets in a buffer, since enable()
+
+  #if JUCE_DEBUG
+    class RealtimeStorageCheck;
+  #endif
+
+    /** Computes the waveform params of finished sweeps off the audio thread. */
+    class AnalysisThread : public Thread
+    {
+    public:
+      AnalysisThread (StimDetector& processor);
+      void run() override;
+      void drain();
+
+    private:
+      StimDetector& processor;
+    };
+
+    SweepQueue sweepQueue;
+    SpinLock sweepLock;                 //channel groups closing windows at the same time
+    ScopedPointer<AnalysisThread> analysisThread;
+
+    CriticalSection onlineReset;        //analysis results, between the analysis and message threads
+
+    ParamsExport paramsExport;          //fed by the analysis thread, written by its own thread
+
+    bool archiveEnabled;                //set from the canvas, applied in enable()
+    SweepArchiveWriter archive;         //analysis thread, open while acquiring
+    File archiveFile;
+
+    TripleBuffer<ResultSnapshot> results;
+    uint32 resultVersion;
 
     Array<const EventChannel*> moduleEventChannels;
 
+    TriggerLatency triggerLatency;      //written by the audio thread only
+    BudgetMeter budgetMeter;            //written by the audio thread only
+    double budgetSampleRate;            //rate of the first input channel, the buffer duration
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StimDetector);
   };
 
@@ -25,11 +25,91 @@
 
 using namespace StimDetectorSpace;
 
+namespace
+{
+  // differentiators offered by the canvas; the editor XML keeps any other settings
+  struct DifferentiatorPreset
+  {
+    const char* name;
+    DifferentiatorSettings::Type type;
+    int length;
+    int order;
+    double cutoff;
+  };
+
+  const DifferentiatorPreset differentiatorPresets[] =
+  {
+    { "First difference",       DifferentiatorSettings::firstDifference,   7,  2, 0.5  },
+    { "Central difference",     DifferentiatorSettings::centralDifference, 7,  2, 0.5  },
+    { "S-G 7, quadratic",       DifferentiatorSettings::savitzkyGolay,     7,  2, 0.5  },
+    { "S-G 11, quadratic",      DifferentiatorSettings::savitzkyGolay,     11, 2, 0.5  },
+    { "S-G 11, quartic",        DifferentiatorSettings::savitzkyGolay,     11, 4, 0.5  },
+    { "S-G 21, quartic",        DifferentiatorSettings::savitzkyGolay,     21, 4, 0.5  },
+    { "FIR 15, 0.3 Nyquist",    DifferentiatorSettings::bandLimited,       15, 2, 0.3  },
+    { "FIR 31, 0.15 Nyquist",   DifferentiatorSettings::bandLimited,       31, 2, 0.15 },
+  };
+
+  const int numDifferentiatorPresets = (int)(sizeof(differentiatorPresets) / sizeof(differentiatorPresets[0]));
+
+  // prefilters offered by the canvas, likewise
+  struct PrefilterPreset
+  {
+    const char* name;
+    PrefilterSettings::Type type;
+    double lowHz;
+    double highHz;
+    int order;
+  };
+
+  const PrefilterPreset prefilterPresets[] =
+  {
+    { "None",                   PrefilterSettings::none,     1,   1000, 2 },
+    { "High-pass 1 Hz",         PrefilterSettings::highPass, 1,   1000, 2 },
+    { "High-pass 10 Hz",        PrefilterSettings::highPass, 10,  1000, 4 },
+    { "High-pass 300 Hz",       PrefilterSettings::highPass, 300, 1000, 4 },
+    { "Notch 50 Hz",            PrefilterSettings::notch,    50,  1000, 2 },
+    { "Notch 60 Hz",            PrefilterSettings::notch,    60,  1000, 2 },
+    { "Band-pass 1-1000 Hz",    PrefilterSettings::bandPass, 1,   1000, 2 },
+    { "Band-pass 300-5000 Hz",  PrefilterSettings::bandPass, 300, 5000, 2 },
+  };
+
+  const int numPrefilterPresets = (int)(sizeof(prefilterPresets) / sizeof(prefilterPresets[0]));
+
+  bool matchesPreset(const PrefilterSettings& s, const PrefilterPreset& p)
+  {
+    if (s.type != p.type)
+      return false;
+    if (s.type == PrefilterSettings::highPass)
+      return s.lowHz == p.lowHz && s.order == p.order;
+    if (s.type == PrefilterSettings::notch)
+      return s.lowHz == p.lowHz && s.q == PrefilterSettings().q;
+    if (s.type == PrefilterSettings::bandPass)
+      return s.lowHz == p.lowHz && s.highHz == p.highHz && s.order == p.order;
+    return true;
+  }
+
+  bool matchesPreset(const DifferentiatorSettings& s, const DifferentiatorPreset& p)
+  {
+    if (s.type != p.type)
+      return false;
+    if (s.type == DifferentiatorSettings::savitzkyGolay)
+      return s.length == p.length && s.order == p.order;
+    if (s.type == DifferentiatorSettings::bandLimited)
+      return s.length == p.length && s.cutoff == p.cutoff;
+    return true;
+  }
+}
+
 StimDetectorCanvas::StimDetectorCanvas(StimDetector* sd) :
   processor(sd),
   viewport(new Viewport()),
   canvas(new Component("canvas")),
-  canvasBounds	(0, 0, 990, 200)
+  canvasBounds	(0, 0, 990, 200),
+  results(nullptr),
+  lastVersion(0),
+  lastModule(-1),
+  lastLatencyCount(0),
+  lastBudgetCount(0)
 {
   refreshRate = 2; //Hz
   juce::Rectangle<int> bounds;
@@ -66,6 +146,106 @@ StimDetectorCanvas::StimDetectorCanvas(StimDetector* sd) :
   splitButton->addListener(this);
   addAndMakeVisible(splitButton);
 
+  latencyButton = new UtilityButton("Save Latency", font);
+  latencyButton->addListener(this);
+  addAndMakeVisible(latencyButton);
+
+  budgetButton = new UtilityButton("Save CPU", font);
+  budgetButton->addListener(this);
+  addAndMakeVisible(budgetButton);
+
+  overrunLabel = new Label("overrun label", "Overrun %");
+  overrunLabel->setFont(Font("Small Text", 12, Font::plain));
+  overrunLabel->setColour(Label::textColourId, Colours::grey);
+  addAndMakeVisible(overrunLabel);
+
+  lastOverrunString = String(processor->getBudgetMeter().getOverrunFraction() * 100);
+  overrunValue = new Label("overrun value", lastOverrunString);
+  overrunValue->setFont(Font("Default", 15, Font::plain));
+  overrunValue->setColour(Label::textColourId, Colours::white);
+  overrunValue->setColour(Label::backgroundColourId, Colours::grey);
+  overrunValue->setEditable(true);
+  overrunValue->addListener(this);
+  overrunValue->setTooltip("Callbacks over this share of the buffer duration count as overruns (1 to 1000)");
+  addAndMakeVisible(overrunValue);
+
+  archiveButton = new UtilityButton("Archive Sweeps", font);
+  archiveButton->setClickingTogglesState(true);
+  archiveButton->setToggleState(processor->isArchiveEnabled(), dontSendNotification);
+  archiveButton->setTooltip("Keep every raw sweep of the next acquisitions in Documents/StimDetector");
+  archiveButton->addListener(this);
+  addAndMakeVisible(archiveButton);
+
+  learnButton = new UtilityButton("Learn Template", font);
+  learnButton->setTooltip("Trigger on the correlation with the start of the active row's mean sweep; the TTL fires at the end of the match");
+  learnButton->addListener(this);
+  addAndMakeVisible(learnButton);
+
+  diffButton = new UtilityButton("Diff Trigger", font);
+  diffButton->setTooltip("Trigger on the diff threshold again");
+  diffButton->addListener(this);
+  addAndMakeVisible(diffButton);
+
+  matchLabel = new Label("match label", "NCC");
+  matchLabel->setFont(Font("Small Text", 12, Font::plain));
+  matchLabel->setColour(Label::textColourId, Colours::grey);
+  addAndMakeVisible(matchLabel);
+
+  matchValue = new Label("match value", String());
+  matchValue->setFont(Font("Default", 15, Font::plain));
+  matchValue->setColour(Label::textColourId, Colours::white);
+  matchValue->setColour(Label::backgroundColourId, Colours::grey);
+  matchValue->setEditable(true);
+  matchValue->addListener(this);
+  matchValue->setTooltip("Correlation with the template that triggers (0.01 to 0.99)");
+  addAndMakeVisible(matchValue);
+
+  templateLabel = new Label("template label", "Tmpl ms");
+  templateLabel->setFont(Font("Small Text", 12, Font::plain));
+  templateLabel->setColour(Label::textColourId, Colours::grey);
+  addAndMakeVisible(templateLabel);
+
+  templateValue = new Label("template value", String());
+  templateValue->setFont(Font("Default", 15, Font::plain));
+  templateValue->setColour(Label::textColourId, Colours::white);
+  templateValue->setColour(Label::backgroundColourId, Colours::grey);
+  templateValue->setEditable(true);
+  templateValue->addListener(this);
+  templateValue->setTooltip("Length of the next learned template, in ms (0.5 to 40)");
+  addAndMakeVisible(templateValue);
+
+  differentiatorLabel = new Label("differentiator label", "Diff");
+  differentiatorLabel->setFont(Font("Small Text", 12, Font::plain));
+  differentiatorLabel->setColour(Label::textColourId, Colours::grey);
+  addAndMakeVisible(differentiatorLabel);
+
+  differentiatorSelector = new ComboBox("differentiator");
+  for (int i = 0; i < numDifferentiatorPresets; i++)
+    differentiatorSelector->addItem(differentiatorPresets[i].name, i + 1);
+  differentiatorSelector->setTextWhenNothingSelected("Custom");
+  differentiatorSelector->setTooltip("Derivative the diff threshold tests, also written by Apply Diff");
+  differentiatorSelector->addListener(this);
+  addAndMakeVisible(differentiatorSelector);
+
+  prefilterLabel = new Label("prefilter label", "Filter");
+  prefilterLabel->setFont(Font("Small Text", 12, Font::plain));
+  prefilterLabel->setColour(Label::textColourId, Colours::grey);
+  addAndMakeVisible(prefilterLabel);
+
+  prefilterSelector = new ComboBox("prefilter");
+  for (int i = 0; i < numPrefilterPresets; i++)
+    prefilterSelector->addItem(prefilterPresets[i].name, i + 1);
+  prefilterSelector->setTextWhenNothingSelected("Custom");
+  prefilterSelector->setTooltip("IIR filter on the input ahead of detection; the windows and params use the filtered signal");
+  prefilterSelector->addListener(this);
+  addAndMakeVisible(prefilterSelector);
+
+#if STIMDETECTOR_TRACE
+  traceButton = new UtilityButton("Save Trace", font);
+  traceButton->addListener(this);
+  addAndMakeVisible(traceButton);
+#endif
+
   //addAndMakeVisible(viewport);
 
   //stimDisplay = new StimDetectorDisplay(sd, this, viewport);
@@ -95,6 +275,8 @@ void StimDetectorCanvas::flipCanvas()
 
 void StimDetectorCanvas::paint(Graphics& g)
 {
+  SD_TRACE_SCOPE("canvasPaint");
+
   //std::cout << "class.canvas paint" << std::endl;
   g.fillAll(Colours::black); //background
 
@@ -105,8 +287,8 @@ void StimDetectorCanvas::paint(Graphics& g)
   g.fillRect(0, PADDING_TOP - 1, getWidth(), 1);
 
 
-  int cols = last.size();       //6
-  int rows = avgMatrix.size();  //avg lines
+  int cols = NUM_WAVEFORM_PARAMS; //6
+  int rows = results != nullptr ? results->numRows : 0;  //avg lines
 
   g.setFont(font);
 
@@ -135,7 +317,8 @@ void StimDetectorCanvas::paint(Graphics& g)
   {
     //last stim line
     g.drawRect(150 + 130 * x, PADDING_TOP + 100, 130, 30, 1);
-    g.drawText(String(last[x]), 150 + 130 * x, PADDING_TOP + 100, 130, 30, Justification::centred, true);
+    if (results != nullptr)
+      g.drawText(String(results->last[x]), 150 + 130 * x, PADDING_TOP + 100, 130, 30, Justification::centred, true);
   }
 
 
@@ -152,7 +335,128 @@ void StimDetectorCanvas::paint(Graphics& g)
       g.setColour(Colours::grey);
       g.drawRect(150 + 130 * x, PADDING_TOP + 130 + 30 * y, 130, 30, 1);
       g.setColour(colours[y]);
-      g.drawText(String(avgMatrix[y][x]), 150 + 130 * x, PADDING_TOP + 130 + 30 * y, 130, 30, Justification::centred, true);
+      g.drawText(String(results->avgTable[y * cols + x]), 150 + 130 * x, PADDING_TOP + 130 + 30 * y, 130, 30, Justification::centred, true);
+    }
+  }
+
+  // first trigger candidate against the gate timestamp, once the gate opened a window
+  if (results != nullptr && results->numGated > 0)
+  {
+    g.setColour(Colours::white);
+    g.drawText("GATE ALIGNMENT: " + String(results->gateAlignment, 3) + " ms (max " + String(results->maxGateAlignment, 3) + " ms, "
+      + String(results->numAligned) + " of " + String(results->numGated) + " windows)", 150, PADDING_TOP + 140 + 30 * rows, 650, 30, Justification::centredLeft, true);
+  }
+
+  // stim sample to TTL, all detectors
+  const StimDetector::TriggerLatency& latency = processor->getTriggerLatency();
+  if (latency.total.getCount() > 0)
+  {
+    const LatencyHistogram* histograms[] = { &latency.total, &latency.inBuffer, &latency.processing };
+    const String names[] = { "TRIGGER TO TTL", "IN BUFFER", "PROCESSING" };
+
+    g.setColour(Colours::white);
+    for (int h = 0; h < 3; h++)
+    {
+      g.drawText(names[h] + ": p50 " + String(histograms[h]->getPercentile(0.50) / 1000.0, 1)
+        + " us, p99 " + String(histograms[h]->getPercentile(0.99) / 1000.0, 1)
+        + " us, max " + String(histograms[h]->getMax() / 1000.0, 1) + " us",
+        150 + 260 * h, PADDING_TOP + 170 + 30 * rows, 260, 30, Justification::centredLeft, true);
+    }
+  }
+
+  // process() wall time against the buffer duration
+  const BudgetMeter& meter = processor->getBudgetMeter();
+  if (meter.getNumCallbacks() > 0)
+  {
+    const BudgetMeter::Stats stats = meter.getRecentStats();
+
+    const int64 dropped = processor->getNumDroppedEvents();
+    const int64 droppedGates = processor->getNumDroppedGateOnsets();
+
+    g.setColour(meter.getNumOverruns() > 0 || dropped > 0 || droppedGates > 0 ? Colours::orange : Colours::white);
+    g.drawText("CPU: " + String(stats.meanLoad * 100, 1) + "% of the buffer on average, max " + String(stats.maxLoad * 100, 1)
+      + "% (last " + String(stats.numCallbacks) + " buffers), " + String((int64) meter.getNumOverruns()) + " overruns over "
+      + String(meter.getOverrunFraction() * 100, 0) + "% in " + String((int64) meter.getNumCallbacks()) + " buffers"
+      + (dropped > 0 ? ", " + String(dropped) + " TTL events dropped" : String())
+      + (droppedGates > 0 ? ", " + String(droppedGates) + " gate onsets dropped" : String()),
+      150, PADDING_TOP + 200 + 30 * rows, 780, 30, Justification::centredLeft, true);
+  }
+
+  const ParamsExport& paramsExport = processor->getParamsExport();
+  if (paramsExport.isRunning())
+  {
+    g.setColour(paramsExport.getNumDropped() > 0 ? Colours::orange : Colours::grey);
+    g.drawText("EXPORT: " + paramsExport.getFile().getFullPathName()
+      + (paramsExport.getNumDropped() > 0 ? " (" + String(paramsExport.getNumDropped()) + " stims dropped)" : String()),
+      150, PADDING_TOP + 230 + 30 * rows, 780, 30, Justification::centredLeft, true);
+  }
+
+  if (processor->getArchiveFile() != File())
+  {
+    g.setColour(Colours::grey);
+    g.drawText("ARCHIVE: " + processor->getArchiveFile().getFullPathName(),
+      150, PADDING_TOP + 260 + 30 * rows, 780, 30, Justification::centredLeft, true);
+  }
+
+  // mean sweep of each avg row with its 95% confidence band (1.96 SEM)
+  if (results != nullptr && results->sweepLength > 1 && results->sampleRate > 0)
+  {
+    const int length = results->sweepLength;
+    const juce::Rectangle<float> plot(150, PADDING_TOP + 300 + 30 * rows, 780, 220);
+
+    double yLow = 0, yHigh = 0;
+    for (int i = 0; i < rows * length; i++)
+    {
+      yLow = jmin(yLow, results->rowMean[i] - 1.96 * results->rowSem[i]);
+      yHigh = jmax(yHigh, results->rowMean[i] + 1.96 * results->rowSem[i]);
+    }
+    if (yHigh <= yLow)
+      yHigh = yLow + 1;
+
+    const float xStep = plot.getWidth() / (length - 1);
+    const float yScale = plot.getHeight() / (float) (yHigh - yLow);
+    auto toY = [&](double y) { return plot.getBottom() - (float) (y - yLow) * yScale; };
+
+    g.setColour(Colours::grey);
+    g.drawRect(plot, 1.0f);
+    g.drawHorizontalLine((int) toY(0), plot.getX(), plot.getRight());
+    g.drawVerticalLine((int) (plot.getX() + xStep * results->preLength), plot.getY(), plot.getBottom()); //trigger
+
+    const int module = processor->getActiveModule();
+    const String trigger = processor->hasTemplate(module)
+      ? "TRIGGER: TEMPLATE, NCC > " + String(processor->getMatchThreshold(module), 2) : "TRIGGER: DIFF THRESHOLD";
+
+    g.setColour(Colours::white);
+    g.drawText("AVG +/- 95% CI    " + trigger, (int) plot.getX(), (int) plot.getY() - 30, 520, 30, Justification::centredLeft, true);
+    g.drawText(String(yHigh, 3), 50, (int) plot.getY(), 95, 20, Justification::centredRight, true);
+    g.drawText(String(yLow, 3), 50, (int) plot.getBottom() - 20, 95, 20, Justification::centredRight, true);
+    g.drawText(String((length - 1 - results->preLength) / results->sampleRate * 1000, 1) + " ms",
+      (int) plot.getRight() - 100, (int) plot.getBottom(), 100, 20, Justification::centredRight, true);
+
+    for (int y = 0; y < rows; y++)
+    {
+      if (results->avgTable[y * cols + 5] < 1) //no sweeps in this row yet
+        continue;
+
+      const double* mean = results->rowMean.begin() + y * length;
+      const double* sem = results->rowSem.begin() + y * length;
+
+      Path band, line;
+      band.startNewSubPath(plot.getX(), toY(mean[0] + 1.96 * sem[0]));
+      line.startNewSubPath(plot.getX(), toY(mean[0]));
+      for (int w = 1; w < length; w++)
+      {
+        band.lineTo(plot.getX() + xStep * w, toY(mean[w] + 1.96 * sem[w]));
+        line.lineTo(plot.getX() + xStep * w, toY(mean[w]));
+      }
+      for (int w = length - 1; w >= 0; w--)
+        band.lineTo(plot.getX() + xStep * w, toY(mean[w] - 1.96 * sem[w]));
+      band.closeSubPath();
+
+      g.setColour(colours[y].withAlpha(0.3f));
+      g.fillPath(band);
+      g.setColour(colours[y]);
+      g.strokePath(line, PathStrokeType(1.0f));
     }
   }
 
@@ -188,15 +492,37 @@ void StimDetectorCanvas::refreshState()
   std::cout << "class.canvas refreshState" << std::endl;
   // called when the component's tab becomes visible again
   resized();
+  updateTemplateLabels();
+  updateDifferentiatorSelector();
+  updatePrefilterSelector();
 }
 
 void StimDetectorCanvas::resized()
 {
   std::cout << "class.canvas resized" << std::endl;
   // called when the modify canvas dimensions
-  viewport->setBounds(0, 50, getWidth(), getHeight() - 50); // leave space at top for buttons
+  viewport->setBounds(0, PADDING_TOP, getWidth(), getHeight() - PADDING_TOP); // leave space at top for buttons
   resetButton->setBounds(10, 10, 120, 30);
   splitButton->setBounds(140, 10, 120, 30);
+  latencyButton->setBounds(270, 10, 120, 30);
+  budgetButton->setBounds(400, 10, 120, 30);
+  overrunLabel->setBounds(530, 15, 70, 20);
+  overrunValue->setBounds(600, 15, 45, 20);
+  archiveButton->setBounds(660, 10, 130, 30);
+  if (traceButton != nullptr)
+    traceButton->setBounds(800, 10, 120, 30);
+
+  // second row: how the detector triggers
+  learnButton->setBounds(10, 50, 120, 30);
+  diffButton->setBounds(140, 50, 100, 30);
+  matchLabel->setBounds(245, 55, 35, 20);
+  matchValue->setBounds(280, 55, 45, 20);
+  templateLabel->setBounds(330, 55, 55, 20);
+  templateValue->setBounds(385, 55, 45, 20);
+  differentiatorLabel->setBounds(440, 55, 35, 20);
+  differentiatorSelector->setBounds(475, 55, 160, 20);
+  prefilterLabel->setBounds(645, 55, 40, 20);
+  prefilterSelector->setBounds(685, 55, 170, 20);
 }
 
 void StimDetectorCanvas::update()
@@ -211,14 +537,36 @@ void StimDetectorCanvas::refresh()
 {
   // std::cout << "refresh canvas -> ";
   // called continuosly
+  SD_TRACE_THREAD("message");
+  SD_TRACE_SCOPE("canvasRefresh");
 
   // -- Title -- //
-  title = createLabel("Title", "STIM PARAMETERS", Justification::centred, { 5, 5, canvas->getWidth(), 50 });
+  if (title == nullptr)
+    title = createLabel("Title", "STIM PARAMETERS", Justification::centred, { 5, 5, canvas->getWidth(), 50 });
+
+  //processor data, published by the analysis thread; no locks and no copies
+  const StimDetector::ResultSnapshot& snapshot = processor->getResultSnapshot();
+  const int module = processor->getActiveModule();
+  const uint64 latencyCount = processor->getTriggerLatency().total.getCount();
+  const uint64 budgetCount = processor->getBudgetMeter().getNumCallbacks();
 
-  //processor data  
-  last = processor->getLastWaveformParams(-1);
-  avgMatrix = processor->getAvgMatrixParams();
-  //std::cout << "avgMatrix: " << avgMatrix.size() << ", " << avgMatrix[0].size() << std::endl;
+  if (snapshot.version == lastVersion && module == lastModule && latencyCount == lastLatencyCount
+    && budgetCount == lastBudgetCount)
+    return; //nothing new to draw
+
+  results = isPositiveAndBelow(module, snapshot.modules.size()) ? &snapshot.modules.getReference(module) : nullptr;
+
+  if (module != lastModule)
+  {
+    updateTemplateLabels();
+    updateDifferentiatorSelector();
+    updatePrefilterSelector();
+  }
+
+  lastVersion = snapshot.version;
+  lastModule = module;
+  lastLatencyCount = latencyCount;
+  lastBudgetCount = budgetCount;
 
   repaint(); //update graphics
 
@@ -238,8 +586,22 @@ void StimDetectorCanvas::endAnimation()
   stopCallbacks();
 }
 
-void StimDetectorCanvas::saveVisualizerParameters(XmlElement* xml) {}
-void StimDetectorCanvas::loadVisualizerParameters(XmlElement* xml) {}
+void StimDetectorCanvas::saveVisualizerParameters(XmlElement* xml)
+{
+  xml->setAttribute("OVERRUN", processor->getBudgetMeter().getOverrunFraction() * 100);
+  xml->setAttribute("ARCHIVE", processor->isArchiveEnabled());
+}
+
+void StimDetectorCanvas::loadVisualizerParameters(XmlElement* xml)
+{
+  const double percent = xml->getDoubleAttribute("OVERRUN", processor->getBudgetMeter().getOverrunFraction() * 100);
+  processor->setOverrunFraction(percent / 100);
+  overrunValue->setText(String(percent), dontSendNotification);
+  lastOverrunString = overrunValue->getText();
+
+  processor->setArchiveEnabled(xml->getBoolAttribute("ARCHIVE", processor->isArchiveEnabled()));
+  archiveButton->setToggleState(processor->isArchiveEnabled(), dontSendNotification);
+}
 
 void StimDetectorCanvas::buttonClicked(Button* button)
 {
@@ -254,6 +616,150 @@ void StimDetectorCanvas::buttonClicked(Button* button)
     // Add new line and restart new avg calc
     processor->splitAvgArray();
   }
+  else if (button == latencyButton)
+  {
+    FileChooser chooser("Save trigger latency", File::getSpecialLocation(File::userHomeDirectory).getChildFile("stim_latency.csv"), "*.csv");
+
+    if (chooser.browseForFileToSave(true) && !processor->saveTriggerLatency(chooser.getResult()))
+      CoreServices::sendStatusMessage("Could not write " + chooser.getResult().getFullPathName());
+  }
+  else if (button == budgetButton)
+  {
+    FileChooser chooser("Save CPU budget", File::getSpecialLocation(File::userHomeDirectory).getChildFile("stim_cpu.csv"), "*.csv");
+
+    if (chooser.browseForFileToSave(true) && !processor->saveBudget(chooser.getResult()))
+      CoreServices::sendStatusMessage("Could not write " + chooser.getResult().getFullPathName());
+  }
+  else if (button == archiveButton)
+  {
+    processor->setArchiveEnabled(archiveButton->getToggleState());
+  }
+  else if (button == learnButton)
+  {
+    const int module = processor->getActiveModule();
+
+    if (module >= 0 && !processor->learnTemplate(module))
+      CoreServices::sendStatusMessage("Stim Detector: no sweeps in the active row to learn a template from");
+    repaint();
+  }
+  else if (button == diffButton)
+  {
+    const int module = processor->getActiveModule();
+
+    if (module >= 0)
+      processor->clearTemplate(module);
+    repaint();
+  }
+  else if (button == traceButton)
+  {
+    FileChooser chooser("Save trace", File::getSpecialLocation(File::userHomeDirectory).getChildFile("stim_trace.json"), "*.json");
+
+    if (chooser.browseForFileToSave(true)
+      && !TraceRecorder::getInstance().writeChromeTrace(chooser.getResult().getFullPathName().toRawUTF8()))
+      CoreServices::sendStatusMessage("Could not write " + chooser.getResult().getFullPathName());
+  }
+}
+
+void StimDetectorCanvas::labelTextChanged(Label* label)
+{
+  if (label == overrunValue)
+  {
+    const double percent = double(label->getTextValue().getValue());
+
+    if (percent < 1 || percent > 1000)
+    {
+      CoreServices::sendStatusMessage("Value out of range.");
+      label->setText(lastOverrunString, dontSendNotification);
+      return;
+    }
+
+    processor->setOverrunFraction(percent / 100);
+    lastOverrunString = label->getText();
+  }
+  else if (label == matchValue || label == templateValue)
+  {
+    const double value = double(label->getTextValue().getValue());
+    const bool isMatch = label == matchValue;
+    const int module = processor->getActiveModule();
+
+    if (module < 0 || (isMatch ? (value < 0.01 || value > 0.99) : (value < 0.5 || value > 40)))
+    {
+      CoreServices::sendStatusMessage("Value out of range.");
+      updateTemplateLabels();
+      return;
+    }
+
+    processor->setParameter(isMatch ? 10 : 9, (float) value);
+    repaint();
+  }
+}
+
+// Template settings of the detector on screen
+void StimDetectorCanvas::updateTemplateLabels()
+{
+  const int module = processor->getActiveModule();
+  const bool valid = module >= 0;
+
+  matchValue->setText(valid ? String(processor->getMatchThreshold(module)) : String(), dontSendNotification);
+  templateValue->setText(valid ? String(processor->getTemplateMs(module)) : String(), dontSendNotification);
+}
+
+void StimDetectorCanvas::comboBoxChanged(ComboBox* comboBox)
+{
+  const int module = processor->getActiveModule();
+  const int preset = comboBox->getSelectedId() - 1;
+
+  if (module < 0 || preset < 0)
+    return;
+
+  if (comboBox == differentiatorSelector)
+  {
+    DifferentiatorSettings settings;
+    settings.type = differentiatorPresets[preset].type;
+    settings.length = differentiatorPresets[preset].length;
+    settings.order = differentiatorPresets[preset].order;
+    settings.cutoff = differentiatorPresets[preset].cutoff;
+    processor->setDifferentiator(module, settings);
+  }
+  else if (comboBox == prefilterSelector)
+  {
+    PrefilterSettings settings;
+    settings.type = prefilterPresets[preset].type;
+    settings.lowHz = prefilterPresets[preset].lowHz;
+    settings.highHz = prefilterPresets[preset].highHz;
+    settings.order = prefilterPresets[preset].order;
+    processor->setPrefilter(module, settings);
+  }
+}
+
+// Differentiator of the detector on screen, nothing selected for custom settings
+void StimDetectorCanvas::updateDifferentiatorSelector()
+{
+  const int module = processor->getActiveModule();
+  int id = 0;
+
+  for (int i = 0; module >= 0 && i < numDifferentiatorPresets && id == 0; i++)
+  {
+    if (matchesPreset(processor->getDifferentiator(module), differentiatorPresets[i]))
+      id = i + 1;
+  }
+
+  differentiatorSelector->setSelectedId(id, dontSendNotification);
+}
+
+// Prefilter of the detector on screen, likewise
+void StimDetectorCanvas::updatePrefilterSelector()
+{
+  const int module = processor->getActiveModule();
+  int id = 0;
+
+  for (int i = 0; module >= 0 && i < numPrefilterPresets && id == 0; i++)
+  {
+    if (matchesPreset(processor->getPrefilter(module), prefilterPresets[i]))
+      id = i + 1;
+  }
+
+  prefilterSelector->setSelectedId(id, dontSendNotification);
 }
 
 Label* StimDetectorCanvas::createLabel(const String& name, const String& text, const Justification& justification, juce::Rectangle<int> bounds)
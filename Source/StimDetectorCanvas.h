@@ -34,7 +34,7 @@
 #include "StimDetector.h"
 #include <vector>
 
-#define PADDING_TOP 50
+#define PADDING_TOP 90   //two rows of controls
 #define SCALE_WIDTH 0
 
 namespace StimDetectorSpace {
@@ -48,9 +48,9 @@ namespace StimDetectorSpace {
 
   class StimDetectorCanvas :
     public Visualizer,
-    public Button::Listener
-    //public ComboBox::Listener,
-    //public Label::Listener
+    public Button::Listener,
+    public ComboBox::Listener,
+    public Label::Listener
 
   {
   public:
@@ -79,6 +79,8 @@ namespace StimDetectorSpace {
     void setParameter(int, int, int, float) {}
 
     void buttonClicked(Button*) override;
+    void labelTextChanged(Label*) override;
+    void comboBoxChanged(ComboBox*) override;
 
   private:
     StimDetector* processor;
@@ -95,12 +97,36 @@ namespace StimDetectorSpace {
     /* Window content */
     Array<Colour> colours;
     Font font;
-    Array<double> last; // 1 detector params
-    Array<Array<double>> avgMatrix; // avgIndex.detectorParams
+    const StimDetector::ModuleResults* results; // active detector params, owned by the processor snapshot
+    uint32 lastVersion;                         // snapshot version on screen
+    int lastModule;                             // detector on screen
+    uint64 lastLatencyCount;                    // triggers in the latency line on screen
+    uint64 lastBudgetCount;                     // callbacks in the budget line on screen
 
     ScopedPointer<Label> title;
     ScopedPointer<UtilityButton> resetButton;
     ScopedPointer<UtilityButton> splitButton;
+    ScopedPointer<UtilityButton> latencyButton;
+    ScopedPointer<UtilityButton> budgetButton;
+    ScopedPointer<UtilityButton> traceButton;     // only with STIMDETECTOR_TRACE
+    ScopedPointer<UtilityButton> archiveButton;
+    ScopedPointer<Label> overrunLabel;
+    ScopedPointer<Label> overrunValue;
+    String lastOverrunString;
+    ScopedPointer<UtilityButton> learnButton;
+    ScopedPointer<UtilityButton> diffButton;
+    ScopedPointer<Label> matchLabel;
+    ScopedPointer<Label> matchValue;
+    ScopedPointer<Label> templateLabel;
+    ScopedPointer<Label> templateValue;
+    ScopedPointer<Label> differentiatorLabel;
+    ScopedPointer<ComboBox> differentiatorSelector;
+    ScopedPointer<Label> prefilterLabel;
+    ScopedPointer<ComboBox> prefilterSelector;
+
+    void updateTemplateLabels();
+    void updateDifferentiatorSelector();
+    void updatePrefilterSelector();
 
     //ScopedPointer<StimDetectorDisplay> stimDisplay;
 
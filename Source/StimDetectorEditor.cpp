@@ -47,11 +47,25 @@ StimDetectorEditor::StimDetectorEditor(GenericProcessor* parentNode, bool useDef
   addAndMakeVisible(plusButton);
 
   detectorSelector = new ComboBox();
-  detectorSelector->setBounds(35,30,165,20);
+  detectorSelector->setBounds(35,30,120,20);
   detectorSelector->addListener(this);
   addAndMakeVisible(detectorSelector);
 
+  // threads shared by all detectors of the node, applied when acquisition starts
+  threadSelector = new ComboBox();
+  threadSelector->setBounds(160,30,40,20);
+  threadSelector->setTooltip("Threads");
+  for (int i = 1; i <= SystemStats::getNumCpus(); i++)
+    threadSelector->addItem(String(i), i);
+  threadSelector->setSelectedId(1, dontSendNotification);
+  threadSelector->addListener(this);
+  addAndMakeVisible(threadSelector);
+
   backgroundColours.add(Colours::red);
+  backgroundColours.add(Colours::green);
+  backgroundColours.add(Colours::orange);
+  backgroundColours.add(Colours::magenta);
+  backgroundColours.add(Colours::blue);
   //plusButton->setToggleState(true, sendNotification);
   addDetector();
 
@@ -74,6 +88,7 @@ Visualizer* StimDetectorEditor::createNewCanvas()
 void StimDetectorEditor::startAcquisition()
 {
   plusButton->setEnabled(false);
+  threadSelector->setEnabled(false);
   for (int i = 0; i < interfaces.size(); i++)
     interfaces[i]->setEnableStatus(false);
 }
@@ -81,6 +96,7 @@ void StimDetectorEditor::startAcquisition()
 void StimDetectorEditor::stopAcquisition()
 {
   plusButton->setEnabled(true);
+  threadSelector->setEnabled(true);
   for (int i = 0; i < interfaces.size(); i++)
     interfaces[i]->setEnableStatus(true);
 }
@@ -148,6 +164,12 @@ void StimDetectorEditor::comboBoxChanged(ComboBox* c)
 {
   StimDetector* sd = (StimDetector*)getProcessor();
 
+  if (c == threadSelector)
+  {
+    sd->setParameter(7, (float)c->getSelectedId());
+    return;
+  }
+
   for (int i = 0; i < interfaces.size(); i++)
   {
 
@@ -169,7 +191,7 @@ void StimDetectorEditor::comboBoxChanged(ComboBox* c)
 
 void StimDetectorEditor::buttonEvent(Button* button)
 {
-  if (button == plusButton && interfaces.size() < 1)
+  if (button == plusButton)
   {
     addDetector();
     CoreServices::updateSignalChain(this);
@@ -188,7 +210,7 @@ void StimDetectorEditor::addDetector()
 
   int detectorNumber = interfaces.size()+1;
 
-  DetectorInterface* di = new DetectorInterface(sd, backgroundColours[detectorNumber % 5], detectorNumber-1);
+  DetectorInterface* di = new DetectorInterface(sd, backgroundColours[(detectorNumber - 1) % backgroundColours.size()], detectorNumber-1);
   di->setBounds(10,50,190,80); // module position and size
 
   addAndMakeVisible(di);
@@ -217,6 +239,9 @@ void StimDetectorEditor::saveCustomParameters(XmlElement* xml)
 {
 
   xml->setAttribute("Type", "StimDetectorEditor");
+  xml->setAttribute("THREADS", threadSelector->getSelectedId());
+
+  StimDetector* processor = (StimDetector*)getProcessor();
 
   for (int i = 0; i < interfaces.size(); i++)
   {
@@ -224,6 +249,23 @@ void StimDetectorEditor::saveCustomParameters(XmlElement* xml)
     d->setAttribute("INPUT",interfaces[i]->getInputChan());
     d->setAttribute("OUTPUT",interfaces[i]->getOutputChan());
     d->setAttribute("THRESHOLD",interfaces[i]->getThreshold());
+    d->setAttribute("PRE",interfaces[i]->getPreTrigger());
+    d->setAttribute("DIFF_CHANNEL",interfaces[i]->getDiffChannel());
+    d->setAttribute("MATCH",processor->getMatchThreshold(i));
+    d->setAttribute("TEMPLATE_MS",processor->getTemplateMs(i));
+
+    const DifferentiatorSettings& differentiator = processor->getDifferentiator(i);
+    d->setAttribute("DIFF_TYPE",(int)differentiator.type);
+    d->setAttribute("DIFF_LENGTH",differentiator.length);
+    d->setAttribute("DIFF_ORDER",differentiator.order);
+    d->setAttribute("DIFF_CUTOFF",differentiator.cutoff);
+
+    const PrefilterSettings& prefilter = processor->getPrefilter(i);
+    d->setAttribute("FILTER_TYPE",(int)prefilter.type);
+    d->setAttribute("FILTER_LOW",prefilter.lowHz);
+    d->setAttribute("FILTER_HIGH",prefilter.highHz);
+    d->setAttribute("FILTER_Q",prefilter.q);
+    d->setAttribute("FILTER_ORDER",prefilter.order);
   }
 }
 
@@ -232,6 +274,10 @@ void StimDetectorEditor::loadCustomParameters(XmlElement* xml)
 
   int i = 0;
 
+  const int numThreads = jlimit(1, threadSelector->getNumItems(), xml->getIntAttribute("THREADS", 1));
+  threadSelector->setSelectedId(numThreads, dontSendNotification);
+  ((StimDetector*)getProcessor())->setParameter(7, (float)numThreads);
+
   forEachXmlChildElement(*xml, xmlNode)
   {
     if (xmlNode->hasTagName("STIMDETECTOR"))
@@ -244,6 +290,29 @@ void StimDetectorEditor::loadCustomParameters(XmlElement* xml)
       interfaces[i]->setInputChan(xmlNode->getIntAttribute("INPUT"));
       interfaces[i]->setOutputChan(xmlNode->getIntAttribute("OUTPUT"));
       interfaces[i]->setThreshold(xmlNode->getDoubleAttribute("THRESHOLD"));
+      interfaces[i]->setPreTrigger(xmlNode->getDoubleAttribute("PRE", 0));
+      interfaces[i]->setDiffChannel(xmlNode->getBoolAttribute("DIFF_CHANNEL", false));
+
+      // learned templates are not saved, only how the next one is matched
+      StimDetector* processor = (StimDetector*)getProcessor();
+      processor->setActiveModule(i);
+      processor->setParameter(10, (float)xmlNode->getDoubleAttribute("MATCH", 0.8));
+      processor->setParameter(9, (float)xmlNode->getDoubleAttribute("TEMPLATE_MS", 2));
+
+      DifferentiatorSettings differentiator;
+      differentiator.type = (DifferentiatorSettings::Type)jlimit(0, 3, xmlNode->getIntAttribute("DIFF_TYPE", 0));
+      differentiator.length = jlimit(3, 63, xmlNode->getIntAttribute("DIFF_LENGTH", 7));
+      differentiator.order = jlimit(1, differentiator.length - 1, xmlNode->getIntAttribute("DIFF_ORDER", 2));
+      differentiator.cutoff = jlimit(0.05, 1.0, xmlNode->getDoubleAttribute("DIFF_CUTOFF", 0.5));
+      processor->setDifferentiator(i, differentiator);
+
+      PrefilterSettings prefilter;
+      prefilter.type = (PrefilterSettings::Type)jlimit(0, 3, xmlNode->getIntAttribute("FILTER_TYPE", 0));
+      prefilter.lowHz = jlimit(0.1, 10000.0, xmlNode->getDoubleAttribute("FILTER_LOW", 1));
+      prefilter.highHz = jlimit(prefilter.lowHz, 20000.0, xmlNode->getDoubleAttribute("FILTER_HIGH", 1000));
+      prefilter.q = jlimit(0.5, 100.0, xmlNode->getDoubleAttribute("FILTER_Q", 30));
+      prefilter.order = jlimit(2, 8, xmlNode->getIntAttribute("FILTER_ORDER", 2)) & ~1;
+      processor->setPrefilter(i, prefilter);
       i++;
     }
   }
@@ -258,6 +327,7 @@ DetectorInterface::DetectorInterface(StimDetector* pd, Colour c, int id) :
   /* set Bounds relative to (10,50,190,80) */
 
   lastThresholdString = "100";
+  lastPreTriggerString = "0";
 
   font = Font("Small Text", 10, Font::plain);
 
@@ -295,11 +365,18 @@ DetectorInterface::DetectorInterface(StimDetector* pd, Colour c, int id) :
 
   applyDiff = new UtilityButton("Diff", Font("Default", 10, Font::plain));
   applyDiff->addListener(this);
-  applyDiff->setBounds(10, 55, 60, 20);
+  applyDiff->setBounds(10, 55, 30, 20);
   applyDiff->setClickingTogglesState(true);
   applyDiff->setTooltip("When this button is off, selected channels will do not show differentiation");
   addAndMakeVisible(applyDiff);
 
+  diffChannel = new UtilityButton("+Ch", Font("Default", 10, Font::plain));
+  diffChannel->addListener(this);
+  diffChannel->setBounds(42, 55, 30, 20);
+  diffChannel->setClickingTogglesState(true);
+  diffChannel->setTooltip("Add a channel with the differentiated input, keeping the input raw for recording");
+  addAndMakeVisible(diffChannel);
+
   std::cout << "Updating channels" << std::endl;
 
   updateChannels(processor->getNumInputs());
@@ -323,6 +400,22 @@ DetectorInterface::DetectorInterface(StimDetector* pd, Colour c, int id) :
   thresholdValue->setTooltip("Set the threshold of detection");
   addAndMakeVisible(thresholdValue);
 
+  preTriggerLabel = new Label("pre-trigger label", "Pre ms");
+  preTriggerLabel->setBounds(72, 10, 45, 20);
+  preTriggerLabel->setFont(Font("Small Text", 10, Font::plain));
+  preTriggerLabel->setColour(Label::textColourId, Colours::darkgrey);
+  addAndMakeVisible(preTriggerLabel);
+
+  preTriggerValue = new Label("pre-trigger value", lastPreTriggerString);
+  preTriggerValue->setBounds(77, 28, 35, 18);
+  preTriggerValue->setFont(Font("Default", 15, Font::plain));
+  preTriggerValue->setColour(Label::textColourId, Colours::white);
+  preTriggerValue->setColour(Label::backgroundColourId, Colours::grey);
+  preTriggerValue->setEditable(true);
+  preTriggerValue->addListener(this);
+  preTriggerValue->setTooltip("Set the history kept before the trigger, in ms (0 to 100)");
+  addAndMakeVisible(preTriggerValue);
+
 
 
   std::cout << "Updating processor" << std::endl;
@@ -372,6 +465,14 @@ void DetectorInterface::buttonClicked(Button* button)
     processor->setActiveModule(idNum);
     processor->setParameter(1, (float)applyDiff->getToggleState() ? 1 : 0 );
   }
+  else if (button == diffChannel)
+  {
+    processor->setActiveModule(idNum);
+    processor->setParameter(11, diffChannel->getToggleState() ? 1.0f : 0.0f);
+
+    // the derived channel is declared with the signal chain
+    CoreServices::updateSignalChain(processor->getEditor());
+  }
 }
 
 void DetectorInterface::labelTextChanged(Label* label)
@@ -379,6 +480,32 @@ void DetectorInterface::labelTextChanged(Label* label)
   Value val = label->getTextValue();
   double requestedValue = double(val.getValue());
 
+  if (label == preTriggerValue)
+  {
+    // updateSignalChain reallocates the bank the audio thread is using
+    if (CoreServices::getAcquisitionStatus())
+    {
+      CoreServices::sendStatusMessage("Stop acquisition to change the pre-trigger.");
+      label->setText(lastPreTriggerString, dontSendNotification);
+      return;
+    }
+
+    if (requestedValue < 0 || requestedValue > 100)
+    {
+      CoreServices::sendStatusMessage("Value out of range.");
+      label->setText(lastPreTriggerString, dontSendNotification);
+      return;
+    }
+
+    processor->setActiveModule(idNum);
+    processor->setParameter(8, requestedValue);
+    lastPreTriggerString = label->getText();
+
+    // the window and history are resized with the signal chain
+    CoreServices::updateSignalChain(processor->getEditor());
+    return;
+  }
+
   std::cout << "threshold=" << requestedValue << std::endl;
 
   if (requestedValue < 0.01 || requestedValue > 10000)
@@ -395,11 +522,11 @@ void DetectorInterface::labelTextChanged(Label* label)
 
   if (label == thresholdValue)
   {
+    processor->setActiveModule(idNum);
     double val = processor->getThresholdValueForActiveModule();
 
     if (requestedValue != val)
     {
-      processor->setActiveModule(idNum);
       processor->setParameter(5, requestedValue);
     }
 
@@ -479,6 +606,31 @@ int DetectorInterface::getGateChan()
   return gateSelector->getSelectedId() - 2;
 }
 
+void DetectorInterface::setPreTrigger(double value)
+{
+  preTriggerValue->setText(String(value), dontSendNotification);
+  lastPreTriggerString = preTriggerValue->getText();
+  processor->setActiveModule(idNum);
+  processor->setParameter(8, (float)value);
+}
+
+void DetectorInterface::setDiffChannel(bool enabled)
+{
+  diffChannel->setToggleState(enabled, dontSendNotification);
+  processor->setActiveModule(idNum);
+  processor->setParameter(11, enabled ? 1.0f : 0.0f);
+}
+
+bool DetectorInterface::getDiffChannel()
+{
+  return diffChannel->getToggleState();
+}
+
+double DetectorInterface::getPreTrigger()
+{
+  return (double) preTriggerValue->getTextValue().getValue();
+}
+
 double DetectorInterface::getThreshold()
 {
   return (double) thresholdValue->getTextValue().getValue();
@@ -487,4 +639,6 @@ double DetectorInterface::getThreshold()
 void DetectorInterface::setEnableStatus(bool status)
 {
   inputSelector->setEnabled(status);
+  diffChannel->setEnabled(status);
+  preTriggerValue->setEnabled(status); // resizes the bank through the signal chain
 }
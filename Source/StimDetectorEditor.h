@@ -74,6 +74,7 @@ namespace StimDetectorSpace {
   private:
 
     ScopedPointer<ComboBox> detectorSelector;
+    ScopedPointer<ComboBox> threadSelector;
     ScopedPointer<UtilityButton> plusButton;
 
     void addDetector();
@@ -116,11 +117,15 @@ namespace StimDetectorSpace {
     void setOutputChan(int);
     void setGateChan(int);
     void setThreshold(double);
+    void setPreTrigger(double);
+    void setDiffChannel(bool);
 
     int getInputChan();
     int getOutputChan();
     int getGateChan();
     double getThreshold();
+    double getPreTrigger();
+    bool getDiffChannel();
 
     void setEnableStatus(bool status);
 
@@ -133,15 +138,20 @@ namespace StimDetectorSpace {
     int idNum;
 
     String lastThresholdString;
+    String lastPreTriggerString;
 
     ScopedPointer<ComboBox> inputSelector;
     ScopedPointer<ComboBox> gateSelector;
     ScopedPointer<ComboBox> outputSelector;
 
     ScopedPointer<UtilityButton> applyDiff;
+    ScopedPointer<UtilityButton> diffChannel;
 
     ScopedPointer<Label> thresholdLabel;
     ScopedPointer<Label> thresholdValue;
+
+    ScopedPointer<Label> preTriggerLabel;
+    ScopedPointer<Label> preTriggerValue;
   };
 
 }
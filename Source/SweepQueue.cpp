@@ -0,0 +1,92 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SweepQueue.h"
+
+using namespace StimDetectorSpace;
+
+SweepQueue::SweepQueue(int numSlots)
+  : fifo      (numSlots)
+  , maxLength (-1)
+{
+  for (int i = 0; i < numSlots; i++)
+    slots.add(new Sweep());
+}
+
+SweepQueue::~SweepQueue()
+{
+}
+
+void SweepQueue::prepare(int newMaxLength)
+{
+  reset();
+
+  if (newMaxLength == maxLength)
+    return;
+
+  maxLength = newMaxLength;
+
+  for (int i = 0; i < slots.size(); i++)
+  {
+    Sweep* s = slots[i];
+    s->length = 0;
+    s->stim.calloc(jmax(1, maxLength));
+  }
+}
+
+void SweepQueue::reset()
+{
+  fifo.reset();
+  numDropped.set(0);
+}
+
+SweepQueue::Sweep* SweepQueue::beginWrite()
+{
+  int start1, size1, start2, size2;
+  fifo.prepareToWrite(1, start1, size1, start2, size2);
+
+  if (size1 == 0)
+  {
+    ++numDropped;
+    return nullptr;
+  }
+
+  return slots[start1];
+}
+
+void SweepQueue::finishWrite()
+{
+  fifo.finishedWrite(1);
+}
+
+const SweepQueue::Sweep* SweepQueue::beginRead()
+{
+  int start1, size1, start2, size2;
+  fifo.prepareToRead(1, start1, size1, start2, size2);
+
+  return size1 > 0 ? slots[start1] : nullptr;
+}
+
+void SweepQueue::finishRead()
+{
+  fifo.finishedRead(1);
+}
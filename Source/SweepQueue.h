@@ -0,0 +1,91 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __SWEEPQUEUE_H_DEFINED
+#define __SWEEPQUEUE_H_DEFINED
+
+#include <ProcessorHeaders.h>
+
+namespace StimDetectorSpace {
+
+  /**
+
+    Lock-free single-producer/single-consumer queue of finished sweeps.
+
+    Every slot is allocated up front by prepare(); the audio thread copies a
+    closed window into a free slot and the analysis thread reads it back.
+    When the queue is full the sweep is dropped instead of blocking.
+
+    @see StimDetector
+  */
+  class SweepQueue
+  {
+  public:
+    struct Sweep
+    {
+      int module;                   //detector module index
+      int count;                    //avg count when the window closed
+      int activeRow;                //avg row the sweep belongs to
+      int length;                   //valid samples in stim
+      int preLength;                //samples before the trigger at the start of stim
+      bool gated;                   //the window was started by the gate
+      bool gateAligned;             //a trigger candidate followed the gate inside the window
+      int64 gateError;              //first candidate minus gate timestamp, in samples
+      int64 startTimestamp;         //timestamp of stim[0], one sample per index
+
+      HeapBlock<double> stim;       //original stim
+    };
+
+    SweepQueue (int numSlots);
+    ~SweepQueue();
+
+    /** Allocates every slot for sweeps of up to maxLength samples. Not real-time safe. */
+    void prepare (int maxLength);
+    void reset();
+
+    int getMaxLength() const { return maxLength; }
+
+    /** Producer side: returns a free slot, or nullptr if the queue is full. */
+    Sweep* beginWrite();
+    void finishWrite();
+
+    /** Consumer side: returns the oldest finished sweep, or nullptr if there is none. */
+    const Sweep* beginRead();
+    void finishRead();
+
+    /** Sweeps lost because the queue was full since the last reset(). */
+    int getNumDropped() const { return numDropped.get(); }
+
+  private:
+    AbstractFifo fifo;
+    OwnedArray<Sweep> slots;
+    int maxLength;
+
+    Atomic<int> numDropped;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SweepQueue);
+  };
+
+}
+
+#endif  // __SWEEPQUEUE_H_DEFINED
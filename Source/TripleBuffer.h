@@ -0,0 +1,82 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __TRIPLEBUFFER_H_DEFINED
+#define __TRIPLEBUFFER_H_DEFINED
+
+#include <ProcessorHeaders.h>
+
+namespace StimDetectorSpace {
+
+  /**
+
+    Lock-free triple buffer for handing whole objects from one writer to one reader.
+
+    The writer fills getWriteBuffer() and calls publish(); the reader calls update()
+    and then uses getReadBuffer() until its next update(). Neither side ever waits,
+    and each side only touches a buffer the other one cannot reach, so the writer
+    is free to resize its buffer.
+  */
+  template <typename Type>
+  class TripleBuffer
+  {
+  public:
+    TripleBuffer() : writeIndex (0), readIndex (1), state (2) {}
+
+    /** Writer side: the buffer being prepared. */
+    Type& getWriteBuffer() { return buffers[writeIndex]; }
+
+    /** Writer side: makes the write buffer the latest one and takes back a free one. */
+    void publish()
+    {
+      writeIndex = state.exchange (writeIndex | newDataBit) & indexMask;
+    }
+
+    /** Reader side: picks up the latest published buffer. Returns false if nothing
+        was published since the last call. */
+    bool update()
+    {
+      if ((state.get() & newDataBit) == 0)
+        return false;
+
+      readIndex = state.exchange (readIndex) & indexMask;
+      return true;
+    }
+
+    /** Reader side: the buffer picked up by the last update(). */
+    const Type& getReadBuffer() const { return buffers[readIndex]; }
+
+  private:
+    enum { indexMask = 3, newDataBit = 4 };
+
+    Type buffers[3];
+    int writeIndex;
+    int readIndex;
+    Atomic<int> state;   //index of the buffer in the middle, plus newDataBit
+
+    JUCE_DECLARE_NON_COPYABLE (TripleBuffer);
+  };
+
+}
+
+#endif  // __TRIPLEBUFFER_H_DEFINED
@@ -0,0 +1,186 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "WorkerPool.h"
+#include "TraceRecorder.h"
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  inline int64 packRange (int next, int end)  { return ((int64) end << 32) | (uint32) next; }
+  inline int rangeNext (int64 range)          { return (int) (uint32) range; }
+  inline int rangeEnd (int64 range)           { return (int) (range >> 32); }
+}
+
+WorkerPool::WorkerPool(int numThreads)
+  : job (nullptr)
+{
+  numThreads = jmax(1, numThreads);
+
+  for (int i = 0; i < numThreads; i++)
+    lanes.add(new Lane());
+
+  // participant 0 is the caller of run()
+  for (int i = 1; i < numThreads; i++)
+  {
+    Worker* w = new Worker(*this, i);
+    workers.add(w);
+    w->startThread(Thread::realtimeAudioPriority);
+  }
+}
+
+WorkerPool::~WorkerPool()
+{
+  for (int i = 0; i < workers.size(); i++)
+  {
+    workers[i]->signalThreadShouldExit();
+    workers[i]->wake.signal();
+  }
+
+  for (int i = 0; i < workers.size(); i++)
+    workers[i]->stopThread(1000);
+}
+
+void WorkerPool::run(Job& newJob, int numItems)
+{
+  if (numItems <= 0)
+    return;
+
+  const int numLanes = lanes.size();
+
+  // the job is set before the ranges, so an item taken from these ranges always sees it
+  job.set(&newJob);
+  done.reset();
+  remaining.set(numItems);
+
+  for (int i = 0; i < numLanes; i++)
+  {
+    const int begin = (int) ((int64) numItems * i / numLanes);
+    const int end = (int) ((int64) numItems * (i + 1) / numLanes);
+    lanes[i]->range.set(packRange(begin, end));
+  }
+
+  for (int i = 0; i < workers.size(); i++)
+    workers[i]->wake.signal();
+
+  work(0);
+
+  // every item is claimed now; the ones still running on workers are usually
+  // short, but a worker descheduled in the middle of one must not keep the caller spinning
+  for (int spin = 0; remaining.get() > 0; spin++)
+  {
+    if (spin < maxSpins)
+      Thread::yield();
+    else
+      done.wait(1);
+  }
+}
+
+bool WorkerPool::takeFront(int lane, int& item)
+{
+  Atomic<int64>& range = lanes[lane]->range;
+
+  for (;;)
+  {
+    const int64 current = range.get();
+    const int next = rangeNext(current);
+    const int end = rangeEnd(current);
+
+    if (next >= end)
+      return false;
+
+    if (range.compareAndSetBool(packRange(next + 1, end), current))
+    {
+      item = next;
+      return true;
+    }
+  }
+}
+
+bool WorkerPool::takeBack(int lane, int& item)
+{
+  Atomic<int64>& range = lanes[lane]->range;
+
+  for (;;)
+  {
+    const int64 current = range.get();
+    const int next = rangeNext(current);
+    const int end = rangeEnd(current);
+
+    if (next >= end)
+      return false;
+
+    if (range.compareAndSetBool(packRange(next, end - 1), current))
+    {
+      item = end - 1;
+      return true;
+    }
+  }
+}
+
+void WorkerPool::work(int participant)
+{
+  const int numLanes = lanes.size();
+
+  for (;;)
+  {
+    int item = -1;
+    bool found = takeFront(participant, item);
+
+    // own range is empty, steal from the others
+    for (int k = 1; !found && k < numLanes; k++)
+      found = takeBack((participant + k) % numLanes, item);
+
+    if (!found)
+      return;
+
+    job.get()->process(item, participant);
+
+    if (--remaining == 0)
+      done.signal();
+  }
+}
+
+// ===================================================================
+
+WorkerPool::Worker::Worker(WorkerPool& p, int i)
+  : Thread ("Stim Detector Worker " + String(i))
+  , pool (p)
+  , index (i)
+{
+}
+
+void WorkerPool::Worker::run()
+{
+  SD_TRACE_THREAD("worker");
+
+  while (!threadShouldExit())
+  {
+    wake.wait(-1);
+
+    if (threadShouldExit())
+      return;
+
+    pool.work(index);
+  }
+}
@@ -0,0 +1,102 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __WORKERPOOL_H_DEFINED
+#define __WORKERPOOL_H_DEFINED
+
+#include <ProcessorHeaders.h>
+
+namespace StimDetectorSpace {
+
+  /**
+
+    Persistent pool of threads that splits a batch of independent items between
+    the calling thread and its workers.
+
+    Each participant starts on its own contiguous range of items and, once that is
+    empty, steals from the back of the others' ranges, so the caller takes every
+    item a worker has not claimed yet. run() returns when every item is done,
+    spinning briefly on the ones still running and then sleeping until the last
+    one finishes. Nothing is allocated after construction.
+
+    @see StimDetector
+  */
+  class WorkerPool
+  {
+  public:
+    class Job
+    {
+    public:
+      virtual ~Job() {}
+
+      /** Called once per item, from the thread of participant worker (0 is the caller). */
+      virtual void process (int item, int worker) = 0;
+    };
+
+    /** Creates numThreads - 1 workers; the thread calling run() is the last participant. */
+    WorkerPool (int numThreads);
+    ~WorkerPool();
+
+    int getNumThreads() const { return lanes.size(); }
+
+    /** Runs job.process() for every item in [0, numItems) and waits for all of them. */
+    void run (Job& job, int numItems);
+
+  private:
+    class Worker : public Thread
+    {
+    public:
+      Worker (WorkerPool& pool, int index);
+      void run() override;
+
+      WaitableEvent wake;
+
+    private:
+      WorkerPool& pool;
+      int index;
+    };
+
+    struct Lane
+    {
+      Atomic<int64> range;    //next item in the low 32 bits, end of the range in the high ones
+    };
+
+    bool takeFront (int lane, int& item);
+    bool takeBack (int lane, int& item);
+    void work (int participant);
+
+    OwnedArray<Lane> lanes;
+    OwnedArray<Worker> workers;
+
+    Atomic<Job*> job;
+    Atomic<int> remaining;      //items of the current run not finished yet
+    WaitableEvent done;         //signalled by whoever finishes the last item of a run
+
+    enum { maxSpins = 64 };     //yields of the caller before it sleeps on done
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WorkerPool);
+  };
+
+}
+
+#endif  // __WORKERPOOL_H_DEFINED
@@ -0,0 +1,208 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Runs the diff threshold detector of the original plugin, ported sample for
+  sample from its process() loop, next to DetectorEngine over the same signal
+  and requires the same TTL edges and the same windows at every buffer size.
+*/
+
+#include "DetectorEngine.h"
+#include "SignalGenerator.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  struct Trace
+  {
+    std::vector<int64_t> ttlOn;         //sample of each rising TTL edge
+    std::vector<int64_t> ttlOff;
+    std::vector<int64_t> windowStarts;
+  };
+
+  /** The per-sample loop of the original process(), gate disabled, state as addModule() set it. */
+  Trace runBaseline (const std::vector<float>& signal, double threshold, int ttlLength, int avgLength)
+  {
+    Trace trace;
+
+    float lastSample = 0.0f;
+    float lastDiff = 0.0f;
+    int samplesSinceTrigger = 5000;
+    bool wasTriggered = false;
+    bool startStim = false;
+    int startIndex = -1;
+    int windowIndex = -1;
+
+    for (int64_t i = 0; i < (int64_t) signal.size(); ++i)
+    {
+      const float sample = signal[(size_t) i];
+      const float diffSample = std::fabs (sample - lastSample);
+      const bool ignoreFirst = i == 0;
+
+      if (diffSample > lastDiff && diffSample > threshold && diffSample < 5 * threshold && !startStim && !ignoreFirst)
+      {
+        trace.ttlOn.push_back (i);
+        samplesSinceTrigger = 0;
+        wasTriggered = true;
+        startStim = true;
+
+        startIndex = (int) i;
+        windowIndex = 0;
+      }
+
+      if (wasTriggered)
+      {
+        if (samplesSinceTrigger > ttlLength)
+        {
+          trace.ttlOff.push_back (i);
+          wasTriggered = false;
+        }
+        else
+        {
+          samplesSinceTrigger++;
+        }
+      }
+
+      if (startIndex >= 0 && windowIndex < avgLength)
+      {
+        windowIndex++;
+      }
+      else
+      {
+        if (startStim)
+          trace.windowStarts.push_back (i - avgLength);
+
+        startIndex = -1;
+        windowIndex = -1;
+        startStim = false;
+      }
+
+      lastSample = sample;
+      lastDiff = diffSample;
+    }
+
+    return trace;
+  }
+
+  class WindowRecorder : public WindowSink
+  {
+  public:
+    WindowRecorder (DetectorBank& b) : bank (b) {}
+    void windowClosed (int d) override { starts.push_back (bank.windowStart[d]); }
+
+    DetectorBank& bank;
+    std::vector<int64_t> starts;
+  };
+
+  Trace runEngine (const std::vector<float>& signal, double threshold, int ttlLength, int avgLength, int bufferSize)
+  {
+    DetectorBank bank;
+    DetectorEngine engine (bank);
+    bank.prepare (1, avgLength, 0);
+    bank.threshold[0] = threshold;
+    bank.outputChan[0] = 0;
+    bank.windowLength[0] = avgLength;
+    bank.ttlLength[0] = ttlLength;
+
+    const int d = 0;
+    DetectorEngine::Scratch scratch;
+    TtlEventBuffer events;
+    WindowRecorder sink (bank);
+    Trace trace;
+
+    for (size_t pos = 0; pos < signal.size(); pos += (size_t) bufferSize)
+    {
+      const int n = (int) std::min (signal.size() - pos, (size_t) bufferSize);
+      engine.processChannel (&d, 1, signal.data() + pos, n, (int64_t) pos, scratch, events, sink, nullptr);
+
+      for (const TtlEvent& event : events)
+        (event.ttlData != 0 ? trace.ttlOn : trace.ttlOff).push_back (event.timestamp);
+      events.clear();
+    }
+
+    SD_CHECK (events.getNumDropped() == 0);
+    std::sort (sink.starts.begin(), sink.starts.end());
+    trace.windowStarts = sink.starts;
+    return trace;
+  }
+
+  /** Noise, jittered artifacts and responses; at 40 stims/s the 40 ms windows
+      swallow some stims, and the lower thresholds put some artifacts past 5 * threshold. */
+  std::vector<float> makeSignal (double stimRate, uint64_t seed, int seconds)
+  {
+    SynthSettings settings;
+    settings.numChannels = 1;
+    settings.seed = seed;
+    settings.jitter = 20;
+    settings.stimRate = stimRate;
+
+    std::vector<float> signal ((size_t) (settings.sampleRate * seconds));
+    std::vector<SynthStim> stims;
+    float* channels[] = { signal.data() };
+    SignalGenerator (settings).generate (channels, (int) signal.size(), stims);
+    return signal;
+  }
+}
+
+int main()
+{
+  const double sampleRate = SynthSettings().sampleRate;
+  const int ttlLength = (int) std::ceil (sampleRate * 0.005);
+  const int avgLength = (int) std::ceil (sampleRate * 0.040);
+
+  const double stimRates[] = { 10, 40 };
+  const double thresholds[] = { 30, 100, 200 };
+  const int bufferSizes[] = { 1024, 1500, 333, 64 };
+
+  int numTriggers = 0;
+
+  for (double stimRate : stimRates)
+  {
+    const std::vector<float> signal = makeSignal (stimRate, 11, 5);
+
+    for (double threshold : thresholds)
+    {
+      const Trace reference = runBaseline (signal, threshold, ttlLength, avgLength);
+      numTriggers += (int) reference.ttlOn.size();
+
+      for (int bufferSize : bufferSizes)
+      {
+        const Trace trace = runEngine (signal, threshold, ttlLength, avgLength, bufferSize);
+
+        SD_CHECK (trace.ttlOn == reference.ttlOn);
+        SD_CHECK (trace.ttlOff == reference.ttlOff);
+        SD_CHECK (trace.windowStarts == reference.windowStarts);
+      }
+    }
+  }
+
+  // the comparison is not vacuous
+  SD_CHECK (numTriggers > 100);
+
+  return finishTest ("BaselineEquivalence");
+}
@@ -0,0 +1,226 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Runs the same detectors over the same synthetic recording with every kernel
+  implementation this CPU supports and requires the scalar results: the same
+  TTL events, the same trigger diff and the same captured windows.
+*/
+
+#include "DetectorEngine.h"
+#include "Differentiator.h"
+#include "SignalGenerator.h"
+#include "StimDetectorKernels.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  const int numDetectors = 4;
+
+  struct Window
+  {
+    int detector;
+    int64_t start;
+    double sum;                 //of every captured sample
+  };
+
+  class WindowRecorder : public WindowSink
+  {
+  public:
+    WindowRecorder (DetectorBank& b) : bank (b) {}
+
+    void windowClosed (int d) override
+    {
+      double sum = 0;
+      for (int w = 0; w < bank.windowLength[d]; w++)
+        sum += bank.getStim (d)[w];
+
+      const Window window = { d, bank.windowStart[d], sum };
+      windows.push_back (window);
+    }
+
+    DetectorBank& bank;
+    std::vector<Window> windows;
+  };
+
+  struct Result
+  {
+    std::vector<TtlEvent> events;
+    std::vector<float> diff;
+    std::vector<Window> windows;
+  };
+
+  /** Four detectors on one channel: two sharing the first difference, one with a
+      pre-trigger history and one on a Savitzky-Golay derivative. */
+  Result run (const std::vector<float>& signal, double sampleRate, int bufferSize)
+  {
+    const int avgLength = (int) std::ceil (sampleRate * 0.040);
+    const int preLength = (int) std::ceil (sampleRate * 0.002);
+
+    DifferentiatorSettings settings;
+    settings.type = DifferentiatorSettings::savitzkyGolay;
+    settings.length = 7;
+    settings.order = 2;
+    Differentiator differentiator (settings, Kernels::blockSize);
+
+    DetectorBank bank;
+    DetectorEngine engine (bank);
+    bank.prepare (numDetectors, preLength + avgLength, preLength + DifferentiatorSettings::maxLength / 2);
+
+    const double thresholds[numDetectors] = { 200, 150, 200, 100 };
+    for (int d = 0; d < numDetectors; d++)
+    {
+      bank.threshold[d] = thresholds[d];
+      bank.outputChan[d] = d;
+      bank.windowLength[d] = avgLength;
+      bank.ttlLength[d] = (int) std::ceil (sampleRate * 0.005);
+    }
+    bank.windowLength[2] = preLength + avgLength;
+    bank.preLength[2] = preLength;
+    bank.differentiator[3] = &differentiator;
+
+    const int detectors[numDetectors] = { 0, 1, 2, 3 };
+    DetectorEngine::Scratch scratch;
+    TtlEventBuffer events;
+    WindowRecorder sink (bank);
+
+    Result result;
+    result.diff.resize (signal.size());
+
+    for (size_t pos = 0; pos < signal.size(); pos += (size_t) bufferSize)
+    {
+      const int n = (int) std::min (signal.size() - pos, (size_t) bufferSize);
+      engine.processChannel (detectors, numDetectors, signal.data() + pos, n, (int64_t) pos,
+                             scratch, events, sink, result.diff.data() + pos);
+
+      result.events.insert (result.events.end(), events.begin(), events.end());
+      events.clear();
+    }
+
+    SD_CHECK (events.getNumDropped() == 0);
+    result.windows = sink.windows;
+    return result;
+  }
+
+  /** Events are in processing order, detector by detector within a block, so they are
+      compared per detector. sampleNum is relative to the buffer; the timestamps carry over
+      between buffer sizes. */
+  bool sameEvents (const std::vector<TtlEvent>& a, const std::vector<TtlEvent>& b)
+  {
+    if (a.size() != b.size())
+      return false;
+
+    for (int d = 0; d < numDetectors; d++)
+    {
+      std::vector<const TtlEvent*> ofA, ofB;
+      for (size_t i = 0; i < a.size(); i++)
+      {
+        if (a[i].detector == d)
+          ofA.push_back (&a[i]);
+        if (b[i].detector == d)
+          ofB.push_back (&b[i]);
+      }
+
+      if (ofA.size() != ofB.size())
+        return false;
+
+      for (size_t i = 0; i < ofA.size(); i++)
+        if (ofA[i]->timestamp != ofB[i]->timestamp || ofA[i]->channel != ofB[i]->channel || ofA[i]->ttlData != ofB[i]->ttlData)
+          return false;
+    }
+
+    return true;
+  }
+
+  /** Windows close in processing order too; compared sorted by detector and start. */
+  bool sameWindows (std::vector<Window> a, std::vector<Window> b)
+  {
+    if (a.size() != b.size())
+      return false;
+
+    const auto earlier = [] (const Window& x, const Window& y)
+    {
+      return x.detector != y.detector ? x.detector < y.detector : x.start < y.start;
+    };
+    std::sort (a.begin(), a.end(), earlier);
+    std::sort (b.begin(), b.end(), earlier);
+
+    for (size_t i = 0; i < a.size(); i++)
+      if (a[i].detector != b[i].detector || a[i].start != b[i].start || a[i].sum != b[i].sum)
+        return false;
+
+    return true;
+  }
+}
+
+int main()
+{
+  SynthSettings settings;
+  settings.numChannels = 1;
+  settings.seed = 7;
+  settings.jitter = 20;
+
+  const int numSamples = (int) settings.sampleRate * 5;
+  std::vector<float> signal (numSamples);
+  std::vector<SynthStim> stims;
+  float* channels[] = { signal.data() };
+  SignalGenerator (settings).generate (channels, numSamples, stims);
+
+  const char* implementations[] = { "scalar", "sse2", "avx2" };
+  const int bufferSizes[] = { 1024, 1500, 333 };
+
+  SD_CHECK (Kernels::selectImplementation ("scalar"));
+  const Result reference = run (signal, settings.sampleRate, bufferSizes[0]);
+
+  // each detector triggers on every stim, so the comparison is not vacuous
+  int numTriggers = 0;
+  for (const TtlEvent& event : reference.events)
+    numTriggers += event.ttlData != 0;
+  SD_CHECK (numTriggers >= 4 * (int) stims.size() - 4);
+  SD_CHECK (!reference.windows.empty());
+
+  for (const char* name : implementations)
+  {
+    if (!Kernels::selectImplementation (name))
+    {
+      std::printf ("%s kernels not supported here, skipped\n", name);
+      continue;
+    }
+
+    for (int bufferSize : bufferSizes)
+    {
+      const Result result = run (signal, settings.sampleRate, bufferSize);
+
+      SD_CHECK (sameEvents (result.events, reference.events));
+      SD_CHECK (result.diff == reference.diff);
+      SD_CHECK (sameWindows (result.windows, reference.windows));
+    }
+  }
+
+  return finishTest ("KernelEquivalence");
+}
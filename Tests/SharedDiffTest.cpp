@@ -0,0 +1,149 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Detectors that read the same input channel share its first difference. A
+  prefiltered detector among them detects on its own filtered diff, which must
+  not leak into the shared one: the unfiltered detectors have to trigger, and
+  the trigger diff output has to read, exactly as if each ran alone.
+*/
+
+#include "DetectorEngine.h"
+#include "Prefilter.h"
+#include "SignalGenerator.h"
+#include "StimDetectorKernels.h"
+#include "TestCheck.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  class NullSink : public WindowSink
+  {
+  public:
+    void windowClosed (int) override {}
+  };
+
+  const double sampleRate = 30000;
+  const int numDetectors = 3;
+  const double thresholds[numDetectors] = { 200, 60, 150 };
+
+  /** Runs detectors[0 .. numUsed) of a bank where detector 1 is band-passed, and returns
+      the triggers of each detector; diff receives the trigger diff output unless it is null. */
+  void run (const std::vector<float>& signal, const int* detectors, int numUsed,
+            std::vector<std::vector<int64_t>>& triggers, std::vector<float>* diff)
+  {
+    PrefilterSettings settings;
+    settings.type = PrefilterSettings::bandPass;
+    settings.lowHz = 1;
+    settings.highHz = 200;
+    settings.order = 4;
+    Prefilter prefilter (settings, sampleRate);
+
+    DetectorBank bank;
+    DetectorEngine engine (bank);
+    const int avgLength = (int) std::ceil (sampleRate * 0.040);
+    bank.prepare (numDetectors, avgLength, 0);
+
+    for (int d = 0; d < numDetectors; d++)
+    {
+      bank.threshold[d] = thresholds[d];
+      bank.outputChan[d] = d;
+      bank.windowLength[d] = avgLength;
+      bank.ttlLength[d] = (int) std::ceil (sampleRate * 0.005);
+    }
+    bank.prefilter[1] = &prefilter;
+
+    DetectorEngine::Scratch scratch;
+    TtlEventBuffer events;
+    NullSink sink;
+
+    triggers.assign (numDetectors, std::vector<int64_t>());
+    if (diff != nullptr)
+      diff->assign (signal.size(), 0.0f);
+
+    const int bufferSize = 1000;
+    for (size_t pos = 0; pos < signal.size(); pos += bufferSize)
+    {
+      const int n = (int) std::min (signal.size() - pos, (size_t) bufferSize);
+      engine.processChannel (detectors, numUsed, signal.data() + pos, n, (int64_t) pos,
+                             scratch, events, sink, diff != nullptr ? diff->data() + pos : nullptr);
+
+      for (const TtlEvent& event : events)
+        if (event.ttlData != 0)
+          triggers[event.detector].push_back (event.timestamp);
+      events.clear();
+    }
+  }
+}
+
+int main()
+{
+  SynthSettings settings;
+  settings.numChannels = 1;
+  settings.sampleRate = sampleRate;
+  settings.seed = 3;
+
+  // a slow drift under the stims, so the band-passed diff differs from the raw one
+  const int numSamples = (int) sampleRate * 10;
+  std::vector<float> signal (numSamples);
+  std::vector<SynthStim> stims;
+  float* channels[] = { signal.data() };
+  SignalGenerator (settings).generate (channels, numSamples, stims);
+  for (int i = 0; i < numSamples; i++)
+    signal[i] += (float) (30 * std::sin (i * 0.01));
+
+  const int all[] = { 0, 1, 2 };   //the filtered detector between the two that share the diff
+  const int first[] = { 0 };
+  const int last[] = { 2 };
+
+  std::vector<std::vector<int64_t>> firstAlone, lastAlone;
+  run (signal, first, 1, firstAlone, nullptr);
+  run (signal, last, 1, lastAlone, nullptr);
+
+  // without an output the shared diff lives in the scratch, with one in the output channel
+  for (int withOutput = 0; withOutput < 2; withOutput++)
+  {
+    std::vector<std::vector<int64_t>> shared, ignored;
+    std::vector<float> sharedDiff, aloneDiff;
+
+    run (signal, all, 3, shared, withOutput ? &sharedDiff : nullptr);
+    SD_CHECK (shared[0] == firstAlone[0]);
+    SD_CHECK (shared[2] == lastAlone[2]);
+
+    if (withOutput)
+    {
+      run (signal, first, 1, ignored, &aloneDiff);
+      SD_CHECK (sharedDiff == aloneDiff);
+    }
+
+    // the raw detectors see every stim; the filtered one sees a different diff
+    SD_CHECK (shared[0].size() >= stims.size() - 1);
+    SD_CHECK (shared[2].size() >= stims.size() - 1);
+    SD_CHECK (shared[1] != shared[2]);
+  }
+
+  return finishTest ("SharedDiff");
+}
@@ -0,0 +1,166 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Writes a sweep archive large enough to grow the file and move its index,
+  reads every sweep back, and checks that archives with a record past the end
+  of the file are rejected when opened.
+*/
+
+#include "SweepArchive.h"
+#include "TestCheck.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  const int numSweeps = 5000;   //past the initial index capacity
+
+  SweepInfo makeInfo (int i)
+  {
+    SweepInfo info;
+    info.startTimestamp = (int64_t) i * 3000 - 60;
+    info.sampleRate = 30000;
+    info.module = i % 3;
+    info.row = i / 1000;
+    info.count = i + 1;
+    info.length = 1 + (i * 7) % 97;
+    info.preLength = info.length / 4;
+    info.flags = i % 2 == 0 ? gatedFlag : 0;
+    return info;
+  }
+
+  double makeSample (int sweep, int w)
+  {
+    return sweep * 0.5 - w * 0.25;
+  }
+
+  std::vector<char> readFile (const std::string& path)
+  {
+    std::vector<char> bytes;
+    if (FILE* f = std::fopen (path.c_str(), "rb"))
+    {
+      char buffer[65536];
+      size_t n;
+      while ((n = std::fread (buffer, 1, sizeof (buffer), f)) > 0)
+        bytes.insert (bytes.end(), buffer, buffer + n);
+      std::fclose (f);
+    }
+    return bytes;
+  }
+
+  void writeFile (const std::string& path, const std::vector<char>& bytes)
+  {
+    if (FILE* f = std::fopen (path.c_str(), "wb"))
+    {
+      std::fwrite (bytes.data(), 1, bytes.size(), f);
+      std::fclose (f);
+    }
+  }
+
+  template <typename T>
+  T readAt (const std::vector<char>& bytes, size_t offset)
+  {
+    T value;
+    std::copy (bytes.begin() + offset, bytes.begin() + offset + sizeof (T), (char*) &value);
+    return value;
+  }
+}
+
+int main (int argc, char** argv)
+{
+  const std::string path = argc > 1 ? argv[1] : "SweepArchiveTest.sda";
+
+  {
+    SweepArchiveWriter writer;
+    SD_CHECK (writer.open (path, 4096));
+
+    std::vector<double> samples;
+    for (int i = 0; i < numSweeps; i++)
+    {
+      const SweepInfo info = makeInfo (i);
+      samples.resize (info.length);
+      for (int w = 0; w < info.length; w++)
+        samples[w] = makeSample (i, w);
+      SD_CHECK (writer.append (info, samples.data()));
+    }
+
+    SD_CHECK (writer.getNumSweeps() == (uint64_t) numSweeps);
+    writer.close();
+  }
+
+  {
+    const SweepArchiveReader reader (path);
+    SD_CHECK (reader.isOpen());
+    SD_CHECK (reader.getNumSweeps() == (uint64_t) numSweeps);
+
+    int mismatches = 0;
+    for (int i = 0; reader.isOpen() && i < numSweeps; i++)
+    {
+      const SweepInfo expected = makeInfo (i);
+      const SweepInfo& info = reader.getInfo (i);
+      mismatches += info.startTimestamp != expected.startTimestamp || info.sampleRate != expected.sampleRate
+        || info.module != expected.module || info.row != expected.row || info.count != expected.count
+        || info.length != expected.length || info.preLength != expected.preLength || info.flags != expected.flags;
+
+      const float* samples = reader.getSamples (i);
+      for (int w = 0; w < info.length; w++)
+        mismatches += samples[w] != (float) makeSample (i, w);
+    }
+    SD_CHECK (mismatches == 0);
+  }
+
+  // header: numSweeps at byte 16, indexOffset at byte 24; SweepInfo::length at byte 28 of a record
+  const std::vector<char> bytes = readFile (path);
+  SD_CHECK (bytes.size() > 64);
+
+  if (bytes.size() > 64)
+  {
+    const uint64_t count = readAt<uint64_t> (bytes, 16);
+    const uint64_t indexOffset = readAt<uint64_t> (bytes, 24);
+    const size_t lastEntry = (size_t) (indexOffset + (count - 1) * sizeof (uint64_t));
+    const uint64_t lastRecord = readAt<uint64_t> (bytes, lastEntry);
+
+    const std::string corrupt = path + ".corrupt";
+
+    std::vector<char> longSweep = bytes;
+    const int32_t length = 1 << 28;
+    std::copy ((const char*) &length, (const char*) &length + sizeof (length), longSweep.begin() + (size_t) lastRecord + 28);
+    writeFile (corrupt, longSweep);
+    SD_CHECK (!SweepArchiveReader (corrupt).isOpen());
+
+    std::vector<char> pastEnd = bytes;
+    const uint64_t offset = bytes.size() - 8;
+    std::copy ((const char*) &offset, (const char*) &offset + sizeof (offset), pastEnd.begin() + lastEntry);
+    writeFile (corrupt, pastEnd);
+    SD_CHECK (!SweepArchiveReader (corrupt).isOpen());
+
+    std::remove (corrupt.c_str());
+  }
+
+  std::remove (path.c_str());
+  return finishTest ("SweepArchive");
+}
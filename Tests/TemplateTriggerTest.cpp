@@ -0,0 +1,130 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  A template detector reports a match at the last sample of the matched segment.
+  The engine dates it back by the template length, so the TTL timestamp and the
+  captured window must land on the stim the template was learned from, for any
+  buffer size and with a pre-trigger history.
+*/
+
+#include "DetectorEngine.h"
+#include "SignalGenerator.h"
+#include "StimDetectorKernels.h"
+#include "TemplateMatcher.h"
+#include "TestCheck.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  class WindowRecorder : public WindowSink
+  {
+  public:
+    WindowRecorder (DetectorBank& b) : bank (b) {}
+
+    void windowClosed (int d) override
+    {
+      triggers.push_back (bank.windowStart[d] + bank.preLength[d]);
+      firstSamples.push_back (bank.getStim (d)[bank.preLength[d]] * DetectorEngine::getStimScale());
+    }
+
+    DetectorBank& bank;
+    std::vector<int64_t> triggers;        //timestamp of window sample preLength
+    std::vector<double> firstSamples;     //input value there
+  };
+}
+
+int main()
+{
+  // identical stims on a clean baseline, so the match is exact at the stim only
+  SynthSettings settings;
+  settings.numChannels = 1;
+  settings.seed = 5;
+  settings.noise = 0;
+  settings.stimRate = 20;
+
+  const double sampleRate = settings.sampleRate;
+  const int numSamples = (int) sampleRate * 2;
+  std::vector<float> signal (numSamples);
+  std::vector<SynthStim> stims;
+  float* channels[] = { signal.data() };
+  SignalGenerator (settings).generate (channels, numSamples, stims);
+
+  const int length = (int) std::ceil (sampleRate * 0.004);
+  const int preLength = (int) std::ceil (sampleRate * 0.002);
+  const int avgLength = (int) std::ceil (sampleRate * 0.040);
+  const int64_t learned = stims[1].sample;
+
+  const int bufferSizes[] = { 1024, 1500, 333 };
+  for (int bufferSize : bufferSizes)
+  {
+    TemplateMatcher matcher (signal.data() + learned, length, Kernels::blockSize);
+
+    DetectorBank bank;
+    DetectorEngine engine (bank);
+    bank.prepare (1, preLength + avgLength, preLength + length);
+    bank.matcher[0] = &matcher;
+    bank.matchThreshold[0] = 0.99;
+    bank.outputChan[0] = 0;
+    bank.windowLength[0] = preLength + avgLength;
+    bank.preLength[0] = preLength;
+    bank.ttlLength[0] = (int) std::ceil (sampleRate * 0.005);
+
+    const int d = 0;
+    DetectorEngine::Scratch scratch;
+    TtlEventBuffer events;
+    WindowRecorder sink (bank);
+    std::vector<int64_t> triggers;
+
+    for (int pos = 0; pos < numSamples; pos += bufferSize)
+    {
+      const int n = std::min (bufferSize, numSamples - pos);
+      engine.processChannel (&d, 1, signal.data() + pos, n, pos, scratch, events, sink, nullptr);
+
+      for (const TtlEvent& event : events)
+        if (event.ttlData != 0)
+          triggers.push_back (event.timestamp);
+      events.clear();
+    }
+
+    // every stim that starts a full template in the recording, at its own sample
+    std::vector<int64_t> expected;
+    for (const SynthStim& stim : stims)
+      if (stim.sample + length <= numSamples)
+        expected.push_back (stim.sample);
+
+    SD_CHECK (triggers == expected);
+    SD_CHECK (sink.triggers.size() + 1 >= expected.size());
+
+    int misplaced = 0;
+    for (size_t i = 0; i < sink.triggers.size() && i < expected.size(); i++)
+      misplaced += sink.triggers[i] != expected[i]
+        || std::fabs (sink.firstSamples[i] - signal[(size_t) expected[i]]) > 1e-3;
+    SD_CHECK (misplaced == 0);
+  }
+
+  return finishTest ("TemplateTrigger");
+}
@@ -0,0 +1,59 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __TESTCHECK_H_DEFINED
+#define __TESTCHECK_H_DEFINED
+
+#include <cstdio>
+
+namespace StimDetectorSpace {
+
+  /** Failure count of a test executable, reported by finishTest(). */
+  inline int& getTestFailures()
+  {
+    static int failures = 0;
+    return failures;
+  }
+
+  inline void checkTest (bool ok, const char* condition, const char* file, int line)
+  {
+    if (ok)
+      return;
+
+    std::fprintf (stderr, "%s:%d: check failed: %s\n", file, line, condition);
+    getTestFailures()++;
+  }
+
+  /** Exit status of main(): 0 when every check passed. */
+  inline int finishTest (const char* name)
+  {
+    const int failures = getTestFailures();
+    std::printf ("%s: %s (%d failed)\n", name, failures == 0 ? "passed" : "FAILED", failures);
+    return failures == 0 ? 0 : 1;
+  }
+
+}
+
+#define SD_CHECK(condition) StimDetectorSpace::checkTest ((condition), #condition, __FILE__, __LINE__)
+
+#endif  // __TESTCHECK_H_DEFINED
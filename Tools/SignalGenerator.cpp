@@ -0,0 +1,205 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SignalGenerator.h"
+#include "DetectorEngine.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  inline uint64_t splitMix (uint64_t& state)
+  {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+  }
+
+  inline uint64_t xorShift (uint64_t& state)
+  {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1Dull;
+  }
+
+  // sum of four 16-bit uniforms: near gaussian, zero mean and unit variance
+  inline float gaussian (uint64_t& state)
+  {
+    const uint64_t r = xorShift (state);
+    const int sum = (int) (r & 0xFFFF) + (int) ((r >> 16) & 0xFFFF) + (int) ((r >> 32) & 0xFFFF) + (int) (r >> 48);
+    return (float) (sum - 2 * 65535) * (float) (1.7320508 / (2 * 65535));
+  }
+
+  inline double uniform (uint64_t& state)
+  {
+    return (xorShift (state) >> 11) * (1.0 / 9007199254740992.0);
+  }
+}
+
+SynthSettings::SynthSettings() :
+  numChannels (16), sampleRate (30000), seed (1),
+  noise (10), stimRate (10), jitter (0), artifact (500), artifactWidth (0.2),
+  responseMax (40), responseMin (-120), peakTime (8), latency (12), recovery (10), gainJitter (0)
+{
+}
+
+SignalGenerator::SignalGenerator (const SynthSettings& s) :
+  settings (s), position (0), stimState (0), nextStim (0), period (0)
+{
+  uint64_t seed = settings.seed;
+  channelState.resize (std::max (0, settings.numChannels));
+  for (uint64_t& state : channelState)
+    state = splitMix (seed) | 1; // xorshift needs a non-zero state
+  stimState = splitMix (seed) | 1;
+
+  const double msToSamples = settings.sampleRate / 1000;
+
+  const int phase = std::max (1, (int) std::lround (settings.artifactWidth * msToSamples));
+  artifact.assign (2 * phase, (float) settings.artifact);
+  std::fill (artifact.begin() + phase, artifact.end(), (float) -settings.artifact);
+
+  // piecewise linear: rise to the peak from half its time, fall to the trough, recover
+  const double onset = settings.peakTime / 2 * msToSamples;
+  const double peak = settings.peakTime * msToSamples;
+  const double trough = settings.latency * msToSamples;
+  const double end = trough + settings.recovery * msToSamples;
+
+  response.resize ((size_t) std::ceil (end) + 1);
+  for (size_t t = 0; t < response.size(); t++)
+  {
+    double y = 0;
+    if (t >= onset && t < peak)
+      y = settings.responseMax * (t - onset) / (peak - onset);
+    else if (t >= peak && t < trough)
+      y = settings.responseMax + (settings.responseMin - settings.responseMax) * (t - peak) / (trough - peak);
+    else if (t >= trough && t < end)
+      y = settings.responseMin * (1 - (t - trough) / (end - trough));
+    response[t] = (float) y;
+  }
+
+  if (settings.stimRate > 0)
+  {
+    period = settings.sampleRate / settings.stimRate;
+    nextStim = (int64_t) std::lround (period / 2); // leave the first half period as baseline
+  }
+}
+
+void SignalGenerator::scheduleStims (int64_t end, std::vector<SynthStim>& stims)
+{
+  if (period <= 0)
+    return;
+
+  const double scale = DetectorEngine::getStimScale();
+  const double jitterSamples = settings.jitter * settings.sampleRate / 1000;
+
+  for (; nextStim < end; nextStim += (int64_t) std::lround (period))
+  {
+    const double offset = jitterSamples * (2 * uniform (stimState) - 1);
+    const double gain = 1 + settings.gainJitter * (2 * uniform (stimState) - 1);
+    const int64_t sample = std::max (position, nextStim + (int64_t) std::lround (offset));
+
+    const Pending stim = { sample, (float) gain };
+    pending.push_back (stim);
+
+    SynthStim truth;
+    truth.sample = sample;
+    truth.gain = gain;
+    truth.yMin = gain * settings.responseMin / scale;
+    truth.yMax = gain * settings.responseMax / scale;
+    truth.latency = settings.latency;
+    truth.slope = (truth.yMax - truth.yMin) / ((settings.peakTime - settings.latency) / 1000);
+    stims.push_back (truth);
+  }
+}
+
+void SignalGenerator::addWaveforms (float* channel, int numSamples) const
+{
+  for (const Pending& stim : pending)
+  {
+    const int64_t offset = stim.sample - position;  //start of the stim in this block, may be negative
+
+    const int artifactFrom = (int) std::max<int64_t> (0, -offset);
+    const int artifactTo = (int) std::min<int64_t> ((int64_t) artifact.size(), numSamples - offset);
+    for (int t = artifactFrom; t < artifactTo; t++)
+      channel[offset + t] += artifact[t];
+
+    const int responseFrom = (int) std::max<int64_t> (0, -offset);
+    const int responseTo = (int) std::min<int64_t> ((int64_t) response.size(), numSamples - offset);
+    for (int t = responseFrom; t < responseTo; t++)
+      channel[offset + t] += stim.gain * response[t];
+  }
+}
+
+void SignalGenerator::generate (float* const* channels, int numSamples, std::vector<SynthStim>& stims)
+{
+  scheduleStims (position + numSamples, stims);
+
+  const float noise = (float) settings.noise;
+
+  for (int c = 0; c < settings.numChannels; c++)
+  {
+    float* x = channels[c];
+    uint64_t state = channelState[c];
+
+    for (int i = 0; i < numSamples; i++)
+      x[i] = noise * gaussian (state);
+
+    channelState[c] = state;
+    addWaveforms (x, numSamples);
+  }
+
+  position += numSamples;
+
+  // drop the stims whose waveforms ended in this block
+  const int64_t length = (int64_t) std::max (artifact.size(), response.size());
+  pending.erase (std::remove_if (pending.begin(), pending.end(),
+                                 [&] (const Pending& stim) { return stim.sample + length <= position; }),
+                 pending.end());
+}
+
+void SignalGenerator::generateInterleaved (int16_t* frames, int numSamples, double bitVolts, std::vector<SynthStim>& stims)
+{
+  const int numChannels = settings.numChannels;
+  scratch.resize ((size_t) numChannels * numSamples);
+
+  std::vector<float*> channels (numChannels);
+  for (int c = 0; c < numChannels; c++)
+    channels[c] = scratch.data() + (size_t) c * numSamples;
+
+  generate (channels.data(), numSamples, stims);
+
+  const float toBits = (float) (1 / bitVolts);
+  for (int c = 0; c < numChannels; c++)
+  {
+    const float* x = channels[c];
+    for (int i = 0; i < numSamples; i++)
+    {
+      const float bits = std::min (32767.0f, std::max (-32768.0f, x[i] * toBits));
+      frames[(size_t) i * numChannels + c] = (int16_t) std::lround (bits);
+    }
+  }
+}
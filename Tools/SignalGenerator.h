@@ -0,0 +1,117 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __SIGNALGENERATOR_H_DEFINED
+#define __SIGNALGENERATOR_H_DEFINED
+
+#include <stdint.h>
+#include <vector>
+
+namespace StimDetectorSpace {
+
+  /** What the generator draws; amplitudes in microvolts, times in ms from the stim. */
+  struct SynthSettings
+  {
+    SynthSettings();
+
+    int numChannels;
+    double sampleRate;
+    uint64_t seed;
+
+    double noise;               //standard deviation of the background
+    double stimRate;            //stims per second, 0 for none
+    double jitter;              //uniform jitter of each stim time, +/- ms
+    double artifact;            //height of the biphasic stim artifact
+    double artifactWidth;       //width of each artifact phase
+
+    double responseMax;         //positive peak of the evoked response
+    double responseMin;         //trough of the evoked response, negative
+    double peakTime;            //time of the positive peak
+    double latency;             //time of the trough
+    double recovery;            //return to baseline after the trough
+    double gainJitter;          //uniform jitter of the response amplitude, +/- fraction
+  };
+
+  /** Ground truth of one stim, in the units of the results table. */
+  struct SynthStim
+  {
+    int64_t sample;             //artifact onset
+    double gain;                //response scale of this stim
+    double yMin;                //trough
+    double yMax;                //positive peak
+    double latency;             //trough time from the artifact, ms
+    double slope;               //from peak to trough, per second
+  };
+
+  /**
+
+    Deterministic multichannel test signal: noise, stim artifacts at a jittered
+    rate and evoked responses of known shape.
+
+    Each channel draws from its own random stream and the stim times from
+    another, so the output depends only on the settings and the seed, never on
+    the block sizes it is rendered in.
+
+  */
+  class SignalGenerator
+  {
+  public:
+    explicit SignalGenerator (const SynthSettings& settings);
+
+    const SynthSettings& getSettings() const    { return settings; }
+
+    /** Next sample to be rendered. */
+    int64_t getPosition() const                 { return position; }
+
+    /** Renders the next numSamples samples of every channel, in microvolts, into
+        channels[c][0 .. numSamples). Stims due by the end of the block are appended
+        to stims, in time order; jitter may place one a little past the block. */
+    void generate (float* const* channels, int numSamples, std::vector<SynthStim>& stims);
+
+    /** Same as generate(), interleaved and quantised to int16 at bitVolts microvolts per bit. */
+    void generateInterleaved (int16_t* frames, int numSamples, double bitVolts, std::vector<SynthStim>& stims);
+
+  private:
+    void scheduleStims (int64_t end, std::vector<SynthStim>& stims);
+    void addWaveforms (float* channel, int numSamples) const;
+
+    SynthSettings settings;
+    int64_t position;
+
+    std::vector<uint64_t> channelState;         //random stream of each channel
+    uint64_t stimState;                         //random stream of the stim times
+
+    std::vector<float> artifact;                //artifact shape, from the onset
+    std::vector<float> response;                //unit gain response shape, from the onset
+
+    struct Pending { int64_t sample; float gain; };
+    std::vector<Pending> pending;               //stims whose waveforms are not over yet
+    int64_t nextStim;
+    double period;
+
+    std::vector<float> scratch;                 //channel-major block of generateInterleaved()
+  };
+
+}
+
+#endif  // __SIGNALGENERATOR_H_DEFINED
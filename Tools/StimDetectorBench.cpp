@@ -0,0 +1,831 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Microbenchmarks of the detector hot paths, on synthetic signals.
+
+  Usage: StimDetectorBench [--duration seconds] [--repeat n] [--threads n] [--output file.json] [--quick]
+
+  Every configuration of sample rate, buffer size, module count and stim rate
+  runs the detection engine over the same signal, keeping the fastest of n
+  runs. The cost of TTL emission is the time over the stim-free run of the
+  same configuration, per event. Template detection is timed per template
+  length, with the number of stims it finds, and each differentiator with
+  its output written in place or to a derived channel. Prefilters are timed
+  with the detector they feed. The channel group pass of process() is timed
+  on 1 to n threads over many input channels, scheduled as WorkerPool does.
+  The results go out as a single JSON document.
+*/
+
+#include "DetectorEngine.h"
+#include "Differentiator.h"
+#include "Prefilter.h"
+#include "SignalGenerator.h"
+#include "StimDetectorKernels.h"
+#include "TemplateMatcher.h"
+#include "WaveformFeatures.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  typedef std::chrono::steady_clock Clock;
+
+  double secondsSince (Clock::time_point start)
+  {
+    return std::chrono::duration<double> (Clock::now() - start).count();
+  }
+
+  struct Options
+  {
+    Options() : duration (2.0), repeat (5), maxThreads ((int) std::max (1u, std::thread::hardware_concurrency())), quick (false) {}
+
+    double duration;            //seconds of signal per configuration
+    int repeat;                 //runs per configuration, the fastest is kept
+    int maxThreads;             //top of the thread sweep
+    std::string output;         //JSON file, stdout when empty
+    bool quick;                 //smaller sweep, for smoke runs
+  };
+
+  const double threshold = 50.0;
+  const float artifactAmplitude = 200.0f;  //diff of the artifact, between threshold and 5 * threshold
+
+  /** Channel-major noise, stim artifacts at stimRate and evoked responses on each channel. */
+  void makeSignal (std::vector<float>& signal, std::vector<SynthStim>& stims, int numChannels, int numSamples,
+                   double sampleRate, double stimRate, uint64_t seed)
+  {
+    SynthSettings settings;
+    settings.numChannels = numChannels;
+    settings.sampleRate = sampleRate;
+    settings.seed = seed;
+    settings.noise = 2;
+    settings.stimRate = stimRate;
+    settings.artifact = artifactAmplitude;
+    settings.responseMax = 10;
+    settings.responseMin = -30;
+
+    signal.assign ((size_t) numChannels * numSamples, 0.0f);
+
+    std::vector<float*> channels (numChannels);
+    for (int c = 0; c < numChannels; c++)
+      channels[c] = signal.data() + (size_t) c * numSamples;
+
+    SignalGenerator generator (settings);
+    generator.generate (channels.data(), numSamples, stims);
+  }
+
+  struct ProcessResult
+  {
+    double seconds;
+    long long events;
+    long long windows;
+  };
+
+  class CountingSink : public WindowSink
+  {
+  public:
+    CountingSink() : count (0) {}
+    void windowClosed (int) override { count++; }
+    long long count;
+  };
+
+  ProcessResult runProcess (const std::vector<float>& signal, int numModules, int numSamples,
+                            double sampleRate, int bufferSize)
+  {
+    DetectorBank bank;
+    DetectorEngine engine (bank);
+
+    const int avgLength = (int) std::ceil (sampleRate * 0.040);
+    bank.prepare (numModules, avgLength, 0);
+
+    for (int d = 0; d < numModules; d++)
+    {
+      bank.threshold[d] = threshold;
+      bank.outputChan[d] = d % 8;
+      bank.windowLength[d] = avgLength;
+      bank.ttlLength[d] = (int) std::ceil (sampleRate * 0.005);
+    }
+
+    DetectorEngine::Scratch scratch;
+    TtlEventBuffer events (1024);
+    CountingSink sink;
+
+    ProcessResult result = { 0, 0, 0 };
+    const Clock::time_point start = Clock::now();
+
+    for (int pos = 0; pos < numSamples; pos += bufferSize)
+    {
+      const int n = std::min (bufferSize, numSamples - pos);
+
+      // one detector per channel, as process() hands them over
+      for (int d = 0; d < numModules; d++)
+        engine.processChannel (&d, 1, signal.data() + (size_t) d * numSamples + pos, n, pos,
+                               scratch, events, sink, nullptr);
+
+      result.events += (long long) events.size();
+      events.clear();
+    }
+
+    result.seconds = secondsSince (start);
+    result.windows = sink.count;
+    return result;
+  }
+
+  struct TemplateResult
+  {
+    double seconds;
+    int fftSize;
+    long long triggers;
+  };
+
+  /** A template detector on one channel, matching the first templateMs after a stim. */
+  TemplateResult runTemplate (const std::vector<float>& signal, const std::vector<SynthStim>& stims, int numSamples,
+                              double sampleRate, double templateMs, int bufferSize)
+  {
+    const int length = (int) std::ceil (sampleRate * templateMs / 1000);
+    const int start = stims.empty() ? 0 : (int) std::min<int64_t> (stims[0].sample, numSamples - length);
+    TemplateMatcher matcher (signal.data() + start, length, Kernels::blockSize);
+
+    DetectorBank bank;
+    DetectorEngine engine (bank);
+    const int avgLength = (int) std::ceil (sampleRate * 0.040);
+    bank.prepare (1, avgLength, length);     //the history dates matches back to their start
+    bank.matcher[0] = &matcher;
+    bank.matchThreshold[0] = 0.8;
+    bank.outputChan[0] = 0;
+    bank.windowLength[0] = avgLength;
+    bank.ttlLength[0] = (int) std::ceil (sampleRate * 0.005);
+
+    DetectorEngine::Scratch scratch;
+    TtlEventBuffer events (1024);
+    CountingSink sink;
+
+    TemplateResult result = { 0, matcher.getFftSize(), 0 };
+    const Clock::time_point begin = Clock::now();
+
+    for (int pos = 0; pos < numSamples; pos += bufferSize)
+    {
+      const int d = 0;
+      const int n = std::min (bufferSize, numSamples - pos);
+      engine.processChannel (&d, 1, signal.data() + pos, n, pos, scratch, events, sink, nullptr);
+
+      for (const TtlEvent& event : events)
+        result.triggers += event.ttlData != 0;
+      events.clear();
+    }
+
+    result.seconds = secondsSince (begin);
+    return result;
+  }
+
+  struct DifferentiatorResult
+  {
+    double seconds;
+    int numTaps;
+    long long triggers;
+  };
+
+  /** A diff threshold detector on one channel through a differentiator, writing its output
+      over a copy of the input as applyDiff does, or to a derived channel. */
+  DifferentiatorResult runDifferentiator (const std::vector<float>& signal, int numSamples, double sampleRate,
+                                          const DifferentiatorSettings& settings, bool derivedChannel, int bufferSize)
+  {
+    Differentiator differentiator (settings, Kernels::blockSize);
+
+    DetectorBank bank;
+    DetectorEngine engine (bank);
+    const int avgLength = (int) std::ceil (sampleRate * 0.040);
+    bank.prepare (1, avgLength, 0);
+    bank.differentiator[0] = settings.type == DifferentiatorSettings::firstDifference ? nullptr : &differentiator;
+    bank.threshold[0] = threshold;
+    bank.outputChan[0] = 0;
+    bank.windowLength[0] = avgLength;
+    bank.ttlLength[0] = (int) std::ceil (sampleRate * 0.005);
+
+    DetectorEngine::Scratch scratch;
+    TtlEventBuffer events (1024);
+    CountingSink sink;
+    std::vector<float> buffer (bufferSize);
+    std::vector<float> derived (bufferSize);
+    float* out = derivedChannel ? derived.data() : buffer.data();
+
+    DifferentiatorResult result = { 0, differentiator.getNumTaps(), 0 };
+    const Clock::time_point begin = Clock::now();
+
+    for (int pos = 0; pos < numSamples; pos += bufferSize)
+    {
+      const int d = 0;
+      const int n = std::min (bufferSize, numSamples - pos);
+      std::copy (signal.data() + pos, signal.data() + pos + n, buffer.data());
+      engine.processChannel (&d, 1, buffer.data(), n, pos, scratch, events, sink, out);
+
+      for (const TtlEvent& event : events)
+        result.triggers += event.ttlData != 0;
+      events.clear();
+    }
+
+    result.seconds = secondsSince (begin);
+    return result;
+  }
+
+  /** A diff threshold detector on one channel behind a prefilter. */
+  DifferentiatorResult runPrefilter (const std::vector<float>& signal, int numSamples, double sampleRate,
+                                     const PrefilterSettings& settings, int bufferSize)
+  {
+    Prefilter prefilter (settings, sampleRate);
+
+    DetectorBank bank;
+    DetectorEngine engine (bank);
+    const int avgLength = (int) std::ceil (sampleRate * 0.040);
+    bank.prepare (1, avgLength, 0);
+    bank.prefilter[0] = settings.type == PrefilterSettings::none ? nullptr : &prefilter;
+    bank.threshold[0] = threshold;
+    bank.outputChan[0] = 0;
+    bank.windowLength[0] = avgLength;
+    bank.ttlLength[0] = (int) std::ceil (sampleRate * 0.005);
+
+    DetectorEngine::Scratch scratch;
+    TtlEventBuffer events (1024);
+    CountingSink sink;
+
+    DifferentiatorResult result = { 0, prefilter.getNumSections(), 0 };
+    const Clock::time_point begin = Clock::now();
+
+    for (int pos = 0; pos < numSamples; pos += bufferSize)
+    {
+      const int d = 0;
+      const int n = std::min (bufferSize, numSamples - pos);
+      engine.processChannel (&d, 1, signal.data() + pos, n, pos, scratch, events, sink, nullptr);
+
+      for (const TtlEvent& event : events)
+        result.triggers += event.ttlData != 0;
+      events.clear();
+    }
+
+    result.seconds = secondsSince (begin);
+    return result;
+  }
+
+  /** WorkerPool without JUCE: persistent workers, a contiguous range of channel groups
+      per participant, stealing from the back of the others' ranges once it is empty. */
+  class GroupPool
+  {
+  public:
+    GroupPool (int numThreads) : lanes ((size_t) numThreads), generation (0), stop (false), remaining (0), job (nullptr)
+    {
+      for (int i = 1; i < numThreads; i++)
+        workers.emplace_back ([this, i] { workerLoop (i); });
+    }
+
+    ~GroupPool()
+    {
+      stop = true;
+      for (std::thread& worker : workers)
+        worker.join();
+    }
+
+    template <typename Job>
+    void run (Job& newJob, int numItems)
+    {
+      const int numLanes = (int) lanes.size();
+      callback = [] (void* j, int item, int participant) { (*static_cast<Job*> (j)) (item, participant); };
+      job = &newJob;
+      remaining = numItems;
+
+      for (int i = 0; i < numLanes; i++)
+        lanes[i].store (pack ((int) ((int64_t) numItems * i / numLanes), (int) ((int64_t) numItems * (i + 1) / numLanes)));
+
+      generation++;
+      work (0);
+
+      while (remaining.load() > 0)
+        std::this_thread::yield();
+    }
+
+  private:
+    static int64_t pack (int next, int end) { return ((int64_t) end << 32) | (uint32_t) next; }
+
+    bool take (int lane, bool back, int& item)
+    {
+      int64_t current = lanes[lane].load();
+
+      for (;;)
+      {
+        const int next = (int) (uint32_t) current;
+        const int end = (int) (current >> 32);
+
+        if (next >= end)
+          return false;
+
+        if (lanes[lane].compare_exchange_weak (current, back ? pack (next, end - 1) : pack (next + 1, end)))
+        {
+          item = back ? end - 1 : next;
+          return true;
+        }
+      }
+    }
+
+    void work (int participant)
+    {
+      const int numLanes = (int) lanes.size();
+
+      for (;;)
+      {
+        int item = -1;
+        bool found = take (participant, false, item);
+
+        for (int k = 1; !found && k < numLanes; k++)
+          found = take ((participant + k) % numLanes, true, item);
+
+        if (!found)
+          return;
+
+        callback (job.load(), item, participant);
+        remaining--;
+      }
+    }
+
+    void workerLoop (int participant)
+    {
+      int seen = 0;
+
+      while (!stop)
+      {
+        if (generation.load() == seen)
+        {
+          std::this_thread::yield();
+          continue;
+        }
+
+        seen = generation.load();
+        work (participant);
+      }
+    }
+
+    std::vector<std::atomic<int64_t>> lanes;  //next item in the low 32 bits, end of the range in the high ones
+    std::vector<std::thread> workers;
+    std::atomic<int> generation;
+    std::atomic<bool> stop;
+    std::atomic<int> remaining;
+    std::atomic<void*> job;
+    void (*callback) (void*, int, int);
+  };
+
+  struct ThreadsResult
+  {
+    double seconds;
+    long long events;
+  };
+
+  /** One detector per input channel, each channel its own group, on numThreads threads. */
+  ThreadsResult runThreads (const std::vector<float>& signal, int numChannels, int numSamples,
+                            double sampleRate, int bufferSize, int numThreads)
+  {
+    DetectorBank bank;
+    DetectorEngine engine (bank);
+
+    const int avgLength = (int) std::ceil (sampleRate * 0.040);
+    bank.prepare (numChannels, avgLength, 0);
+
+    for (int d = 0; d < numChannels; d++)
+    {
+      bank.threshold[d] = threshold;
+      bank.outputChan[d] = d % 8;
+      bank.windowLength[d] = avgLength;
+      bank.ttlLength[d] = (int) std::ceil (sampleRate * 0.005);
+    }
+
+    // per participant scratch and sink, per group events, as process() keeps them
+    std::vector<DetectorEngine::Scratch> scratch ((size_t) numThreads);
+    std::vector<CountingSink> sinks ((size_t) numThreads);
+    std::vector<TtlEventBuffer> events ((size_t) numChannels, TtlEventBuffer (64));
+    GroupPool pool (numThreads);
+
+    ThreadsResult result = { 0, 0 };
+    int pos = 0, n = 0;
+
+    auto job = [&] (int d, int participant)
+    {
+      engine.processChannel (&d, 1, signal.data() + (size_t) d * numSamples + pos, n, pos,
+                             scratch[participant], events[d], sinks[participant], nullptr);
+    };
+
+    const Clock::time_point start = Clock::now();
+
+    for (pos = 0; pos < numSamples; pos += bufferSize)
+    {
+      n = std::min (bufferSize, numSamples - pos);
+      pool.run (job, numChannels);
+
+      for (TtlEventBuffer& group : events)
+      {
+        result.events += (long long) group.size();
+        group.clear();
+      }
+    }
+
+    result.seconds = secondsSince (start);
+    return result;
+  }
+
+  /** Feature extraction of one closed window, as the analysis thread runs it. */
+  double runFeatures (double sampleRate, int numSweeps)
+  {
+    const int length = (int) std::ceil (sampleRate * 0.040);
+    const int ttlLength = (int) std::ceil (sampleRate * 0.005);
+    const int movMean = ttlLength;
+
+    // one stim half way through 2 windows, the window starts at its artifact
+    std::vector<float> signal;
+    std::vector<SynthStim> stims;
+    makeSignal (signal, stims, 1, 2 * length, sampleRate, sampleRate / (2 * length), 1);
+    const int first = stims.empty() ? 0 : (int) std::min<int64_t> (stims[0].sample, length);
+
+    std::vector<double> stim (length), smoothed (length);
+    for (int i = 0; i < length; i++)
+      stim[i] = signal[first + i] / DetectorEngine::getStimScale();
+
+    WaveformFeatures features;
+    double params[NUM_WAVEFORM_PARAMS];
+    double sink = 0;
+
+    const Clock::time_point start = Clock::now();
+    for (int s = 0; s < numSweeps; s++)
+    {
+      extractWaveformFeatures (stim.data(), 0, length, 0, ttlLength, movMean,
+                               smoothed.data(), features);
+      computeWaveformParams (features, s + 1, ttlLength, sampleRate, params);
+      sink += params[3];
+    }
+    const double seconds = secondsSince (start);
+
+    if (sink == 12345.678) // keep the loop
+      std::printf (" ");
+
+    return seconds / numSweeps;
+  }
+
+  /** Filling the result table the canvas reads: params of every module and avg row. */
+  double runSnapshot (int numModules, int numRows, int numSnapshots)
+  {
+    WaveformFeatures features;
+    features.yMin = -0.1;
+    features.yMax = 0.05;
+    features.xMin = 300;
+    features.xMax = 240;
+
+    std::vector<double> table;
+    double sink = 0;
+
+    const Clock::time_point start = Clock::now();
+    for (int s = 0; s < numSnapshots; s++)
+    {
+      table.resize ((size_t) numModules * (numRows + 1) * NUM_WAVEFORM_PARAMS);
+      double* row = table.data();
+
+      for (int m = 0; m < numModules; m++)
+      {
+        computeWaveformParams (features, s, 150, 30000.0, row);
+        row += NUM_WAVEFORM_PARAMS;
+
+        for (int r = 0; r < numRows; r++, row += NUM_WAVEFORM_PARAMS)
+        {
+          row[0] = updateRunningMean (row[0], features.yMin, s + 1);
+          row[1] = updateRunningMean (row[1], features.yMax, s + 1);
+          row[2] = row[1] - row[0];
+          row[3] = updateRunningMean (row[3], 10.0, s + 1);
+          row[4] = updateRunningMean (row[4], 1.0, s + 1);
+          row[5] = s + 1;
+        }
+      }
+      sink += table[0];
+    }
+    const double seconds = secondsSince (start);
+
+    if (sink == 12345.678)
+      std::printf (" ");
+
+    return seconds / numSnapshots;
+  }
+
+  bool parseOptions (int argc, char** argv, Options& options)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      if (std::strcmp (argv[i], "--duration") == 0 && i + 1 < argc)
+        options.duration = std::atof (argv[++i]);
+      else if (std::strcmp (argv[i], "--repeat") == 0 && i + 1 < argc)
+        options.repeat = std::atoi (argv[++i]);
+      else if (std::strcmp (argv[i], "--threads") == 0 && i + 1 < argc)
+        options.maxThreads = std::atoi (argv[++i]);
+      else if (std::strcmp (argv[i], "--output") == 0 && i + 1 < argc)
+        options.output = argv[++i];
+      else if (std::strcmp (argv[i], "--quick") == 0)
+        options.quick = true;
+      else
+        return false;
+    }
+
+    return options.duration > 0 && options.repeat > 0 && options.maxThreads > 0;
+  }
+}
+
+int main (int argc, char** argv)
+{
+  Options options;
+  if (!parseOptions (argc, argv, options))
+  {
+    std::fprintf (stderr, "usage: %s [--duration seconds] [--repeat n] [--threads n] [--output file.json] [--quick]\n", argv[0]);
+    return 1;
+  }
+
+  std::vector<double> sampleRates;
+  std::vector<int> bufferSizes, moduleCounts;
+  std::vector<double> stimRates;
+
+  if (options.quick)
+  {
+    sampleRates = { 1000, 30000 };
+    bufferSizes = { 64, 4096 };
+    moduleCounts = { 1, 16 };
+    stimRates = { 0, 10 };
+  }
+  else
+  {
+    sampleRates = { 1000, 5000, 10000, 20000, 30000 };
+    bufferSizes = { 64, 256, 1024, 4096 };
+    moduleCounts = { 1, 8, 64, 128 };
+    stimRates = { 0, 1, 10, 100 };
+  }
+
+  std::string json = "{\n  \"implementation\": \"";
+  json += Kernels::getImplementationName();
+  json += "\",\n  \"duration_s\": " + std::to_string (options.duration)
+        + ",\n  \"repeat\": " + std::to_string (options.repeat)
+        + ",\n  \"hardware_threads\": " + std::to_string (std::thread::hardware_concurrency()) + ",\n  \"process\": [";
+
+  char line[512];
+  bool first = true;
+
+  for (double sampleRate : sampleRates)
+  {
+    const int numSamples = (int) (sampleRate * options.duration);
+
+    for (int numModules : moduleCounts)
+    {
+      std::vector<double> baseline (bufferSizes.size(), 0.0);
+
+      for (double stimRate : stimRates)
+      {
+        std::vector<float> signal;
+        std::vector<SynthStim> stims;
+        makeSignal (signal, stims, numModules, numSamples, sampleRate, stimRate, 12345);
+
+        for (size_t b = 0; b < bufferSizes.size(); b++)
+        {
+          const int bufferSize = bufferSizes[b];
+
+          ProcessResult r = runProcess (signal, numModules, numSamples, sampleRate, bufferSize);
+          for (int i = 1; i < options.repeat; i++)
+          {
+            const ProcessResult next = runProcess (signal, numModules, numSamples, sampleRate, bufferSize);
+            r.seconds = std::min (r.seconds, next.seconds);
+          }
+
+          if (stimRate == 0)
+            baseline[b] = r.seconds;
+
+          const double perModule = numSamples / r.seconds;
+          const double perEvent = r.events > 0 && baseline[b] > 0
+            ? std::max (0.0, r.seconds - baseline[b]) * 1e9 / r.events : 0.0;
+
+          std::snprintf (line, sizeof (line),
+            "%s\n    { \"sample_rate\": %g, \"buffer_size\": %d, \"modules\": %d, \"stim_rate\": %g, "
+            "\"seconds\": %.9f, \"samples_per_s_per_module\": %.0f, \"x_real_time\": %.1f, "
+            "\"ns_per_buffer\": %.0f, \"ttl_events\": %lld, \"ns_per_event\": %.0f, \"windows\": %lld }",
+            first ? "" : ",", sampleRate, bufferSize, numModules, stimRate,
+            r.seconds, perModule, perModule / sampleRate,
+            r.seconds * 1e9 / std::max (1, (numSamples + bufferSize - 1) / bufferSize),
+            r.events, perEvent, r.windows);
+
+          json += line;
+          first = false;
+        }
+      }
+    }
+  }
+
+  json += "\n  ],\n  \"threads\": [";
+  first = true;
+  {
+    const double sampleRate = 30000;
+    const int bufferSize = 1024;
+    const int numSamples = (int) (sampleRate * options.duration);
+
+    for (int numChannels : options.quick ? std::vector<int> { 128 } : std::vector<int> { 128, 384 })
+    {
+      std::vector<float> signal;
+      std::vector<SynthStim> stims;
+      makeSignal (signal, stims, numChannels, numSamples, sampleRate, 10, 12345);
+      double serial = 0;
+
+      for (int numThreads = 1; numThreads <= options.maxThreads; numThreads++)
+      {
+        ThreadsResult r = runThreads (signal, numChannels, numSamples, sampleRate, bufferSize, numThreads);
+        for (int i = 1; i < options.repeat; i++)
+          r.seconds = std::min (r.seconds, runThreads (signal, numChannels, numSamples, sampleRate, bufferSize, numThreads).seconds);
+
+        if (numThreads == 1)
+          serial = r.seconds;
+
+        std::snprintf (line, sizeof (line),
+          "%s\n    { \"channels\": %d, \"buffer_size\": %d, \"threads\": %d, \"seconds\": %.9f, "
+          "\"x_real_time\": %.1f, \"us_per_buffer\": %.1f, \"speedup\": %.2f, \"ttl_events\": %lld }",
+          first ? "" : ",", numChannels, bufferSize, numThreads, r.seconds,
+          numSamples / (r.seconds * sampleRate), r.seconds * 1e6 / ((numSamples + bufferSize - 1) / bufferSize),
+          serial / r.seconds, r.events);
+        json += line;
+        first = false;
+      }
+    }
+  }
+
+  json += "\n  ],\n  \"template\": [";
+  first = true;
+  {
+    const double sampleRate = 30000;
+    const int numSamples = (int) (sampleRate * options.duration);
+    std::vector<float> signal;
+    std::vector<SynthStim> stims;
+    makeSignal (signal, stims, 1, numSamples, sampleRate, 10, 12345);
+
+    for (double templateMs : { 1.0, 5.0, 10.0, 20.0, 40.0 })
+    {
+      TemplateResult r = runTemplate (signal, stims, numSamples, sampleRate, templateMs, 1024);
+      for (int i = 1; i < options.repeat; i++)
+        r.seconds = std::min (r.seconds, runTemplate (signal, stims, numSamples, sampleRate, templateMs, 1024).seconds);
+
+      std::snprintf (line, sizeof (line),
+        "%s\n    { \"sample_rate\": %g, \"template_ms\": %g, \"fft_size\": %d, \"ns_per_sample\": %.1f, "
+        "\"channels_per_core\": %.0f, \"stims\": %d, \"triggers\": %lld }",
+        first ? "" : ",", sampleRate, templateMs, r.fftSize, r.seconds * 1e9 / numSamples,
+        numSamples / (r.seconds * sampleRate), (int) stims.size(), r.triggers);
+      json += line;
+      first = false;
+    }
+  }
+
+  json += "\n  ],\n  \"differentiator\": [";
+  first = true;
+  {
+    const double sampleRate = 30000;
+    const int numSamples = (int) (sampleRate * options.duration);
+    std::vector<float> signal;
+    std::vector<SynthStim> stims;
+    makeSignal (signal, stims, 1, numSamples, sampleRate, 10, 12345);
+
+    const char* names[] = { "first", "central", "savitzky_golay", "band_limited" };
+
+    for (int type = DifferentiatorSettings::firstDifference; type <= DifferentiatorSettings::bandLimited; type++)
+    {
+      for (int length : { 7, 15, 31 })
+      {
+        if (type < DifferentiatorSettings::savitzkyGolay && length != 7)
+          continue;
+
+        DifferentiatorSettings settings;
+        settings.type = (DifferentiatorSettings::Type) type;
+        settings.length = length;
+        settings.order = 2;
+        settings.cutoff = 0.5;
+
+        for (bool derivedChannel : { false, true })
+        {
+          DifferentiatorResult r = runDifferentiator (signal, numSamples, sampleRate, settings, derivedChannel, 1024);
+          for (int i = 1; i < options.repeat; i++)
+            r.seconds = std::min (r.seconds, runDifferentiator (signal, numSamples, sampleRate, settings, derivedChannel, 1024).seconds);
+
+          std::snprintf (line, sizeof (line),
+            "%s\n    { \"type\": \"%s\", \"taps\": %d, \"output\": \"%s\", \"ns_per_sample\": %.1f, "
+            "\"stims\": %d, \"triggers\": %lld }",
+            first ? "" : ",", names[type], r.numTaps, derivedChannel ? "channel" : "in_place",
+            r.seconds * 1e9 / numSamples, (int) stims.size(), r.triggers);
+          json += line;
+          first = false;
+        }
+      }
+    }
+  }
+
+  json += "\n  ],\n  \"prefilter\": [";
+  first = true;
+  {
+    const double sampleRate = 30000;
+    const int numSamples = (int) (sampleRate * options.duration);
+    std::vector<float> signal;
+    std::vector<SynthStim> stims;
+    makeSignal (signal, stims, 1, numSamples, sampleRate, 10, 12345);
+
+    const char* names[] = { "none", "high_pass", "notch", "band_pass" };
+
+    for (int type = PrefilterSettings::none; type <= PrefilterSettings::bandPass; type++)
+    {
+      for (int order : { 2, 8 })
+      {
+        if ((type == PrefilterSettings::none || type == PrefilterSettings::notch) && order != 2)
+          continue;
+
+        PrefilterSettings settings;
+        settings.type = (PrefilterSettings::Type) type;
+        settings.lowHz = type == PrefilterSettings::notch ? 50 : 10;
+        settings.highHz = 5000;
+        settings.order = order;
+
+        DifferentiatorResult r = runPrefilter (signal, numSamples, sampleRate, settings, 1024);
+        for (int i = 1; i < options.repeat; i++)
+          r.seconds = std::min (r.seconds, runPrefilter (signal, numSamples, sampleRate, settings, 1024).seconds);
+
+        std::snprintf (line, sizeof (line),
+          "%s\n    { \"type\": \"%s\", \"sections\": %d, \"ns_per_sample\": %.1f, "
+          "\"channels_per_core\": %.0f, \"stims\": %d, \"triggers\": %lld }",
+          first ? "" : ",", names[type], r.numTaps, r.seconds * 1e9 / numSamples,
+          numSamples / (r.seconds * sampleRate), (int) stims.size(), r.triggers);
+        json += line;
+        first = false;
+      }
+    }
+  }
+
+  json += "\n  ],\n  \"features\": [";
+  first = true;
+  for (double sampleRate : sampleRates)
+  {
+    const double perSweep = runFeatures (sampleRate, options.quick ? 2000 : 20000);
+    std::snprintf (line, sizeof (line), "%s\n    { \"sample_rate\": %g, \"ns_per_sweep\": %.0f }",
+                   first ? "" : ",", sampleRate, perSweep * 1e9);
+    json += line;
+    first = false;
+  }
+
+  json += "\n  ],\n  \"snapshot\": [";
+  first = true;
+  for (int numModules : moduleCounts)
+  {
+    for (int numRows : { 1, 10 })
+    {
+      const double perSnapshot = runSnapshot (numModules, numRows, options.quick ? 2000 : 20000);
+      std::snprintf (line, sizeof (line), "%s\n    { \"modules\": %d, \"avg_rows\": %d, \"ns_per_snapshot\": %.0f }",
+                     first ? "" : ",", numModules, numRows, perSnapshot * 1e9);
+      json += line;
+      first = false;
+    }
+  }
+  json += "\n  ]\n}\n";
+
+  if (options.output.empty())
+  {
+    std::fputs (json.c_str(), stdout);
+    return 0;
+  }
+
+  FILE* f = std::fopen (options.output.c_str(), "w");
+  if (f == nullptr)
+  {
+    std::fprintf (stderr, "cannot write %s\n", options.output.c_str());
+    return 1;
+  }
+
+  std::fputs (json.c_str(), f);
+  std::fclose (f);
+  return 0;
+}
@@ -0,0 +1,230 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Offline re-analysis of a sweep archive with new parameters.
+
+  Usage: StimDetectorReanalyse [options] <file.sda>
+
+    --smooth ms         moving mean width, 5 by default
+    --ttl ms            blanking after the trigger, 5 by default
+    --window ms         window after the trigger, the archived length by default
+    --split-every n     starts a new avg row every n sweeps of a detector
+    --splits a,b,...    or at these sweep numbers of each detector; archived rows by default
+    --threads n         measuring threads, every core by default
+    --output prefix     writes prefix_avg.csv and prefix_stims.csv, "reanalyse" by default
+
+  Sweeps are measured in parallel, then folded into the avg rows in archive
+  order, so the tables match what the analysis thread would have shown.
+*/
+
+#include "SweepReanalysis.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  struct Options
+  {
+    Options() : numThreads (0), output ("reanalyse") {}
+
+    std::string input;
+    ReanalysisSettings settings;
+    int numThreads;
+    std::string output;
+  };
+
+  bool parseSplits (const char* list, std::vector<int>& splits)
+  {
+    for (const char* p = list; *p != 0; )
+    {
+      char* end;
+      const long split = std::strtol (p, &end, 10);
+
+      if (end == p || split < 0 || (*end != 0 && *end != ','))
+        return false;
+
+      splits.push_back ((int) split);
+      p = *end == ',' ? end + 1 : end;
+    }
+    return true;
+  }
+
+  bool parseOptions (int argc, char** argv, Options& options)
+  {
+    ReanalysisSettings& settings = options.settings;
+
+    for (int i = 1; i < argc; i++)
+    {
+      const std::string arg = argv[i];
+      const bool hasValue = i + 1 < argc;
+
+      if (arg == "--smooth" && hasValue)
+        settings.smoothingMs = std::atof (argv[++i]);
+      else if (arg == "--ttl" && hasValue)
+        settings.ttlMs = std::atof (argv[++i]);
+      else if (arg == "--window" && hasValue)
+        settings.windowMs = std::atof (argv[++i]);
+      else if (arg == "--split-every" && hasValue)
+        settings.splitEvery = std::atoi (argv[++i]);
+      else if (arg == "--splits" && hasValue)
+      {
+        if (!parseSplits (argv[++i], settings.splits))
+          return false;
+      }
+      else if (arg == "--threads" && hasValue)
+        options.numThreads = std::atoi (argv[++i]);
+      else if (arg == "--output" && hasValue)
+        options.output = argv[++i];
+      else if (arg.compare (0, 2, "--") != 0 && options.input.empty())
+        options.input = arg;
+      else
+        return false;
+    }
+
+    return !options.input.empty() && settings.smoothingMs > 0 && settings.ttlMs >= 0
+      && settings.windowMs >= 0 && settings.splitEvery >= 0 && options.numThreads >= 0;
+  }
+}
+
+int main (int argc, char** argv)
+{
+  Options options;
+  if (!parseOptions (argc, argv, options))
+  {
+    std::fprintf (stderr, "usage: %s [--smooth ms] [--ttl ms] [--window ms] [--split-every n | --splits a,b,...] "
+                          "[--threads n] [--output prefix] <file.sda>\n", argv[0]);
+    return 1;
+  }
+
+  const SweepArchiveReader archive (options.input);
+  if (!archive.isOpen())
+  {
+    std::fprintf (stderr, "cannot read %s\n", options.input.c_str());
+    return 1;
+  }
+
+  const uint64_t numSweeps = archive.getNumSweeps();
+  int numThreads = options.numThreads > 0 ? options.numThreads : (int) std::thread::hardware_concurrency();
+  numThreads = std::max (1, numThreads);
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  SweepReanalysis reanalysis (archive, options.settings);
+  reanalysis.assignRows();
+
+  // small chunks keep the threads busy when sweep lengths differ
+  const uint64_t chunkSize = 256;
+  std::atomic<uint64_t> nextChunk (0);
+
+  auto measure = [&]()
+  {
+    for (;;)
+    {
+      const uint64_t begin = nextChunk.fetch_add (chunkSize);
+      if (begin >= numSweeps)
+        break;
+      reanalysis.measureSweeps (begin, std::min (numSweeps, begin + chunkSize));
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int t = 1; t < numThreads; t++)
+    threads.push_back (std::thread (measure));
+  measure();
+  for (std::thread& thread : threads)
+    thread.join();
+
+  const double measureSeconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+
+  std::vector<ReanalysisTable> tables;
+  reanalysis.buildTables (tables);
+
+  const double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+
+  const std::string stimsPath = options.output + "_stims.csv";
+  FILE* stims = std::fopen (stimsPath.c_str(), "w");
+  if (stims == nullptr)
+  {
+    std::fprintf (stderr, "cannot write %s\n", stimsPath.c_str());
+    return 1;
+  }
+
+  std::fprintf (stims, "sweep,module,row,timestamp,min,max,peak_to_peak,latency,slope,count\n");
+  for (uint64_t i = 0; i < numSweeps; i++)
+  {
+    const SweepInfo& info = archive.getInfo (i);
+    const double* p = reanalysis.getSweepParams (i);
+    std::fprintf (stims, "%llu,%d,%d,%lld,%g,%g,%g,%g,%g,%d\n", (unsigned long long) i, (int) info.module,
+                  reanalysis.getSweepRow (i), (long long) (info.startTimestamp + info.preLength),
+                  p[0], p[1], p[2], p[3], p[4], (int) p[5]);
+  }
+  std::fclose (stims);
+
+  // one table per detector, in the row layout of the canvas
+  const std::string avgPath = options.output + "_avg.csv";
+  FILE* avg = std::fopen (avgPath.c_str(), "w");
+  if (avg == nullptr)
+  {
+    std::fprintf (stderr, "cannot write %s\n", avgPath.c_str());
+    return 1;
+  }
+
+  int numRows = 0;
+  std::fprintf (avg, "module,row,min,max,peak_to_peak,latency,slope,count\n");
+  for (size_t m = 0; m < tables.size(); m++)
+  {
+    for (int r = 0; r < tables[m].numRows; r++)
+    {
+      const double* p = &tables[m].avgTable[(size_t) r * NUM_WAVEFORM_PARAMS];
+      std::fprintf (avg, "%d,%d,%g,%g,%g,%g,%g,%d\n", (int) m, r, p[0], p[1], p[2], p[3], p[4], (int) p[5]);
+      numRows++;
+    }
+  }
+
+  std::fprintf (avg, "\nmodule,row,sample,avg,sem\n");
+  for (size_t m = 0; m < tables.size(); m++)
+  {
+    for (int r = 0; r < tables[m].numRows; r++)
+    {
+      const SweepStatistics& sweep = tables[m].avgSweeps[r];
+      for (int w = 0; w < sweep.getLength(); w++)
+        std::fprintf (avg, "%d,%d,%d,%g,%g\n", (int) m, r, w, sweep.getMean()[w], sweep.getSem (w));
+    }
+  }
+  std::fclose (avg);
+
+  std::printf ("{ \"sweeps\": %llu, \"modules\": %d, \"rows\": %d, \"threads\": %d, "
+               "\"measure_s\": %.6f, \"seconds\": %.6f, \"sweeps_per_s\": %.0f }\n",
+               (unsigned long long) numSweeps, (int) tables.size(), numRows, numThreads,
+               measureSeconds, seconds, seconds > 0 ? numSweeps / seconds : 0.0);
+  return 0;
+}
@@ -0,0 +1,602 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Offline replay of a recording through the detection core.
+
+  Usage: StimDetectorReplay [options] <continuous.dat | file.i16>
+
+    --channels n        interleaved channels in the file (required)
+    --rate hz           sample rate, 30000 by default
+    --bit-volts v       microvolts per bit, 0.195 by default
+    --buffer n          samples per processing buffer, 1024 by default
+    --timestamps file   sample timestamps (.npy); timestamps.npy next to a continuous.dat by default
+    --events dir        recorded TTL events (channel_states.npy and timestamps.npy) to replay as gates
+    --module spec       input:threshold[:gate[:preMs[:output]]], repeatable
+    --diff spec         differentiator of every module: first, central, sg:length:order
+                        or fir:length:cutoff; first by default
+    --filter spec       prefilter of every module: hp:hz[:order], notch:hz[:q]
+                        or bp:low:high[:order]; none by default
+    --output prefix     writes prefix_stims.csv and prefix_avg.csv, "replay" by default
+    --archive file      also appends every closed window to a sweep archive
+
+  The file is memory mapped and read once, front to back, in buffers of the
+  given size, the way process() sees it. Every closed window goes through the
+  same feature extraction and running averages as the analysis thread.
+*/
+
+#include "DetectorEngine.h"
+#include "Differentiator.h"
+#include "MappedFile.h"
+#include "Prefilter.h"
+#include "StimDetectorKernels.h"
+#include "SweepArchive.h"
+#include "SweepStatistics.h"
+#include "WaveformFeatures.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  struct Module
+  {
+    Module() : inputChan (0), gateChan (-1), outputChan (0), threshold (0), preTriggerMs (0),
+               avgLength (0), preLength (0), ttlLength (0), movMean (0), avg (), stims (0) {}
+
+    int inputChan;
+    int gateChan;
+    int outputChan;
+    double threshold;
+    double preTriggerMs;
+
+    int avgLength;
+    int preLength;
+    int ttlLength;
+    int movMean;
+
+    std::vector<double> stimMean;       //smoothed window, scratch of the feature extraction
+    WaveformFeatures features;
+    double avg[NUM_WAVEFORM_PARAMS];    //running mean of the per-stim params
+    SweepStatistics sweeps;             //mean and spread of every window sample
+    long long stims;
+  };
+
+  struct Options
+  {
+    Options() : numChannels (0), sampleRate (30000), bitVolts (0.195), bufferSize (1024),
+                output ("replay") {}
+
+    std::string input;
+    int numChannels;
+    double sampleRate;
+    double bitVolts;
+    int bufferSize;
+    std::string timestamps;
+    std::string events;
+    std::string output;
+    std::string archive;
+    std::vector<Module> modules;
+    DifferentiatorSettings differentiator;
+    PrefilterSettings prefilter;
+  };
+
+  struct GateOnset
+  {
+    int64_t timestamp;
+    int channel;
+  };
+
+  bool parseModule (const char* spec, Module& module)
+  {
+    double fields[5] = { -1, 0, -1, 0, 0 };
+    int numFields = 0;
+
+    for (const char* p = spec; numFields < 5; ++p)
+    {
+      char* end;
+      fields[numFields++] = std::strtod (p, &end);
+
+      if (end == p)
+        return false;
+      if (*end == 0)
+        break;
+      if (*end != ':')
+        return false;
+      p = end;
+    }
+
+    if (numFields < 2 || fields[0] < 0)
+      return false;
+
+    module.inputChan = (int) fields[0];
+    module.threshold = fields[1];
+    module.gateChan = (int) fields[2];
+    module.preTriggerMs = std::min (100.0, std::max (0.0, fields[3]));
+    module.outputChan = (int) fields[4];
+    return module.outputChan >= 0 && module.outputChan < 8;
+  }
+
+  bool parseDifferentiator (const std::string& spec, DifferentiatorSettings& settings)
+  {
+    const size_t colon = spec.find (':');
+    const std::string type = spec.substr (0, colon);
+    const char* fields = colon == std::string::npos ? "" : spec.c_str() + colon + 1;
+
+    char* end;
+    const long length = std::strtol (fields, &end, 10);
+    const double last = *end == ':' ? std::strtod (end + 1, &end) : 0;
+
+    if (type == "first" || type == "central")
+    {
+      settings.type = type == "first" ? DifferentiatorSettings::firstDifference : DifferentiatorSettings::centralDifference;
+      return colon == std::string::npos;
+    }
+
+    if (type != "sg" && type != "fir")
+      return false;
+
+    settings.type = type == "sg" ? DifferentiatorSettings::savitzkyGolay : DifferentiatorSettings::bandLimited;
+    settings.length = (int) length;
+    settings.order = (int) last;
+    settings.cutoff = last;
+
+    if (*end != 0 || length < 3 || length > 63)
+      return false;
+    return type == "sg" ? last >= 1 && last < length : last > 0 && last <= 1;
+  }
+
+  bool parsePrefilter (const std::string& spec, PrefilterSettings& settings)
+  {
+    const size_t colon = spec.find (':');
+    const std::string type = spec.substr (0, colon);
+    if (colon == std::string::npos)
+      return false;
+
+    double fields[3] = { 0, 0, 0 };
+    int numFields = 0;
+    for (const char* p = spec.c_str() + colon + 1; numFields < 3; ++p)
+    {
+      char* end;
+      fields[numFields++] = std::strtod (p, &end);
+
+      if (end == p)
+        return false;
+      if (*end == 0)
+        break;
+      if (*end != ':')
+        return false;
+      p = end;
+    }
+
+    settings.lowHz = fields[0];
+    if (type == "hp" && numFields <= 2)
+    {
+      settings.type = PrefilterSettings::highPass;
+      settings.order = numFields == 2 ? (int) fields[1] : 2;
+    }
+    else if (type == "notch" && numFields <= 2)
+    {
+      settings.type = PrefilterSettings::notch;
+      settings.q = numFields == 2 ? fields[1] : settings.q;
+    }
+    else if (type == "bp" && numFields >= 2)
+    {
+      settings.type = PrefilterSettings::bandPass;
+      settings.highHz = fields[1];
+      settings.order = numFields == 3 ? (int) fields[2] : 2;
+    }
+    else
+      return false;
+
+    return settings.lowHz > 0 && (type != "bp" || settings.highHz > settings.lowHz) && settings.q > 0
+      && settings.order >= 2 && settings.order <= 8 && settings.order % 2 == 0;
+  }
+
+  bool parseOptions (int argc, char** argv, Options& options)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      const std::string arg = argv[i];
+      const bool hasValue = i + 1 < argc;
+
+      if (arg == "--channels" && hasValue)
+        options.numChannels = std::atoi (argv[++i]);
+      else if (arg == "--rate" && hasValue)
+        options.sampleRate = std::atof (argv[++i]);
+      else if (arg == "--bit-volts" && hasValue)
+        options.bitVolts = std::atof (argv[++i]);
+      else if (arg == "--buffer" && hasValue)
+        options.bufferSize = std::atoi (argv[++i]);
+      else if (arg == "--timestamps" && hasValue)
+        options.timestamps = argv[++i];
+      else if (arg == "--events" && hasValue)
+        options.events = argv[++i];
+      else if (arg == "--output" && hasValue)
+        options.output = argv[++i];
+      else if (arg == "--archive" && hasValue)
+        options.archive = argv[++i];
+      else if (arg == "--module" && hasValue)
+      {
+        Module module;
+        if (!parseModule (argv[++i], module))
+          return false;
+        options.modules.push_back (module);
+      }
+      else if (arg == "--diff" && hasValue)
+      {
+        if (!parseDifferentiator (argv[++i], options.differentiator))
+          return false;
+      }
+      else if (arg == "--filter" && hasValue)
+      {
+        if (!parsePrefilter (argv[++i], options.prefilter))
+          return false;
+      }
+      else if (arg.compare (0, 2, "--") != 0 && options.input.empty())
+        options.input = arg;
+      else
+        return false;
+    }
+
+    if (options.timestamps.empty())
+    {
+      const size_t slash = options.input.find_last_of ("/\\");
+      const std::string folder = slash == std::string::npos ? std::string() : options.input.substr (0, slash + 1);
+
+      if (options.input.compare (folder.size(), std::string::npos, "continuous.dat") == 0)
+        options.timestamps = folder + "timestamps.npy";
+    }
+
+    for (const Module& module : options.modules)
+    {
+      if (module.inputChan >= options.numChannels)
+        return false;
+    }
+
+    return !options.input.empty() && options.numChannels > 0 && options.sampleRate > 0
+      && options.bufferSize > 0 && !options.modules.empty();
+  }
+
+  /** Rising edges of the recorded TTLs, in timestamp order. */
+  bool loadGateOnsets (const std::string& folder, std::vector<GateOnset>& onsets)
+  {
+    const NpyArray states (folder + "/channel_states.npy");
+    const NpyArray timestamps (folder + "/timestamps.npy");
+
+    if (!states.isOpen() || !timestamps.isOpen() || states.size() != timestamps.size())
+      return false;
+
+    for (size_t i = 0; i < states.size(); i++)
+    {
+      const int64_t state = states.getInt (i);
+
+      if (state > 0) // +(channel + 1) on, -(channel + 1) off
+      {
+        const GateOnset onset = { timestamps.getInt (i), (int) state - 1 };
+        onsets.push_back (onset);
+      }
+    }
+
+    std::stable_sort (onsets.begin(), onsets.end(),
+                      [] (const GateOnset& a, const GateOnset& b) { return a.timestamp < b.timestamp; });
+    return true;
+  }
+
+  /** Analyses each window as it closes, as the plugin's analysis thread does. */
+  class ReplaySink : public WindowSink
+  {
+  public:
+    ReplaySink (DetectorBank& b, std::vector<Module>& m, double rate, FILE* out, SweepArchiveWriter& a) :
+      bank (b), modules (m), sampleRate (rate), stims (out), archive (a), windows (0) {}
+
+    void windowClosed (int d) override
+    {
+      Module& module = modules[d];
+      const int count = bank.count[d];
+      const int length = std::min (bank.windowLength[d], (int) module.stimMean.size());
+
+      extractWaveformFeatures (bank.getStim (d), bank.windowStart[d], length, bank.preLength[d],
+                               module.ttlLength, module.movMean, module.stimMean.data(), module.features);
+
+      double last[NUM_WAVEFORM_PARAMS];
+      computeWaveformParams (module.features, count, module.ttlLength, sampleRate, last);
+      module.sweeps.add (bank.getStim (d), bank.windowLength[d]);
+
+      if (count > 0)
+      {
+        module.avg[0] = updateRunningMean (module.avg[0], last[0], count);
+        module.avg[1] = updateRunningMean (module.avg[1], last[1], count);
+        module.avg[2] = module.avg[1] - module.avg[0];
+        module.avg[3] = updateRunningMean (module.avg[3], last[3], count);
+        module.avg[4] = updateRunningMean (module.avg[4], last[4], count);
+        module.avg[5] = count;
+      }
+
+      if (archive.isOpen())
+      {
+        SweepInfo info;
+        info.startTimestamp = bank.windowStart[d];
+        info.sampleRate = sampleRate;
+        info.module = d;
+        info.row = 0;
+        info.count = count;
+        info.length = length;
+        info.preLength = bank.preLength[d];
+        info.flags = bank.gatedWindow[d] ? gatedFlag : 0;
+        archive.append (info, bank.getStim (d));
+      }
+
+      // first trigger candidate of a gated window against the gate, empty when there was none
+      char gateAlignment[32] = "";
+      if (bank.gatedWindow[d] && bank.gateAligned[d])
+        std::snprintf (gateAlignment, sizeof (gateAlignment), "%g", (double) bank.gateError[d] / sampleRate * 1000);
+
+      std::fprintf (stims, "%d,%lld,%lld,%g,%g,%g,%g,%g,%d,%d,%s\n", d, module.stims++,
+                    (long long) (bank.windowStart[d] + bank.preLength[d]),
+                    last[0], last[1], last[2], last[3], last[4], count, (int) bank.gatedWindow[d], gateAlignment);
+      windows++;
+    }
+
+    long long getNumWindows() const     { return windows; }
+
+  private:
+    DetectorBank& bank;
+    std::vector<Module>& modules;
+    double sampleRate;
+    FILE* stims;
+    SweepArchiveWriter& archive;
+    long long windows;
+  };
+}
+
+int main (int argc, char** argv)
+{
+  Options options;
+  if (!parseOptions (argc, argv, options))
+  {
+    std::fprintf (stderr, "usage: %s --channels n --module input:threshold[:gate[:preMs[:output]]] "
+                          "[--rate hz] [--bit-volts v] [--buffer n] [--timestamps file.npy] "
+                          "[--events dir] [--diff spec] [--filter spec] [--output prefix] [--archive file] <continuous.dat | file.i16>\n", argv[0]);
+    return 1;
+  }
+
+  MappedFile file (options.input);
+  if (!file.isOpen() || (file.getSize() > 0 && file.getData() == nullptr))
+  {
+    std::fprintf (stderr, "cannot map %s\n", options.input.c_str());
+    return 1;
+  }
+
+  const int numChannels = options.numChannels;
+  const int64_t numSamples = (int64_t) (file.getSize() / (sizeof (int16_t) * numChannels));
+  const int16_t* samples = (const int16_t*) file.getData();
+
+  std::unique_ptr<NpyArray> timestamps;
+  if (!options.timestamps.empty())
+  {
+    timestamps.reset (new NpyArray (options.timestamps));
+
+    if (!timestamps->isOpen())
+      timestamps.reset(); // flat files have no timestamps: count from zero
+    else if ((int64_t) timestamps->size() < numSamples)
+    {
+      std::fprintf (stderr, "%s has fewer timestamps than samples\n", options.timestamps.c_str());
+      return 1;
+    }
+  }
+
+  std::vector<GateOnset> onsets;
+  if (!options.events.empty() && !loadGateOnsets (options.events, onsets))
+  {
+    std::fprintf (stderr, "cannot read TTL events from %s\n", options.events.c_str());
+    return 1;
+  }
+
+  // the same sizes as prepareModule() and prepareBank()
+  std::vector<Module>& modules = options.modules;
+  const int numModules = (int) modules.size();
+  const double sampleRate = options.sampleRate;
+
+  int maxLength = 0;
+  int maxPreLength = 0;
+  for (Module& module : modules)
+  {
+    module.avgLength = (int) std::ceil (sampleRate * 0.040);
+    module.ttlLength = (int) std::ceil (sampleRate * 0.005);
+    module.movMean = (int) std::ceil (sampleRate * 0.005);
+    module.preLength = (int) std::ceil (sampleRate * module.preTriggerMs / 1000);
+    module.stimMean.resize (module.preLength + module.avgLength);
+
+    maxLength = std::max (maxLength, module.preLength + module.avgLength);
+    maxPreLength = std::max (maxPreLength, module.preLength);
+  }
+
+  DetectorBank bank;
+  DetectorEngine engine (bank);
+  bank.prepare (numModules, maxLength, maxPreLength + DifferentiatorSettings::maxLength / 2);
+
+  std::vector<std::unique_ptr<Differentiator>> differentiators;
+  std::vector<std::unique_ptr<Prefilter>> prefilters;
+
+  for (int d = 0; d < numModules; d++)
+  {
+    bank.threshold[d] = modules[d].threshold;
+    bank.outputChan[d] = modules[d].outputChan;
+    bank.windowLength[d] = modules[d].preLength + modules[d].avgLength;
+    bank.preLength[d] = modules[d].preLength;
+    bank.ttlLength[d] = modules[d].ttlLength;
+    bank.detectorStim[d] = modules[d].gateChan < 0;
+
+    if (options.differentiator.type != DifferentiatorSettings::firstDifference)
+    {
+      differentiators.emplace_back (new Differentiator (options.differentiator, Kernels::blockSize));
+      bank.differentiator[d] = differentiators.back().get();
+    }
+
+    if (options.prefilter.type != PrefilterSettings::none)
+    {
+      prefilters.emplace_back (new Prefilter (options.prefilter, sampleRate));
+      bank.prefilter[d] = prefilters.back().get();
+    }
+  }
+
+  // detectors grouped by input channel, as groupDetectors() does
+  std::vector<int> order (numModules);
+  for (int d = 0; d < numModules; d++)
+    order[d] = d;
+  std::stable_sort (order.begin(), order.end(),
+                    [&] (int a, int b) { return modules[a].inputChan < modules[b].inputChan; });
+
+  std::vector<int> groups;
+  for (int k = 0; k < numModules; k++)
+  {
+    if (k == 0 || modules[order[k]].inputChan != modules[order[k - 1]].inputChan)
+      groups.push_back (k);
+  }
+  groups.push_back (numModules);
+
+  const std::string stimsPath = options.output + "_stims.csv";
+  FILE* stims = std::fopen (stimsPath.c_str(), "w");
+  if (stims == nullptr)
+  {
+    std::fprintf (stderr, "cannot write %s\n", stimsPath.c_str());
+    return 1;
+  }
+  std::fprintf (stims, "module,stim,timestamp,min,max,peak_to_peak,latency,slope,count,gated,gate_alignment_ms\n");
+
+  SweepArchiveWriter archive;
+  if (!options.archive.empty() && !archive.open (options.archive))
+  {
+    std::fprintf (stderr, "cannot write %s\n", options.archive.c_str());
+    return 1;
+  }
+
+  ReplaySink sink (bank, modules, sampleRate, stims, archive);
+  DetectorEngine::Scratch scratch;
+  TtlEventBuffer events (numModules * options.bufferSize);   //at most one change per detector and sample
+  std::vector<float> channel (options.bufferSize);
+  long long numEvents = 0;
+  long long numGatesDropped = 0;
+  size_t nextOnset = 0;
+
+  const size_t frameBytes = sizeof (int16_t) * numChannels;
+  const size_t releaseBytes = (size_t) 64 << 20;
+  size_t releasedBytes = 0;
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  for (int64_t pos = 0; pos < numSamples; pos += options.bufferSize)
+  {
+    const int n = (int) std::min<int64_t> (options.bufferSize, numSamples - pos);
+    const int64_t bufferTimestamp = timestamps != nullptr ? timestamps->getInt ((size_t) pos) : pos;
+
+    // recorded onsets of this buffer, as handleEvent() queues them
+    bank.clearGateOnsets();
+    for (; nextOnset < onsets.size() && onsets[nextOnset].timestamp < bufferTimestamp + n; nextOnset++)
+    {
+      const GateOnset& onset = onsets[nextOnset];
+      if (onset.timestamp < bufferTimestamp)
+        continue;
+
+      for (int d = 0; d < numModules; d++)
+      {
+        if (modules[d].gateChan == onset.channel && !bank.addGateOnset (d, (int) (onset.timestamp - bufferTimestamp), onset.timestamp))
+          numGatesDropped++;
+      }
+    }
+
+    const int16_t* frame = samples + pos * numChannels;
+
+    for (size_t g = 0; g + 1 < groups.size(); g++)
+    {
+      const int inputChan = modules[order[groups[g]]].inputChan;
+
+      for (int i = 0; i < n; i++)
+        channel[i] = (float) (frame[(size_t) i * numChannels + inputChan] * options.bitVolts);
+
+      engine.processChannel (order.data() + groups[g], groups[g + 1] - groups[g], channel.data(), n,
+                             bufferTimestamp, scratch, events, sink, nullptr);
+    }
+
+    numEvents += (long long) events.size();
+    events.clear();
+
+    const size_t consumed = (size_t) (pos + n) * frameBytes;
+    if (consumed - releasedBytes >= releaseBytes)
+    {
+      file.release (consumed);
+      releasedBytes = consumed;
+    }
+  }
+
+  const double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+  std::fclose (stims);
+  archive.close();
+
+  // running averages: the avg waveform per module and its params
+  const std::string avgPath = options.output + "_avg.csv";
+  FILE* avg = std::fopen (avgPath.c_str(), "w");
+  if (avg == nullptr)
+  {
+    std::fprintf (stderr, "cannot write %s\n", avgPath.c_str());
+    return 1;
+  }
+
+  std::fprintf (avg, "module,min,max,peak_to_peak,latency,slope,count\n");
+  for (int d = 0; d < numModules; d++)
+  {
+    const double* p = modules[d].avg;
+    std::fprintf (avg, "%d,%g,%g,%g,%g,%g,%d\n", d, p[0], p[1], p[2], p[3], p[4], (int) p[5]);
+  }
+
+  // the statistics are kept in stim units
+  std::fprintf (avg, "\nmodule,sample,time_ms,avg_uv,sem_uv\n");
+  for (int d = 0; d < numModules; d++)
+  {
+    const SweepStatistics& sweeps = modules[d].sweeps;
+    const double scale = DetectorEngine::getStimScale();
+
+    for (int w = 0; w < sweeps.getLength(); w++)
+      std::fprintf (avg, "%d,%d,%g,%g,%g\n", d, w, (w - bank.preLength[d]) / sampleRate * 1000,
+                    sweeps.getMean()[w] * scale, sweeps.getSem (w) * scale);
+  }
+  std::fclose (avg);
+
+  const double recorded = numSamples / sampleRate;
+  std::printf ("{ \"samples\": %lld, \"channels\": %d, \"modules\": %d, \"buffer_size\": %d, "
+               "\"recorded_s\": %.3f, \"seconds\": %.6f, \"x_real_time\": %.1f, "
+               "\"ttl_events\": %lld, \"ttl_dropped\": %lld, \"gates_dropped\": %lld, \"windows\": %lld }\n",
+               (long long) numSamples, numChannels, numModules, options.bufferSize,
+               recorded, seconds, seconds > 0 ? recorded / seconds : 0.0,
+               numEvents, (long long) events.getNumDropped(), numGatesDropped, sink.getNumWindows());
+  return 0;
+}
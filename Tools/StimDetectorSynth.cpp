@@ -0,0 +1,272 @@
+/*
+  ------------------------------------------------------------------
+
+  This file is part of the Open Ephys GUI
+  Copyright (C) 2021 Open Ephys
+
+  ------------------------------------------------------------------
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Synthetic evoked-potential recordings with ground truth.
+
+  Usage: StimDetectorSynth [options] <output folder>
+
+    --channels n        channels, 16 by default
+    --rate hz           sample rate, 30000 by default
+    --seconds s         length of the recording, 10 by default
+    --seed n            random seed, 1 by default
+    --noise uv          background standard deviation, 10 by default
+    --stim-rate hz      stims per second, 10 by default
+    --jitter ms         uniform jitter of the stim times, 0 by default
+    --artifact uv       height of the stim artifact, 500 by default
+    --max uv            positive peak of the response, 40 by default
+    --min uv            trough of the response, -120 by default
+    --peak ms           time of the peak, 8 by default
+    --latency ms        time of the trough, 12 by default
+    --gain-jitter f     uniform jitter of the response amplitude, 0 by default
+    --format oe|int16   Open Ephys binary (default) or a flat interleaved int16 file
+    --bit-volts v       microvolts per bit, 0.195 by default
+    --no-write          only generate, to measure the generator itself
+
+  The Open Ephys layout is continuous/continuous.dat with timestamps.npy and
+  the stim onsets on TTL channel 0 in events/TTL_1, ready for the replay tool.
+  truth.csv holds the known params of every stim, in the units of the results
+  table; its latency runs from the artifact, where the table adds the TTL length.
+*/
+
+#include "SignalGenerator.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+ #include <direct.h>
+ #define makeDirectory(path) _mkdir (path)
+#else
+ #include <sys/stat.h>
+ #define makeDirectory(path) mkdir (path, 0755)
+#endif
+
+using namespace StimDetectorSpace;
+
+namespace
+{
+  struct Options
+  {
+    Options() : seconds (10), bitVolts (0.195), flat (false), write (true) {}
+
+    SynthSettings settings;
+    double seconds;
+    double bitVolts;
+    bool flat;
+    bool write;
+    std::string output;
+  };
+
+  bool parseOptions (int argc, char** argv, Options& options)
+  {
+    SynthSettings& s = options.settings;
+
+    for (int i = 1; i < argc; i++)
+    {
+      const std::string arg = argv[i];
+      const bool hasValue = i + 1 < argc;
+      const double value = hasValue ? std::atof (argv[i + 1]) : 0;
+
+      if (arg == "--no-write")            { options.write = false; continue; }
+      if (arg.compare (0, 2, "--") != 0)
+      {
+        if (!options.output.empty())
+          return false;
+        options.output = arg;
+        continue;
+      }
+      if (!hasValue)
+        return false;
+
+      if (arg == "--channels")            s.numChannels = (int) value;
+      else if (arg == "--rate")           s.sampleRate = value;
+      else if (arg == "--seconds")        options.seconds = value;
+      else if (arg == "--seed")           s.seed = std::strtoull (argv[i + 1], nullptr, 10);
+      else if (arg == "--noise")          s.noise = value;
+      else if (arg == "--stim-rate")      s.stimRate = value;
+      else if (arg == "--jitter")         s.jitter = value;
+      else if (arg == "--artifact")       s.artifact = value;
+      else if (arg == "--max")            s.responseMax = value;
+      else if (arg == "--min")            s.responseMin = value;
+      else if (arg == "--peak")           s.peakTime = value;
+      else if (arg == "--latency")        s.latency = value;
+      else if (arg == "--gain-jitter")    s.gainJitter = value;
+      else if (arg == "--bit-volts")      options.bitVolts = value;
+      else if (arg == "--format")         options.flat = std::strcmp (argv[i + 1], "int16") == 0;
+      else
+        return false;
+      i++;
+    }
+
+    return (options.write ? !options.output.empty() : true)
+      && s.numChannels > 0 && s.sampleRate > 0 && options.seconds > 0 && options.bitVolts > 0
+      && s.peakTime > 0 && s.latency > s.peakTime && s.recovery > 0;
+  }
+
+  /** A one-dimensional little-endian .npy array, version 1.0. */
+  bool writeNpy (const std::string& path, const char* descr, const void* values, size_t count, size_t itemSize)
+  {
+    FILE* f = std::fopen (path.c_str(), "wb");
+    if (f == nullptr)
+      return false;
+
+    std::string header = "{'descr': '" + std::string (descr) + "', 'fortran_order': False, 'shape': ("
+                       + std::to_string (count) + ",), }";
+    header.append ((64 - (10 + header.size() + 1) % 64) % 64, ' ');
+    header += '\n';
+
+    const unsigned char preamble[10] = { 0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+                                         (unsigned char) (header.size() & 0xFF), (unsigned char) (header.size() >> 8) };
+    const bool ok = std::fwrite (preamble, 1, sizeof (preamble), f) == sizeof (preamble)
+      && std::fwrite (header.data(), 1, header.size(), f) == header.size()
+      && std::fwrite (values, itemSize, count, f) == count;
+
+    return std::fclose (f) == 0 && ok;
+  }
+}
+
+int main (int argc, char** argv)
+{
+  Options options;
+  if (!parseOptions (argc, argv, options))
+  {
+    std::fprintf (stderr, "usage: %s [--channels n] [--rate hz] [--seconds s] [--seed n] [--noise uv] "
+                          "[--stim-rate hz] [--jitter ms] [--artifact uv] [--max uv] [--min uv] [--peak ms] "
+                          "[--latency ms] [--gain-jitter f] [--format oe|int16] [--bit-volts v] "
+                          "[--no-write] <output folder>\n", argv[0]);
+    return 1;
+  }
+
+  const SynthSettings& settings = options.settings;
+  const int numChannels = settings.numChannels;
+  const int64_t numSamples = (int64_t) (settings.sampleRate * options.seconds);
+  const int blockSize = 4096;
+
+  std::string dataPath;
+  FILE* data = nullptr;
+
+  if (options.write)
+  {
+    makeDirectory (options.output.c_str());
+
+    if (options.flat)
+      dataPath = options.output + "/continuous.i16";
+    else
+    {
+      makeDirectory ((options.output + "/continuous").c_str());
+      makeDirectory ((options.output + "/events").c_str());
+      makeDirectory ((options.output + "/events/TTL_1").c_str());
+      dataPath = options.output + "/continuous/continuous.dat";
+    }
+
+    data = std::fopen (dataPath.c_str(), "wb");
+    if (data == nullptr)
+    {
+      std::fprintf (stderr, "cannot write %s\n", dataPath.c_str());
+      return 1;
+    }
+  }
+
+  SignalGenerator generator (settings);
+  std::vector<SynthStim> stims;
+  std::vector<int16_t> frames ((size_t) blockSize * numChannels);
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  for (int64_t pos = 0; pos < numSamples; pos += blockSize)
+  {
+    const int n = (int) std::min<int64_t> (blockSize, numSamples - pos);
+    generator.generateInterleaved (frames.data(), n, options.bitVolts, stims);
+
+    if (data != nullptr && std::fwrite (frames.data(), sizeof (int16_t) * numChannels, n, data) != (size_t) n)
+    {
+      std::fprintf (stderr, "cannot write %s\n", dataPath.c_str());
+      return 1;
+    }
+  }
+
+  const double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+
+  // jitter may schedule a stim past the end
+  while (!stims.empty() && stims.back().sample >= numSamples)
+    stims.pop_back();
+
+  if (data != nullptr)
+  {
+    bool ok = std::fclose (data) == 0;
+
+    if (!options.flat)
+    {
+      std::vector<int64_t> timestamps ((size_t) numSamples);
+      for (int64_t i = 0; i < numSamples; i++)
+        timestamps[(size_t) i] = i;
+
+      // the stim onsets on TTL channel 0, 1 ms long
+      const int64_t ttlLength = std::max<int64_t> (1, (int64_t) (settings.sampleRate / 1000));
+      std::vector<int16_t> states;
+      std::vector<int64_t> eventTimestamps;
+      for (const SynthStim& stim : stims)
+      {
+        states.push_back (1);
+        eventTimestamps.push_back (stim.sample);
+        states.push_back (-1);
+        eventTimestamps.push_back (stim.sample + ttlLength);
+      }
+
+      ok = ok && writeNpy (options.output + "/continuous/timestamps.npy", "<i8", timestamps.data(), timestamps.size(), sizeof (int64_t))
+              && writeNpy (options.output + "/events/TTL_1/channel_states.npy", "<i2", states.data(), states.size(), sizeof (int16_t))
+              && writeNpy (options.output + "/events/TTL_1/timestamps.npy", "<i8", eventTimestamps.data(), eventTimestamps.size(), sizeof (int64_t));
+    }
+
+    FILE* truth = std::fopen ((options.output + "/truth.csv").c_str(), "w");
+    ok = ok && truth != nullptr;
+    if (truth != nullptr)
+    {
+      std::fprintf (truth, "stim,timestamp,gain,min,max,peak_to_peak,latency,slope\n");
+      for (size_t i = 0; i < stims.size(); i++)
+      {
+        const SynthStim& s = stims[i];
+        std::fprintf (truth, "%d,%lld,%g,%g,%g,%g,%g,%g\n", (int) i, (long long) s.sample, s.gain,
+                      s.yMin, s.yMax, s.yMax - s.yMin, s.latency, s.slope);
+      }
+      ok = std::fclose (truth) == 0 && ok;
+    }
+
+    if (!ok)
+    {
+      std::fprintf (stderr, "cannot write %s\n", options.output.c_str());
+      return 1;
+    }
+  }
+
+  const double total = (double) numSamples * numChannels;
+  std::printf ("{ \"channels\": %d, \"samples\": %lld, \"stims\": %d, \"seconds\": %.6f, "
+               "\"samples_per_s\": %.0f, \"x_real_time\": %.1f }\n",
+               numChannels, (long long) numSamples, (int) stims.size(), seconds,
+               seconds > 0 ? total / seconds : 0.0, seconds > 0 ? options.seconds / seconds : 0.0);
+  return 0;
+}